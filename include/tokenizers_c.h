@@ -38,6 +38,64 @@ namespace rust
 			std::swap(len, _Other.len);
 		}
 	};
+
+	/*! \brief Estimated heap bytes of the tables of a Rust tokenizer. */
+	struct MemoryUsage
+	{
+		size_t vocab;
+		size_t merges;
+		size_t added_tokens;
+	};
+
+	/*!
+	 * \brief An encoded batch in one allocation. Item i spans
+	 *  [offsets[i], offsets[i + 1]) of ids, type_ids, attention_mask and
+	 *  special_tokens_mask. Free with tokenizers_flat_encodings_free.
+	 */
+	struct FlatEncodings
+	{
+		size_t num_seqs;
+		size_t num_tokens;
+		const uint32_t* offsets;
+		const uint32_t* ids;
+		const uint32_t* type_ids;
+		const uint32_t* attention_mask;
+		const uint32_t* special_tokens_mask;
+		Vec buffer;
+	};
+
+	/*! \brief Pool the Rust batch calls and tokenizers_parallel_for run on. */
+	struct ThreadPoolConfig
+	{
+		/*!
+		 * \brief Number of workers, 0 to go back to rayon's global pool and the
+		 *  parallelism setting in effect before the first pool.
+		 */
+		size_t num_threads;
+		/*! \brief Called on each worker as it starts, may be NULL. */
+		void (*on_thread_start)(size_t index, void* user_data);
+		/*!
+		 * \brief Runs worker_main(worker) on a thread of the caller instead of a
+		 *  new one, returns 0 on success. NULL to let rayon spawn the threads.
+		 */
+		int32_t (*spawn)(void (*worker_main)(void*), void* worker, void* user_data);
+		void* user_data;
+	};
+
+	/*! \brief Bounds on the work of one encode call, see tokenizers::EncodeGuard. */
+	struct EncodeGuard
+	{
+		size_t max_piece_bytes;
+		size_t work_budget;
+		uint64_t time_budget_us;
+	};
+
+	/*! \brief Number of times the guards of the Rust tokenizers triggered. */
+	struct EncodeGuardStats
+	{
+		uint64_t pieces_split;
+		uint64_t budget_exceeded;
+	};
 } // namespace rust
 
 namespace tokenizers
@@ -71,6 +129,20 @@ extern "C"
 		EncodingHandle tokenizers_encode(TokenizerHandle handle, const char* input_cstr,
 			uintptr_t len, int32_t add_special_tokens);
 
+		EncodingHandle tokenizers_encode_parallel(TokenizerHandle handle, const char* input_cstr,
+			uintptr_t len, int32_t add_special_tokens);
+
+		size_t tokenizers_count_tokens(TokenizerHandle handle, const char* input_cstr,
+			uintptr_t len, int32_t add_special_tokens, size_t limit);
+
+		void tokenizers_count_tokens_batch(TokenizerHandle handle,
+			const void* input_cstr,
+			uintptr_t num_seqs,
+			int32_t add_special_tokens,
+			size_t limit,
+			CustomConvertArrayHandleOffset convert_array_offset,
+			size_t* output);
+
 		::rust::ArrayHandle tokenizers_encoding_ids(EncodingHandle encoding_handle);
 
 		::rust::ArrayHandle tokenizers_encoding_type_ids(EncodingHandle encoding_handle);
@@ -91,6 +163,23 @@ extern "C"
 			int32_t add_special_tokens,
 			CustomConvertArrayHandleOffset convert_array_offset);
 
+		::rust::FlatEncodings tokenizers_encode_batch_flat(TokenizerHandle handle,
+			const void* input_cstr,
+			uintptr_t num_seqs,
+			int32_t add_special_tokens,
+			CustomConvertArrayHandleOffset convert_array_offset);
+
+		::rust::FlatEncodings tokenizers_encode_pair_batch_flat(TokenizerHandle handle,
+			const void* firsts_cstr,
+			uintptr_t num_firsts,
+			const void* seconds_cstr,
+			uintptr_t num_pairs,
+			const size_t* first_index,
+			int32_t add_special_tokens,
+			size_t max_length,
+			int32_t truncation,
+			CustomConvertArrayHandleOffset convert_array_offset);
+
 		::rust::Vec tokenizers_decode(TokenizerHandle handle, const uint32_t* input_ids,
 			uintptr_t len, int32_t skip_special_tokens);
 
@@ -98,16 +187,75 @@ extern "C"
 			size_t raws, int32_t skip_special_tokens,
 			CustomConvertArrayHandleOffset convert_array_offset);
 
+		/*!
+		 * \brief Decode into out[0, capacity). Returns the byte length of the
+		 *  text, written only when it fits, so capacity 0 queries the size. A
+		 *  query followed by the fill of the same ids decodes once.
+		 */
+		size_t tokenizers_decode_into(TokenizerHandle handle, const uint32_t* input_ids,
+			uintptr_t len, int32_t skip_special_tokens, char* out, size_t capacity);
+
+		/*!
+		 * \brief Decode a batch into out[0, capacity), text i at [offsets[i],
+		 *  offsets[i + 1]). The num_seqs + 1 offsets are always written, the
+		 *  texts only when all fit. Returns the total byte length.
+		 */
+		size_t tokenizers_decode_batch_into(TokenizerHandle handle, const void* input_ids,
+			size_t num_seqs, int32_t skip_special_tokens,
+			CustomConvertArrayHandleOffset convert_array_offset,
+			char* out, size_t capacity, size_t* offsets);
+
+		/*! \brief tokenizers_decode_into into the buffer allocator(length, allocator_args) returns. */
+		size_t tokenizers_decode_into_alloc(TokenizerHandle handle, const uint32_t* input_ids,
+			uintptr_t len, int32_t skip_special_tokens,
+			CustomAllocator allocator, CustomAllocatorArgs allocator_args);
+
+		/*! \brief tokenizers_decode_batch_into into the buffer allocator(total, allocator_args) returns. */
+		size_t tokenizers_decode_batch_into_alloc(TokenizerHandle handle, const void* input_ids,
+			size_t num_seqs, int32_t skip_special_tokens,
+			CustomConvertArrayHandleOffset convert_array_offset,
+			CustomAllocator allocator, CustomAllocatorArgs allocator_args, size_t* offsets);
+
 		size_t tokenizers_get_vocab_size(TokenizerHandle handle);
 
 		::rust::Vec tokenizers_id_to_token(TokenizerHandle handle, uint32_t id);
 
+		void tokenizers_vocab_tokens(
+			TokenizerHandle handle,
+			CustomAllocator allocator,
+			CustomAllocatorArgs allocator_args,
+			CustomEmplaceBackArray emplace_back);
+
+		void tokenizers_vocab_token_bytes(
+			TokenizerHandle handle,
+			CustomAllocator allocator,
+			CustomAllocatorArgs allocator_args,
+			CustomEmplaceBackArray emplace_back);
+
+		::rust::MemoryUsage tokenizers_memory_usage(TokenizerHandle handle);
+
+		size_t tokenizers_add_special_tokens(TokenizerHandle handle,
+			const void* input_cstr,
+			uintptr_t num_tokens,
+			CustomConvertArrayHandleOffset convert_array_offset);
+
 		uint32_t tokenizers_token_to_id(TokenizerHandle handle, const char* token, uintptr_t len);
 
+		int32_t tokenizers_use_fast_pre_tokenizer(TokenizerHandle handle, int32_t enable);
+
+		void tokenizers_set_encode_guard(TokenizerHandle handle, const ::rust::EncodeGuard* guard);
+
+		::rust::EncodeGuardStats tokenizers_encode_guard_stats();
+
+		int32_t tokenizers_configure_thread_pool(const ::rust::ThreadPoolConfig* config);
+
+		void tokenizers_parallel_for(size_t n, void (*body)(void* ctx, size_t index), void* ctx);
+
 		void tokenizers_free(TokenizerHandle handle);
 		void tokenizers_encoding_free(EncodingHandle handle);
 		void tokenizers_encoding_free_with_args(const char* ptr, size_t len, size_t capacity);
 		void tokenizers_encodings_free(::rust::Vec* handle);
+		void tokenizers_flat_encodings_free(::rust::FlatEncodings* handle);
 		void tokenizers_exported_string_free(::rust::Vec* handle);
 		void tokenizers_exported_strings_free(::rust::Vec* handle);
 		void tokenizers_exported_strings_free_without_string_free(::rust::Vec* handle);
@@ -123,6 +271,9 @@ namespace tokenizers
 {
 	void* alloc_string(size_t len, void* args);
 
+	/*! \brief Resize the std::string args to len, without a terminator past it. */
+	void* resize_string(size_t len, void* args);
+
 	::rust::ArrayHandle fetch_string(void* arr, size_t offset);
 
 	template <class _Ty, class _Alloc = std::allocator<_Ty>>
@@ -0,0 +1,88 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_cache.h
+ * \brief Bounded pre-token to ids cache shared by all encoding threads
+ */
+#ifndef TOKENIZERS_CACHE_H_
+#define TOKENIZERS_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace tokenizers
+{
+	/*! \brief Counters of an EncodeCache since it was created or cleared. */
+	struct EncodeCacheStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		/*! \brief Entries held now, at most capacity. */
+		size_t entries = 0;
+		size_t capacity = 0;
+
+		inline double HitRate() const
+		{
+			uint64_t lookups = hits + misses;
+			return lookups ? static_cast<double>(hits) / lookups : 0.0;
+		}
+	};
+
+	/*!
+	 * \brief Cache of the ids of pre-tokens, e.g. the words of natural text,
+	 *  bounded to a number of entries and safe to use from any thread.
+	 *
+	 *  Entries are spread over shards with a lock and a least recently used
+	 *  list each, so threads looking up different pieces rarely contend. The
+	 *  backends only cache pieces whose ids do not depend on the surrounding
+	 *  text, encodings are the same with and without the cache.
+	 */
+	class EncodeCache
+	{
+	public:
+		/*! \brief Longer pieces are not cached, they seldom repeat. */
+		static constexpr size_t kMaxPieceBytes = 64;
+
+		/*! \param capacity The number of pieces kept, at least one. */
+		explicit EncodeCache(size_t capacity);
+		~EncodeCache();
+
+		EncodeCache(const EncodeCache&) = delete;
+		EncodeCache& operator=(const EncodeCache&) = delete;
+
+		/*! \brief Append the cached ids of piece to ids, false on a miss. */
+		bool Lookup(std::string_view piece, std::vector<uint32_t>& ids);
+		bool Lookup(std::string_view piece, std::vector<int32_t>& ids);
+
+		/*! \brief Cache the ids of piece, evicting the least recently used piece of its shard when full. */
+		void Insert(std::string_view piece, const uint32_t* ids, size_t num_ids);
+		void Insert(std::string_view piece, const int32_t* ids, size_t num_ids);
+
+		/*! \brief Drop all entries and reset the counters. */
+		void Clear();
+
+		EncodeCacheStats GetStats() const;
+
+		/*! \brief Heap bytes held by the entries. */
+		size_t MemoryUsage() const;
+
+		inline size_t Capacity() const { return capacity_; }
+
+	private:
+		struct Shard;
+
+		Shard& ShardOf(std::string_view piece) const;
+
+		template <class _Ty>
+		bool LookupAs(std::string_view piece, std::vector<_Ty>& ids);
+
+		template <class _Ty>
+		void InsertAs(std::string_view piece, const _Ty* ids, size_t num_ids);
+
+		size_t capacity_;
+		std::vector<std::unique_ptr<Shard>> shards_;
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_CACHE_H_
@@ -0,0 +1,53 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_compiled.h
+ * \brief Tokenizers linked into the binary as static tables, see tokenizer_codegen
+ */
+#ifndef TOKENIZERS_COMPILED_H_
+#define TOKENIZERS_COMPILED_H_
+
+#include "tokenizers_registry.h"
+#include "tokenizers_vocab.h"
+
+#include <string_view>
+#include <vector>
+
+namespace tokenizers
+{
+	/*!
+	 * \brief A tokenizer emitted as C++ source by tokenizer_codegen.
+	 *
+	 *  All members point at static const data, which lands in read-only pages
+	 *  shared by every process mapping the binary. Tokenizer::FromCompiled
+	 *  builds the tokenizer over the vocabulary images without copying or
+	 *  hashing them.
+	 */
+	struct CompiledTokenizer
+	{
+		std::string_view name;
+		TokenizerSource::Format format = TokenizerSource::Format::kJSON;
+		/*! \brief The tokenizer.json or sentencepiece model, empty for RWKV world. */
+		std::string_view source;
+		/*! \brief The table of Tokenizer::GetVocabTable. */
+		VocabTable::Image vocab;
+		/*! \brief The table of Tokenizer::GetDecodedVocab, no offsets if it is the vocabulary. */
+		VocabTable::Image decoded_vocab;
+	};
+
+	/*!
+	 * \brief Adds a compiled tokenizer to the process-wide list at static
+	 *  initialization. Generated sources define one at namespace scope.
+	 */
+	class CompiledTokenizerRegistration
+	{
+	public:
+		explicit CompiledTokenizerRegistration(const CompiledTokenizer& tokenizer);
+	};
+
+	/*! \brief The compiled tokenizer registered under name, NULL if there is none. */
+	const CompiledTokenizer* FindCompiledTokenizer(std::string_view name);
+
+	/*! \brief Names of all compiled tokenizers linked into the binary. */
+	std::vector<std::string_view> CompiledTokenizerNames();
+} // namespace tokenizers
+#endif // TOKENIZERS_COMPILED_H_
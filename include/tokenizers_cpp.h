@@ -10,6 +10,19 @@
 #include <torch/script.h>
 #endif // ENABLE_TORCH
 
+#ifdef ENABLE_DLPACK
+#include <dlpack/dlpack.h>
+#endif // ENABLE_DLPACK
+
+#include "tokenizers_cache.h"
+#include "tokenizers_match.h"
+#include "tokenizers_vocab.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
@@ -53,6 +66,64 @@ namespace tokenizers
 		std::optional<std::vector<uint32_t>> attention_mask = std::nullopt;
 	};
 
+	/*!
+	 * \brief Integer type of the padded batch buffers. Single-sequence Encode
+	 *  results are always uint32 views.
+	 */
+	enum class IdType
+	{
+		kUInt32,
+		kInt32,
+		kInt64,
+	};
+
+	/*!
+	 * \brief How EncodePair shortens a pair longer than max_length, as the
+	 *  strategies of the same names in HF tokenizers.
+	 */
+	enum class TruncationStrategy
+	{
+		/*! \brief Cut the longer sequence first, both to half once they are even. */
+		kLongestFirst = 0,
+		/*!
+		 * \brief Cut the second sequence only. If the first alone does not fit,
+		 *  the second is dropped and the pair stays longer than max_length.
+		 */
+		kOnlySecond = 1,
+	};
+
+	/*! \brief A padded rows x max_len buffer of uint32, int32 or int64 ids. */
+	class IdBuffer
+	{
+	public:
+		IdBuffer() = default;
+
+		inline IdBuffer(IdType type, size_t size)
+			: type_(type), size_(size), storage_(new uint64_t[(size * element_size(type) + 7) / 8])
+		{
+		}
+
+		static inline size_t element_size(IdType type) { return type == IdType::kInt64 ? 8 : 4; }
+
+		inline IdType type() const { return type_; }
+
+		/*! \brief Number of elements. */
+		inline size_t size() const { return size_; }
+
+		inline void* data() const { return storage_.get(); }
+
+		template <class _Ty>
+		inline _Ty* data() const { return reinterpret_cast<_Ty*>(storage_.get()); }
+
+		/*! \brief Owner of the elements, for views that must keep them alive. */
+		inline std::shared_ptr<void> storage() const { return storage_; }
+
+	private:
+		IdType type_ = IdType::kUInt32;
+		size_t size_ = 0;
+		std::shared_ptr<uint64_t[]> storage_;
+	};
+
 	struct EncodeAdvancedPayload
 	{
 		std::shared_ptr<void> payload = NULL;
@@ -129,65 +200,47 @@ namespace tokenizers
 
 		size_t max_len = 0;
 
-		inline void update(std::vector<array_view<uint32_t>>& src, std::optional<std::vector<uint32_t>>& target)
-		{
-			size_t total = src.size() * max_len;
-			std::vector<uint32_t> arr(total, 0);
-			for (size_t i = 0; i < src.size(); i++)
-			{
-				std::memcpy(arr.data() + i * max_len, src[i].data(), src[i].size());
-			}
-			target = arr;
-		}
+		/*!
+		 * \brief Element type written by update(). kUInt32 fills ids, attention_mask
+		 *  and type_ids; kInt32 and kInt64 fill the typed_* buffers instead, so
+		 *  models taking int64 inputs need no second conversion pass.
+		 */
+		IdType id_type = IdType::kUInt32;
 
-		inline void update_max_len(const std::optional<array_view<uint32_t>>& arr)
-		{
-			auto& temp = arr.value();
-			if (temp.size() > max_len)
-				max_len = temp.size();
-		}
+		std::optional<IdBuffer> typed_ids = std::nullopt;
+		std::optional<IdBuffer> typed_type_ids = std::nullopt;
+		std::optional<IdBuffer> typed_attention_mask = std::nullopt;
 
-		inline void update()
+		/*!
+		 * \brief Set id_type. With torch, the tensor dtype follows it, so the
+		 *  typed buffers are handed to torch as they are instead of being cast
+		 *  back to uint32; set type afterwards to convert anyway.
+		 */
+		inline void set_id_type(IdType id)
 		{
-			std::vector<array_view<uint32_t>> temp_ids, temp_attention_mask, temp_type_ids;
-			temp_ids.resize(encodings.size());
-			temp_attention_mask.resize(encodings.size());
-			temp_type_ids.resize(encodings.size());
-
-			bool has_ids = false, has_mask = false, has_tids = false;
-
-			max_len = 0;
+			id_type = id;
+#ifdef ENABLE_TORCH
+			if (id == IdType::kInt32)
+				type = torch::kInt32;
+			else if (id == IdType::kInt64)
+				type = torch::kInt64;
+#endif // ENABLE_TORCH
+		}
 
-			for (size_t i = 0; i < encodings.size(); i++)
-			{
-				auto& e = encodings[i];
-				if (e.ids.has_value())
-				{
-					has_ids = true;
-					update_max_len(e.ids);
-					temp_ids[i] = e.ids.value();
-				}
-				if (e.attention_mask.has_value())
-				{
-					has_mask = true;
-					update_max_len(e.attention_mask);
-					temp_attention_mask[i] = e.attention_mask.value();
-				}
-				if (e.type_ids.has_value())
-				{
-					has_tids = true;
-					update_max_len(e.type_ids);
-					temp_type_ids[i] = e.type_ids.value();
-				}
-			}
+		/*!
+		 * \brief Input index of each row, set on every sub-batch of a scheduled
+		 *  EncodeBatch: row i holds texts[permutation[i]]. With Order::kInput it
+		 *  is the contiguous range of texts the sub-batch covers. Empty on the
+		 *  batches of the other Encode calls, whose rows are in input order.
+		 */
+		std::vector<size_t> permutation;
 
-			if (has_ids)
-				update(temp_ids, ids);
-			if(has_mask)
-				update(temp_attention_mask, attention_mask);
-			if (has_tids)
-				update(temp_type_ids, type_ids);
-		}
+		/*!
+		 * \brief Pad the rows of encodings to max_len into the buffers of
+		 *  id_type, the ids, mask and type ids of a row together, one row per
+		 *  task of the ThreadPool.
+		 */
+		void update();
 
 		inline void updateOnce()
 		{
@@ -214,6 +267,26 @@ namespace tokenizers
 			args.insert({ std::string(key), tensor });
 		}
 
+		inline void insert(torch::jit::Kwargs& args,
+			std::string_view key,
+			IdBuffer& arr)
+		{
+			torch::Dtype dtype = arr.type() == IdType::kInt64 ? torch::kInt64 : torch::kInt32;
+			// the tensor shares the buffer and keeps it alive
+			auto storage = arr.storage();
+			auto tensor = torch::from_blob(arr.data(),
+				{ static_cast<long long>(arr.size() / max_len), static_cast<long long>(max_len) },
+				[storage](void*) {},
+				c10::TensorOptions(dtype));
+			if (type != dtype)
+				tensor = tensor.to(type);
+
+			if (device != global::CPU)
+				tensor = tensor.to(device);
+
+			args.insert({ std::string(key), tensor });
+		}
+
 		inline operator torch::jit::Kwargs()
 		{
 			torch::jit::Kwargs args;
@@ -224,17 +297,29 @@ namespace tokenizers
 
 				updateOnce();
 
-				if (ids.has_value())
+				if (typed_ids.has_value())
+				{
+					insert(args, "input_ids", typed_ids.value());
+				}
+				else if (ids.has_value())
 				{
 					insert(args, "input_ids", ids.value(), options);
 				}
 
-				if (attention_mask.has_value())
+				if (typed_attention_mask.has_value())
+				{
+					insert(args, "attention_mask", typed_attention_mask.value());
+				}
+				else if (attention_mask.has_value())
 				{
 					insert(args, "attention_mask", attention_mask.value(), options);
 				}
 
-				if (type_ids.has_value())
+				if (typed_type_ids.has_value())
+				{
+					insert(args, "token_type_ids", typed_type_ids.value());
+				}
+				else if (type_ids.has_value())
 				{
 					insert(args, "token_type_ids", type_ids.value(), options);
 				}
@@ -245,6 +330,92 @@ namespace tokenizers
 #endif // ENABLE_TORCH
 	};
 
+#ifdef ENABLE_DLPACK
+	/*! \brief The padded buffers of an EncodingBatch. */
+	enum class BatchTensor
+	{
+		kIds,
+		kAttentionMask,
+		kTypeIds,
+	};
+
+	/*!
+	 * \brief Export a padded [rows, max_len] buffer of batch as a DLPack CPU
+	 *  tensor of batch->id_type, without copying it. The tensor holds a
+	 *  reference to batch, so the buffer and the payload stay alive until the
+	 *  consumer calls its deleter. Pads the batch first if needed.
+	 * \returns The tensor, NULL if the batch has no such buffer.
+	 */
+	DLManagedTensor* ToDLPack(std::shared_ptr<EncodingBatch> batch, BatchTensor tensor);
+#endif // ENABLE_DLPACK
+
+	/*!
+	 * \brief How a scheduled EncodeBatch groups its inputs into padded
+	 *  sub-batches. Each sub-batch is padded to its own longest row only.
+	 */
+	struct BatchSchedule
+	{
+		enum class Order
+		{
+			/*! \brief Keep input order, only split under the budgets. */
+			kInput,
+			/*! \brief Sort rows by encoded length, shortest first. */
+			kSorted,
+			/*!
+			 * \brief Group rows whose lengths fall in the same bucket_width wide
+			 *  bucket, in input order within a bucket. Sub-batches do not span buckets.
+			 */
+			kBucketed,
+		};
+
+		Order order = Order::kSorted;
+
+		/*! \brief Width of the length buckets of kBucketed. */
+		size_t bucket_width = 64;
+
+		/*!
+		 * \brief Max rows x padded length of one sub-batch, 0 for no limit. A row
+		 *  longer than the budget gets a sub-batch of its own.
+		 */
+		size_t max_tokens = 0;
+
+		/*! \brief Max rows of one sub-batch, 0 for no limit. */
+		size_t max_rows = 0;
+	};
+
+	/*!
+	 * \brief Bounds on the work of one Encode or CountTokens call, so that
+	 *  pathological input such as a long base64 run cannot stall a worker.
+	 *
+	 *  Runs longer than max_piece_bytes are cut into pieces of at most that
+	 *  many bytes at character boundaries, and tokens never span a cut. Once a
+	 *  call has matched work_budget bytes or run for time_budget, the rest of
+	 *  its input is tokenized one character (HF) or byte (RWKV world) at a
+	 *  time. Results only differ from unguarded ones where a guard triggered.
+	 */
+	struct EncodeGuard
+	{
+		/*! \brief Cap on the bytes of one pre-token, 0 for no cap. */
+		size_t max_piece_bytes = 0;
+
+		/*! \brief Bytes the model may match per call, 0 for no limit. */
+		size_t work_budget = 0;
+
+		/*! \brief Wall-clock budget per call, 0 for none. Not deterministic. */
+		std::chrono::microseconds time_budget{ 0 };
+
+		inline bool Enabled() const { return max_piece_bytes || work_budget || time_budget.count() > 0; }
+	};
+
+	/*! \brief Number of times the guards of all tokenizers triggered. */
+	struct EncodeGuardStats
+	{
+		/*! \brief Pre-tokens cut by max_piece_bytes. */
+		uint64_t pieces_split = 0;
+		/*! \brief Calls that ran out of their work or time budget. */
+		uint64_t budget_exceeded = 0;
+	};
+
 	struct DecodePayload
 	{
 		std::optional<std::string> buff = std::nullopt;
@@ -267,6 +438,31 @@ namespace tokenizers
 		for (size_t i = 0; i < decodings.size(); i++) res.emplace_back(decodings[i]);
 	}
 
+	/*! \brief Heap bytes held by one part of a tokenizer. */
+	struct MemoryComponent
+	{
+		std::string name;
+		size_t bytes = 0;
+	};
+
+	/*!
+	 * \brief Memory held by one tokenizer instance, by component. Structures
+	 *  owned by the Rust and sentencepiece libraries are estimated from their
+	 *  entry counts and sizes.
+	 */
+	struct MemoryReport
+	{
+		std::vector<MemoryComponent> components;
+
+		inline size_t Total() const
+		{
+			size_t total = 0;
+			for (auto& c : components)
+				total += c.bytes;
+			return total;
+		}
+	};
+
 	/*!
 	 * \brief a universal tokenizer that loads
 	 *  either HF's tokenizer or sentence piece,
@@ -286,13 +482,96 @@ namespace tokenizers
 		virtual Encoding Encode(std::string_view text,
 			bool add_special_tokens = true) = 0;
 
+		/*!
+		 * \brief Encode one long text with its pre-tokens tokenized in parallel.
+		 *  The result is identical to Encode. Backends without a split that
+		 *  provably keeps it identical encode sequentially.
+		 */
+		virtual Encoding EncodeParallel(std::string_view text,
+			bool add_special_tokens = true);
+
 		/*!
 		 * \brief EncodeResult a batch of texts into ids.
 		 * \param texts The input texts.
+		 * \param id_type The element type of the padded batch buffers.
 		 * \returns The encoded token ids.
 		 */
 		virtual EncodingBatch EncodeBatch(const std::vector<std::string_view>& texts,
-			bool add_special_tokens = true);
+			bool add_special_tokens = true,
+			IdType id_type = IdType::kUInt32);
+
+		/*!
+		 * \brief EncodeResult a batch of texts into sub-batches, grouped by encoded
+		 *  length so that little of each padded tensor is padding.
+		 * \param texts The input texts.
+		 * \param schedule How rows are ordered and split.
+		 * \param id_type The element type of the padded batch buffers.
+		 * \returns The sub-batches, each with the input index of its rows in
+		 *  EncodingBatch::permutation. Every input appears in exactly one row.
+		 */
+		std::vector<EncodingBatch> EncodeBatch(const std::vector<std::string_view>& texts,
+			const BatchSchedule& schedule,
+			bool add_special_tokens = true,
+			IdType id_type = IdType::kUInt32);
+
+		/*!
+		 * \brief Encode a sentence pair, e.g. a query and a passage for a
+		 *  cross-encoder, with the pair template of the post-processor: special
+		 *  tokens around and between the sequences, type_ids 0 for the first and
+		 *  1 for the second. Backends without a pair template join the two
+		 *  sequences without special tokens.
+		 * \param add_special_tokens Whether the pair template adds its special
+		 *  tokens. It has no effect on the sentencepiece and RWKV backends,
+		 *  which have no template: neither sequence gets special tokens
+		 *  whatever the flag.
+		 * \param max_length The length to truncate to, special tokens included,
+		 *  0 for no truncation.
+		 */
+		virtual Encoding EncodePair(std::string_view first,
+			std::string_view second,
+			bool add_special_tokens = true,
+			size_t max_length = 0,
+			TruncationStrategy truncation = TruncationStrategy::kLongestFirst);
+
+		/*!
+		 * \brief EncodePair of a batch, padded like EncodeBatch. Equal firsts are
+		 *  encoded once, so one query against many passages costs one query.
+		 * \param firsts One text per second, or a single text paired with each.
+		 * \param seconds The second text of each pair.
+		 * \param add_special_tokens As for EncodePair, no effect without a pair template.
+		 * \param id_type The element type of the padded batch buffers, filled
+		 *  row by row in parallel.
+		 */
+		virtual EncodingBatch EncodePairBatch(const std::vector<std::string_view>& firsts,
+			const std::vector<std::string_view>& seconds,
+			bool add_special_tokens = true,
+			size_t max_length = 0,
+			TruncationStrategy truncation = TruncationStrategy::kLongestFirst,
+			IdType id_type = IdType::kUInt32);
+
+		/*!
+		 * \brief Count the tokens Encode would produce without building an Encoding,
+		 *  after the truncation and padding a tokenizer.json configures.
+		 * \param text The input text.
+		 * \param limit Counting stops once the count exceeds limit, in which
+		 *  case the returned value is only guaranteed to be greater than limit.
+		 *  HuggingFace and RWKV stop early; sentencepiece and backends without a
+		 *  counting path encode the whole text and return the exact count.
+		 * \returns The number of tokens.
+		 */
+		virtual size_t CountTokens(std::string_view text,
+			bool add_special_tokens = true,
+			size_t limit = std::numeric_limits<size_t>::max());
+
+		/*!
+		 * \brief Count the tokens of a batch of texts.
+		 * \param texts The input texts.
+		 * \param limit Per-text early exit bound, see CountTokens.
+		 * \returns The number of tokens of each text.
+		 */
+		virtual std::vector<size_t> CountTokensBatch(const std::vector<std::string_view>& texts,
+			bool add_special_tokens = true,
+			size_t limit = std::numeric_limits<size_t>::max());
 
 #ifdef ENABLE_TORCH
 		/*!
@@ -317,6 +596,24 @@ namespace tokenizers
 		 */
 		virtual Decoding Decode(array_view<uint32_t> ids, bool skip_special_token = true) = 0;
 
+		/*!
+		 * \brief Decode token ids into a caller-owned string, reusing its
+		 *  capacity, e.g. one buffer per generation loop.
+		 * \param out Replaced with the decoded text.
+		 * \returns The byte length of the text.
+		 */
+		virtual size_t DecodeInto(array_view<uint32_t> ids, std::string& out, bool skip_special_token = true);
+
+		/*!
+		 * \brief Decode a batch into one caller-owned string.
+		 * \param out Replaced with the concatenated texts.
+		 * \param offsets Replaced with the ids_batch.size() + 1 offsets, text i
+		 *  is out[offsets[i], offsets[i + 1]).
+		 * \returns The total byte length.
+		 */
+		virtual size_t DecodeBatchInto(const std::vector<array_view<uint32_t>>& ids_batch,
+			std::string& out, std::vector<size_t>& offsets, bool skip_special_token = true);
+
 #ifdef ENABLE_TORCH
 		/*!
 		 * \brief Decode a batch of token ids into texts.
@@ -343,6 +640,61 @@ namespace tokenizers
 		virtual DecodingBatch DecodeBatch(
 			const std::vector<std::vector<uint32_t>>& ids_batch, bool skip_special_token = true);
 
+		/*!
+		 * \brief Decode a row-major padded batch. Runs of pad_id at either end of
+		 *  a row are skipped, so only the valid span of each row is decoded.
+		 * \param ids_batch rows x cols token ids.
+		 * \param cols The padded row width.
+		 * \returns The decoded text of each row.
+		 */
+		virtual DecodingBatch DecodeBatchPadded(
+			array_view<uint32_t> ids_batch, size_t cols, uint32_t pad_id, bool skip_special_token = true);
+
+#ifdef ENABLE_TORCH
+		/*!
+		 * \brief Decode a padded batch, each row from its first to its last
+		 *  position where attention_mask is non-zero. Works for left and right
+		 *  padding; int64 ids are narrowed over the valid spans only. The pad_id
+		 *  variant is DecodeBatchPadded, so that DecodeBatch(ids, 0) is not ambiguous.
+		 * \param ids_batch The [rows, cols] token ids.
+		 * \param attention_mask The [rows, cols] mask, of any integral or bool dtype.
+		 * \returns The decoded text of each row.
+		 */
+		virtual DecodingBatch DecodeBatch(const torch::Tensor& ids_batch,
+			const torch::Tensor& attention_mask, bool skip_special_token = true);
+
+		/*!
+		 * \brief Decode a padded batch, skipping runs of pad_id at either end of each row.
+		 * \param ids_batch The [rows, cols] token ids.
+		 * \returns The decoded text of each row.
+		 */
+		virtual DecodingBatch DecodeBatchPadded(const torch::Tensor& ids_batch,
+			uint32_t pad_id, bool skip_special_token = true);
+#endif // ENABLE_TORCH
+
+#ifdef ENABLE_DLPACK
+		// not virtual, so the vtable is the same whether or not a translation
+		// unit defines ENABLE_DLPACK; both decode through DecodeBatch of views
+
+		/*!
+		 * \brief Decode a padded DLPack batch in place, skipping runs of pad_id
+		 *  at either end of each row. The tensor must be a compact row-major
+		 *  [rows, cols] or [cols] CPU tensor of 32 or 64-bit integers; others
+		 *  throw std::invalid_argument.
+		 */
+		DecodingBatch DecodeBatchPadded(const DLTensor& ids_batch,
+			uint32_t pad_id, bool skip_special_token = true);
+
+		/*!
+		 * \brief Decode a padded DLPack batch, each row from its first to its
+		 *  last position where attention_mask is non-zero.
+		 * \param attention_mask A CPU tensor of the shape of ids_batch, of an
+		 *  int, uint or bool dtype; others throw std::invalid_argument.
+		 */
+		DecodingBatch DecodeBatch(const DLTensor& ids_batch,
+			const DLTensor& attention_mask, bool skip_special_token = true);
+#endif // ENABLE_DLPACK
+
 		/*!
 		 * \brief Returns the vocabulary size. Special tokens are considered.
 		 */
@@ -352,15 +704,100 @@ namespace tokenizers
 		 * \brief Convert the given id to its corresponding token if it exists. If
 		 * not, return an empty string.
 		 */
-		virtual Decoding IdToToken(uint32_t token_id) = 0;
+		virtual Decoding IdToToken(uint32_t token_id);
 
 		/*!
 		 * \brief Convert the given token to its corresponding id if it exists. If
-		 * not, return -1.
+		 * not, return -1, or for sentencepiece the id of its unknown piece.
 		 */
-		virtual uint32_t TokenToId(std::string_view token) = 0;
+		virtual uint32_t TokenToId(std::string_view token);
 
-		virtual void clearCache() {}
+		/*!
+		 * \brief The vocabulary table backing IdToToken and TokenToId, built once
+		 *  when the tokenizer is created. NULL if the backend does not provide one.
+		 */
+		inline const VocabTable* GetVocabTable() const { return vocab_table_.get(); }
+
+		/*!
+		 * \brief The bytes each token contributes to decoded text, e.g. byte-level
+		 *  tokens mapped back to raw bytes. Special tokens map to empty bytes.
+		 *  Built on first use.
+		 */
+		std::shared_ptr<const VocabTable> GetDecodedVocab();
+
+		/*!
+		 * \brief Sorted index of the decoded token bytes, used to fill
+		 *  grammar-constrained decoding masks. Built on first use.
+		 */
+		std::shared_ptr<const TokenBytesIndex> GetTokenBytesIndex();
+
+		/*!
+		 * \brief Added/special tokens matched verbatim in the input, NULL if the
+		 *  backend matches them itself (HF tokenizers) or has none.
+		 */
+		inline const AddedTokenSplitter* GetAddedTokens() const { return added_tokens_.get(); }
+
+		/*!
+		 * \brief Set the tokens that are matched verbatim in the input, e.g. the
+		 *  markers of a chat template, and dropped by decoding when
+		 *  skip_special_tokens is set. Matching is opt-in: no tokens are set by
+		 *  default, and add_special_tokens does not affect it, so text such as
+		 *  "<s>" stays ordinary text unless it is registered here. The decoded
+		 *  vocabulary and token bytes index are rebuilt on next use. Not to be
+		 *  called while encoding or decoding.
+		 * \param tokens Tokens of the vocabulary, replacing the current ones.
+		 */
+		virtual void SetAddedTokens(const std::vector<std::string_view>& tokens);
+
+		/*!
+		 * \brief Memory held by this tokenizer, by component. Results that are
+		 *  still alive are not included, see OutstandingPayloads.
+		 */
+		virtual MemoryReport MemoryUsage();
+
+		/*!
+		 * \brief Number of result payloads of all tokenizers that are still
+		 *  alive. A payload is freed with the last Encoding, EncodingBatch or
+		 *  Decoding sharing it, so a count that keeps growing points at leaked
+		 *  results, e.g. a single Encoding holding a whole batch.
+		 */
+		static size_t OutstandingPayloads();
+
+		/*!
+		 * \brief Bound the work of Encode, EncodeBatch and CountTokens. Applied
+		 *  by the HF and RWKV world backends; sentencepiece splits its input
+		 *  internally and ignores the guard.
+		 */
+		virtual void SetEncodeGuard(const EncodeGuard& guard);
+
+		inline const EncodeGuard& GetEncodeGuard() const { return encode_guard_; }
+
+		/*! \brief How often guards triggered, summed over all tokenizers. */
+		static EncodeGuardStats GetEncodeGuardStats();
+
+		/*!
+		 * \brief Cache the ids of up to capacity pre-tokens across Encode and
+		 *  CountTokens calls of all threads, 0 turns the cache off. Used by the
+		 *  sentencepiece and RWKV world backends, the HF model keeps its own
+		 *  cache in Rust. Not to be called while encoding.
+		 */
+		virtual void SetEncodeCache(size_t capacity);
+
+		/*! \brief The encode cache with its hit rate, NULL when it is off. */
+		inline std::shared_ptr<EncodeCache> GetEncodeCache() const { return encode_cache_; }
+
+		/*!
+		 * \brief Fill the tokens of EncodeBatch rows, off by default. Rows then
+		 *  take one Rust encoding each instead of the flat batch export. Only the
+		 *  HF backend has token strings, and pair batches never carry them.
+		 */
+		inline void SetBatchTokens(bool enable) { batch_tokens_ = enable; }
+
+		virtual void clearCache()
+		{
+			if (encode_cache_)
+				encode_cache_->Clear();
+		}
 
 		//---------------------------------------------------
 		// Factory functions from byte-blobs
@@ -412,6 +849,118 @@ namespace tokenizers
 		 * \return The created tokenizer.
 		 */
 		static std::unique_ptr<Tokenizer> FromBlobRWKVWorld(std::string_view model_blob);
+		/*!
+		 * \brief Create a tokenizer linked into the binary by tokenizer_codegen.
+		 *  The vocabulary tables are used in place, HF and sentencepiece models
+		 *  still parse their embedded source.
+		 *
+		 * \param name The name given to tokenizer_codegen.
+		 * \return The created tokenizer.
+		 */
+		static std::unique_ptr<Tokenizer> FromCompiled(std::string_view name);
+
+	protected:
+		/*!
+		 * \brief Encode a batch without padding it: fills encodings and the
+		 *  payload keeping them alive, max_len stays 0.
+		 */
+		virtual EncodingBatch EncodeRows(const std::vector<std::string_view>& texts,
+			bool add_special_tokens);
+
+		/*!
+		 * \brief Encode the pairs (firsts[first_index[i]], seconds[i]) without
+		 *  padding them, as EncodeRows. firsts holds distinct texts. The
+		 *  default joins the sequences as Encode(text, false) gives them and
+		 *  ignores add_special_tokens.
+		 */
+		virtual EncodingBatch EncodePairRows(const std::vector<std::string_view>& firsts,
+			const std::vector<size_t>& first_index,
+			const std::vector<std::string_view>& seconds,
+			bool add_special_tokens,
+			size_t max_length,
+			TruncationStrategy truncation);
+
+		/*!
+		 * \brief Build the table returned by GetDecodedVocab. Defaults to the
+		 *  vocabulary table, for backends whose tokens are raw bytes.
+		 */
+		virtual std::shared_ptr<VocabTable> BuildDecodedVocab();
+
+		/*! \brief Drop the decoded vocabulary and token bytes index, e.g. after the special tokens changed. */
+		void ResetLazyTables();
+
+		/*! \brief vocabulary table, set by the backend on construction */
+		std::shared_ptr<VocabTable> vocab_table_;
+
+		/*! \brief added tokens split off before the backend model runs */
+		std::shared_ptr<const AddedTokenSplitter> added_tokens_;
+
+		/*! \brief bounds on the work of one encode call, see SetEncodeGuard */
+		EncodeGuard encode_guard_;
+
+		/*! \brief pre-token ids shared by the encoding threads, see SetEncodeCache */
+		std::shared_ptr<EncodeCache> encode_cache_;
+
+		/*! \brief whether batch rows carry their tokens, see SetBatchTokens */
+		bool batch_tokens_ = false;
+
+	private:
+		struct LazyTables;
+		static std::shared_ptr<LazyTables> MakeLazyTables();
+
+		/*! \brief Use decoded as GetDecodedVocab instead of building it. */
+		void SetDecodedVocab(std::shared_ptr<const VocabTable> decoded);
+
+		// tables built on first use, shared so that tokenizers stay movable
+		std::shared_ptr<LazyTables> lazy_tables_ = MakeLazyTables();
+	};
+
+	/*!
+	 * \brief Incremental decoder for generation loops. Each step appends the
+	 *  decoded bytes of one token, looked up in the tokenizer's decoded
+	 *  vocabulary, and feeds them to the stop-string matcher.
+	 *
+	 *  The bytes of one token may end inside a UTF-8 character. Rules that depend
+	 *  on the position in the text, such as stripping the leading space of the
+	 *  first token, are not applied.
+	 */
+	class StreamDecoder
+	{
+	public:
+		struct Step
+		{
+			/*! \brief The bytes appended by the token. */
+			std::string_view bytes;
+			/*! \brief Set when the token completed a stop string. */
+			std::optional<StopSequenceMatcher::Match> stop;
+		};
+
+		/*!
+		 * \param tokenizer The tokenizer the ids come from.
+		 * \param stop The stop strings to watch for, NULL for none.
+		 */
+		explicit StreamDecoder(Tokenizer& tokenizer, std::shared_ptr<const StopSequenceMatcher> stop = nullptr);
+
+		/*!
+		 * \brief Decode one more token. Once a stop string matched, further
+		 *  tokens are not matched again until Reset.
+		 */
+		Step Put(uint32_t token_id);
+
+		/*! \brief Whether a stop string has matched. */
+		inline bool Stopped() const { return stopped_; }
+
+		/*! \brief Trailing bytes that may still become a stop string. */
+		inline size_t PendingBytes() const { return stop_ ? stop_->PendingBytes(state_) : 0; }
+
+		/*! \brief Start a new sequence. */
+		void Reset();
+
+	private:
+		std::shared_ptr<const VocabTable> decoded_;
+		std::shared_ptr<const StopSequenceMatcher> stop_;
+		StopSequenceMatcher::State state_;
+		bool stopped_ = false;
 	};
 } // namespace tokenizers
 #endif // TOKENIZERS_CPP_H_
@@ -0,0 +1,154 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_dataset.h
+ * \brief Memory-mapped file of encoded documents
+ *
+ *  File layout, all integers little-endian, every section 64-byte aligned:
+ *
+ *    DatasetHeader
+ *    ids       num_tokens ids of id_bytes each, the documents back to back
+ *    index     num_documents + 1 uint64 token offsets, document i is
+ *              ids[index[i], index[i + 1])
+ *    metadata  only if metadata_offset is non-zero: num_documents + 1 uint64
+ *              byte offsets relative to the end of the offsets, then the
+ *              metadata bytes of the documents back to back
+ *
+ *  The header is written last, so a file whose writer did not finish has no
+ *  magic and is rejected by the reader.
+ */
+#ifndef TOKENIZERS_DATASET_H_
+#define TOKENIZERS_DATASET_H_
+
+#include "tokenizers_cpp.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tokenizers
+{
+	struct DatasetHeader
+	{
+		static constexpr char kMagic[8] = { 'T', 'K', 'Z', 'D', 'A', 'T', 'A', '1' };
+		static constexpr uint32_t kVersion = 1;
+
+		char magic[8] = {};
+		uint32_t version = kVersion;
+		/*! \brief 2 for uint16 ids, 4 for uint32 ids. */
+		uint32_t id_bytes = 4;
+		uint64_t vocab_size = 0;
+		uint64_t num_documents = 0;
+		uint64_t num_tokens = 0;
+		/*! \brief File offsets of the sections, metadata_offset is 0 without metadata. */
+		uint64_t ids_offset = 0;
+		uint64_t index_offset = 0;
+		uint64_t metadata_offset = 0;
+	};
+
+	static_assert(sizeof(DatasetHeader) == 64);
+
+	/*!
+	 * \brief Writes encoded documents to a dataset file. Ids are stored as
+	 *  uint16 when vocab_size fits, halving the file of most vocabularies.
+	 *  Errors are thrown as std::runtime_error, ids out of the vocabulary as
+	 *  std::invalid_argument. Big-endian hosts can neither write nor open
+	 *  dataset files, and get std::runtime_error.
+	 */
+	class TokenizedDatasetWriter
+	{
+	public:
+		/*!
+		 * \param path The file to create, replaced if it exists.
+		 * \param vocab_size The vocabulary size, e.g. Tokenizer::GetVocabSize.
+		 * \param with_metadata Whether documents carry metadata bytes, which are
+		 *  held in memory until Finish.
+		 */
+		TokenizedDatasetWriter(const std::string& path, size_t vocab_size, bool with_metadata = false);
+
+		/*! \brief Closes the file, which stays unreadable unless Finish was called. */
+		~TokenizedDatasetWriter();
+
+		TokenizedDatasetWriter(const TokenizedDatasetWriter&) = delete;
+		TokenizedDatasetWriter& operator=(const TokenizedDatasetWriter&) = delete;
+
+		/*! \brief Append a document, metadata is ignored unless with_metadata is set. */
+		void Add(array_view<uint32_t> ids, std::string_view metadata = {});
+
+		/*! \brief Append the ids of an encoding. */
+		void Add(const Encoding& encoding, std::string_view metadata = {});
+
+		/*! \brief Write the index, the metadata and the header, and close the file. */
+		void Finish();
+
+		inline size_t NumDocuments() const { return token_offsets_.size() - 1; }
+
+	private:
+		void Write(const void* data, size_t bytes);
+		void Pad();
+
+		std::FILE* file_ = nullptr;
+		uint64_t position_ = 0;
+		DatasetHeader header_;
+		bool with_metadata_;
+		std::vector<uint64_t> token_offsets_{ 0 };
+		std::vector<uint64_t> metadata_offsets_{ 0 };
+		std::string metadata_;
+		std::vector<uint16_t> narrow_;
+	};
+
+	/*!
+	 * \brief Read-only view of a dataset file, mapped into memory. Documents
+	 *  are views into the mapping, valid as long as the dataset is alive.
+	 *  Safe to share between threads.
+	 */
+	class TokenizedDataset
+	{
+	public:
+		/*! \brief Map path, std::runtime_error if it is not a complete dataset file. */
+		static std::shared_ptr<const TokenizedDataset> Open(const std::string& path);
+
+		~TokenizedDataset();
+
+		TokenizedDataset(const TokenizedDataset&) = delete;
+		TokenizedDataset& operator=(const TokenizedDataset&) = delete;
+
+		inline size_t NumDocuments() const { return header_.num_documents; }
+		inline size_t NumTokens() const { return header_.num_tokens; }
+		inline size_t VocabSize() const { return header_.vocab_size; }
+		inline size_t IdBytes() const { return header_.id_bytes; }
+		inline bool HasMetadata() const { return metadata_offsets_ != nullptr; }
+
+		inline size_t DocumentLength(size_t i) const { return index_[i + 1] - index_[i]; }
+
+		/*!
+		 * \brief The ids of document i without copying them. Only for files of
+		 *  uint32 ids, std::logic_error otherwise, see CopyDocument.
+		 */
+		array_view<uint32_t> Document(size_t i) const;
+
+		/*! \brief The ids of document i in a file of uint16 ids, std::logic_error otherwise. */
+		array_view<uint16_t> Document16(size_t i) const;
+
+		/*! \brief Widen the ids of document i into out, for files of either id width. */
+		void CopyDocument(size_t i, std::vector<uint32_t>& out) const;
+
+		/*! \brief The metadata of document i, empty if the file has none. */
+		std::string_view Metadata(size_t i) const;
+
+	private:
+		TokenizedDataset() = default;
+
+		const char* data_ = nullptr;
+		size_t size_ = 0;
+		// platform handle of the mapping
+		void* mapping_handle_ = nullptr;
+		DatasetHeader header_;
+		const uint64_t* index_ = nullptr;
+		const uint64_t* metadata_offsets_ = nullptr;
+		const char* metadata_ = nullptr;
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_DATASET_H_
@@ -0,0 +1,205 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_match.h
+ * \brief Multi-pattern byte matching over token streams
+ */
+#ifndef TOKENIZERS_MATCH_H_
+#define TOKENIZERS_MATCH_H_
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tokenizers
+{
+	/*!
+	 * \brief Aho-Corasick automaton over bytes with a dense transition table.
+	 *
+	 *  Bytes that occur in no pattern share one column of the table, so its size
+	 *  is states x (distinct pattern bytes + 1).
+	 */
+	class AhoCorasick
+	{
+	public:
+		using State = uint32_t;
+
+		static constexpr State kRoot = 0;
+
+		AhoCorasick() = default;
+
+		/*!
+		 * \brief Build the automaton. Empty patterns are ignored.
+		 */
+		explicit AhoCorasick(const std::vector<std::string_view>& patterns);
+
+		/*! \brief Transition on one byte. */
+		inline State Next(State state, uint8_t byte) const
+		{
+			return transitions_[state * num_classes_ + classes_[byte]];
+		}
+
+		/*!
+		 * \brief Index of the longest pattern ending at state, -1 if none.
+		 */
+		inline int32_t Output(State state) const { return outputs_[state]; }
+
+		/*!
+		 * \brief Length of the longest suffix of the input that is a prefix of
+		 *  some pattern, i.e. how many trailing bytes may still start a match.
+		 */
+		inline uint32_t Depth(State state) const { return depths_[state]; }
+
+		inline size_t PatternLength(int32_t index) const { return pattern_lengths_[index]; }
+
+		inline size_t NumPatterns() const { return pattern_lengths_.size(); }
+
+		inline size_t MaxPatternLength() const { return max_pattern_length_; }
+
+		/*! \brief Whether byte occurs in any pattern. */
+		inline bool InAlphabet(uint8_t byte) const { return classes_[byte] != 0; }
+
+	private:
+		uint8_t classes_[256] = {};
+		uint32_t num_classes_ = 1;
+		std::vector<State> transitions_ = std::vector<State>(1, kRoot);
+		std::vector<int32_t> outputs_ = std::vector<int32_t>(1, -1);
+		std::vector<uint32_t> depths_ = std::vector<uint32_t>(1, 0);
+		std::vector<size_t> pattern_lengths_;
+		size_t max_pattern_length_ = 0;
+	};
+
+	/*!
+	 * \brief Incremental stop-string detection over the bytes of generated tokens.
+	 *
+	 *  The matcher is immutable and can be shared by all sequences; the per
+	 *  sequence State carries the automaton state from token to token, so each
+	 *  step costs O(new bytes) and matches spanning token boundaries are found.
+	 */
+	class StopSequenceMatcher
+	{
+	public:
+		struct State
+		{
+			AhoCorasick::State node = AhoCorasick::kRoot;
+			// byte lengths of the most recent tokens, enough to cover a stop string
+			std::deque<uint32_t> token_lengths;
+			size_t recent_bytes = 0;
+		};
+
+		struct Match
+		{
+			/*! \brief Index of the stop string that matched. */
+			size_t stop_index;
+			/*! \brief Bytes to drop from the end of the text fed so far, from the start of the stop string. */
+			size_t rollback_bytes;
+			/*!
+			 * \brief Trailing tokens holding any of those bytes. The first of them may
+			 *  also hold bytes before the stop string.
+			 */
+			size_t rollback_tokens;
+		};
+
+		explicit StopSequenceMatcher(const std::vector<std::string_view>& stop_strings);
+
+		/*!
+		 * \brief Feed the bytes of one token.
+		 * \returns The first stop string completed by these bytes, if any.
+		 */
+		std::optional<Match> Feed(State& state, std::string_view bytes) const;
+
+		/*!
+		 * \brief Trailing bytes that may still turn into a stop string and should
+		 *  be held back from a client until more tokens arrive.
+		 */
+		inline size_t PendingBytes(const State& state) const { return automaton_.Depth(state.node); }
+
+	private:
+		AhoCorasick automaton_;
+	};
+
+	/*!
+	 * \brief Splits text into added/special tokens such as <|im_start|> and the
+	 *  ordinary text between them, before the backend model runs.
+	 *
+	 *  Matching is leftmost-longest, like the added vocabulary of HF tokenizers.
+	 *  Outside of a partial match the scan jumps with SIMD to the next byte that
+	 *  starts some token, so text without special tokens is skipped quickly.
+	 */
+	class AddedTokenSplitter
+	{
+	public:
+		/*! \brief Id of a segment of ordinary text. */
+		static constexpr uint32_t kText = static_cast<uint32_t>(-1);
+
+		struct Segment
+		{
+			std::string_view text;
+			/*! \brief The token id, kText for ordinary text. */
+			uint32_t id;
+		};
+
+		AddedTokenSplitter() = default;
+
+		/*!
+		 * \brief Build the splitter.
+		 * \param tokens The token strings, empty ones are ignored.
+		 * \param ids The id of each token.
+		 */
+		AddedTokenSplitter(const std::vector<std::string_view>& tokens, const std::vector<uint32_t>& ids);
+
+		inline bool Empty() const { return tokens_by_id_.empty(); }
+
+		inline bool IsAdded(uint32_t id) const { return tokens_by_id_.count(id) != 0; }
+
+		/*! \brief The string of an added token, empty if id is not one. */
+		inline std::string_view Token(uint32_t id) const
+		{
+			auto iter = tokens_by_id_.find(id);
+			return iter == tokens_by_id_.end() ? std::string_view() : std::string_view(iter->second);
+		}
+
+		/*!
+		 * \brief Call fn(Segment) for each segment of text in order. Ordinary
+		 *  segments are never empty.
+		 */
+		template <class _Fn>
+		void Split(std::string_view text, _Fn&& fn) const
+		{
+			size_t pos = 0;
+			while (pos < text.size())
+			{
+				size_t begin, end;
+				int32_t index = FindNext(text, pos, begin, end);
+				if (index < 0)
+					break;
+				if (begin > pos)
+					fn(Segment{ text.substr(pos, begin - pos), kText });
+				fn(Segment{ text.substr(begin, end - begin), ids_[index] });
+				pos = end;
+			}
+			if (pos < text.size())
+				fn(Segment{ text.substr(pos), kText });
+		}
+
+		std::vector<Segment> Split(std::string_view text) const;
+
+	private:
+		/*!
+		 * \brief Leftmost-longest match in text[from, ...).
+		 * \returns The token index, -1 if there is none.
+		 */
+		int32_t FindNext(std::string_view text, size_t from, size_t& begin, size_t& end) const;
+
+		AhoCorasick automaton_;
+		std::vector<uint32_t> ids_;
+		// distinct first bytes of the tokens, scanned for with SIMD when few
+		std::vector<uint8_t> first_bytes_;
+		bool is_first_byte_[256] = {};
+		std::unordered_map<uint32_t, std::string> tokens_by_id_;
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_MATCH_H_
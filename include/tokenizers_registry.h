@@ -0,0 +1,140 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_registry.h
+ * \brief Process-wide registry sharing tokenizers loaded from identical blobs
+ */
+#ifndef TOKENIZERS_REGISTRY_H_
+#define TOKENIZERS_REGISTRY_H_
+
+#include "tokenizers_cpp.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+namespace tokenizers
+{
+	/*! \brief What a registry entry is loaded from. */
+	struct TokenizerSource
+	{
+		enum class Format
+		{
+			/*! \brief HF tokenizer.json contents, see Tokenizer::FromBlobJSON. */
+			kJSON,
+			/*! \brief sentencepiece model contents, see Tokenizer::FromBlobSentencePiece. */
+			kSentencePiece,
+			/*! \brief Path of an RWKV world vocabulary, see Tokenizer::FromBlobRWKVWorld. */
+			kRWKVWorld,
+		};
+
+		Format format = Format::kJSON;
+		std::string blob;
+
+		/*! \brief Source of a tokenizer.json file, read now so it is keyed by content. */
+		static TokenizerSource JSONFile(std::string_view path);
+
+		/*! \brief Source of a sentencepiece model file, read now so it is keyed by content. */
+		static TokenizerSource SentencePieceFile(std::string_view path);
+	};
+
+	/*!
+	 * \brief Hands out one shared instance per distinct tokenizer blob.
+	 *
+	 *  Entries are keyed by format and a 128-bit hash of the blob, so routes
+	 *  whose models share a tokenizer.json parse it once and share its memory.
+	 *  The registry only holds weak references: an instance is unloaded as soon
+	 *  as the last shared_ptr to it is released, and loaded again on next use.
+	 *  Concurrent requests for a blob that is being loaded wait for that load.
+	 */
+	class TokenizerRegistry
+	{
+	public:
+		/*! \brief The process-wide registry. */
+		static TokenizerRegistry& Instance();
+
+		TokenizerRegistry();
+
+		TokenizerRegistry(const TokenizerRegistry&) = delete;
+		TokenizerRegistry& operator=(const TokenizerRegistry&) = delete;
+
+		/*!
+		 * \brief The tokenizer for source, loaded on this thread if no live
+		 *  instance exists. Load errors are rethrown to every waiting caller.
+		 */
+		std::shared_ptr<Tokenizer> Get(const TokenizerSource& source);
+
+		/*!
+		 * \brief Start loading source in the background. The future keeps the
+		 *  instance alive until it is released.
+		 */
+		std::shared_future<std::shared_ptr<Tokenizer>> GetAsync(TokenizerSource source);
+
+		/*! \brief Number of instances currently alive or being loaded. */
+		size_t Size();
+
+	private:
+		// format, hash of the blob, blob size
+		using Key = std::tuple<int, uint64_t, uint64_t, size_t>;
+
+		struct Entry
+		{
+			std::weak_ptr<Tokenizer> tokenizer;
+			bool loading = false;
+			// waiters of a failed load see the error, the next Get retries
+			std::exception_ptr error;
+		};
+
+		struct State
+		{
+			std::mutex mutex;
+			std::condition_variable loaded;
+			std::map<Key, Entry> entries;
+		};
+
+		static Key MakeKey(const TokenizerSource& source);
+
+		static std::unique_ptr<Tokenizer> Load(const TokenizerSource& source);
+
+		// shared with the deleters of the instances, which may outlive the registry
+		std::shared_ptr<State> state_;
+	};
+
+	/*!
+	 * \brief A tokenizer that is loaded through the registry on first use.
+	 *
+	 *  Routes can hold one per model without paying for the load until a
+	 *  request arrives, or call Prefetch when a model is about to become hot.
+	 *  Once loaded the instance stays alive until Release is called or this
+	 *  object is destroyed.
+	 */
+	class LazyTokenizer
+	{
+	public:
+		explicit LazyTokenizer(TokenizerSource source, TokenizerRegistry& registry = TokenizerRegistry::Instance());
+
+		/*! \brief Start loading in the background, does nothing if already started. */
+		void Prefetch();
+
+		/*! \brief The tokenizer, waiting for or performing the load if needed. */
+		std::shared_ptr<Tokenizer> Get();
+
+		/*! \brief Whether Get would return without waiting. */
+		bool Ready();
+
+		/*! \brief Drop this reference, the instance is unloaded if nothing else uses it. */
+		void Release();
+
+	private:
+		TokenizerSource source_;
+		TokenizerRegistry& registry_;
+		std::mutex mutex_;
+		std::shared_future<std::shared_ptr<Tokenizer>> future_;
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_REGISTRY_H_
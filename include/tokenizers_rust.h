@@ -272,6 +272,50 @@ namespace tokenizers
 			}
 		}
 
+		/*! \brief Owner of a batch returned by tokenizers_encode_batch_flat. */
+		class FlatEncodings
+		{
+		public:
+			inline FlatEncodings() : raw{} {}
+
+			inline explicit FlatEncodings(const ::rust::FlatEncodings& raw) : raw(raw) {}
+
+			FlatEncodings(const FlatEncodings&) = delete;
+
+			inline FlatEncodings(FlatEncodings&& _Other) noexcept : raw{}
+			{
+				std::swap(raw, _Other.raw);
+			}
+
+			inline ~FlatEncodings()
+			{
+				if (raw.buffer.ptr)
+					tokenizers_flat_encodings_free(&raw);
+			}
+
+			inline size_t size() const { return raw.num_seqs; }
+
+			inline size_t num_tokens() const { return raw.num_tokens; }
+
+			inline array_view<uint32_t> ids(size_t i) const { return row(raw.ids, i); }
+
+			inline array_view<uint32_t> type_ids(size_t i) const { return row(raw.type_ids, i); }
+
+			inline array_view<uint32_t> attention_mask(size_t i) const { return row(raw.attention_mask, i); }
+
+			inline array_view<uint32_t> special_tokens_mask(size_t i) const { return row(raw.special_tokens_mask, i); }
+
+			inline const ::rust::FlatEncodings& get() const { return raw; }
+
+		private:
+			inline array_view<uint32_t> row(const uint32_t* field, size_t i) const
+			{
+				return array_view<uint32_t>(field + raw.offsets[i], raw.offsets[i + 1] - raw.offsets[i]);
+			}
+
+			::rust::FlatEncodings raw;
+		};
+
 		class SharedTokenizerHandle : public interface::BaseSharedHandle
 		{
 		public:
@@ -333,6 +377,14 @@ namespace tokenizers
 				return Encoding(encoding_handle);
 			}
 
+			/*! \brief encode of one long input, its pre-tokens tokenized on the worker pool. */
+			inline Encoding encode_parallel(std::string_view input, bool add_special_tokens = true)
+			{
+				auto raw_handle = tokenizers_encode_parallel(*handle, input.data(), input.size(), add_special_tokens);
+				std::shared_ptr<SharedEncodingHandle> encoding_handle = std::make_shared<SharedEncodingHandle>(raw_handle, HANDLE);
+				return Encoding(encoding_handle);
+			}
+
 			template <class _String, typename std::enable_if_t<is_string_type_v<_String>, int> = 0>
 			inline std::vector<Encoding> encode(const std::vector<_String>& input, bool add_special_tokens = true)
 			{
@@ -346,6 +398,67 @@ namespace tokenizers
 							get_subarray_warp(input))));
 			}
 
+			/*! \brief Encode a batch with a single FFI call, all fields in one buffer. */
+			template <class _String, typename std::enable_if_t<is_string_type_v<_String>, int> = 0>
+			inline FlatEncodings encode_flat(const std::vector<_String>& input, bool add_special_tokens = true)
+			{
+				return FlatEncodings(
+					tokenizers_encode_batch_flat(
+						*handle,
+						&input,
+						input.size(),
+						add_special_tokens,
+						get_subarray_warp(input)));
+			}
+
+			/*!
+			 * \brief Encode the pairs (firsts[first_index[i]], seconds[i]) with the
+			 *  pair template in a single FFI call, each first tokenized once.
+			 * \param max_length Length including special tokens, 0 for no truncation.
+			 * \param truncation 0 for longest_first, 1 for only_second.
+			 */
+			template <class _String, typename std::enable_if_t<is_string_type_v<_String>, int> = 0>
+			inline FlatEncodings encode_pair_flat(const std::vector<_String>& firsts,
+				const std::vector<size_t>& first_index,
+				const std::vector<_String>& seconds,
+				bool add_special_tokens = true,
+				size_t max_length = 0,
+				int32_t truncation = 0)
+			{
+				return FlatEncodings(
+					tokenizers_encode_pair_batch_flat(
+						*handle,
+						&firsts,
+						firsts.size(),
+						&seconds,
+						seconds.size(),
+						first_index.data(),
+						add_special_tokens,
+						max_length,
+						truncation,
+						get_subarray_warp(firsts)));
+			}
+
+			inline size_t count_tokens(std::string_view input, bool add_special_tokens = true, size_t limit = SIZE_MAX)
+			{
+				return tokenizers_count_tokens(*handle, input.data(), input.size(), add_special_tokens, limit);
+			}
+
+			template <class _String, typename std::enable_if_t<is_string_type_v<_String>, int> = 0>
+			inline std::vector<size_t> count_tokens(const std::vector<_String>& input, bool add_special_tokens = true, size_t limit = SIZE_MAX)
+			{
+				std::vector<size_t> counts(input.size());
+				tokenizers_count_tokens_batch(
+					*handle,
+					&input,
+					input.size(),
+					add_special_tokens,
+					limit,
+					get_subarray_warp(input),
+					counts.data());
+				return counts;
+			}
+
 			template <class _Array,
 					  typename std::enable_if_t<is_array_type_of_v<_Array, uint32_t> || is_array_type_of_v<_Array, int32_t>, int> = 0>
 			inline ::rust::String decode(const _Array & ids, bool skip_special_tokens = true)
@@ -369,11 +482,59 @@ namespace tokenizers
 				return res;
 			}
 
+			/*!
+			 * \brief Decode into out, reusing its capacity: the text is decoded
+			 *  once and copied into out resized to its length.
+			 * \returns The byte length of the text.
+			 */
+			template <class _Array,
+					  typename std::enable_if_t<is_array_type_of_v<_Array, uint32_t> || is_array_type_of_v<_Array, int32_t>, int> = 0>
+			inline size_t decode_into(const _Array& ids, std::string& out, bool skip_special_tokens = true)
+			{
+				const uint32_t* data = reinterpret_cast<const uint32_t*>(ids.data());
+				return tokenizers_decode_into_alloc(*handle, data, ids.size(), skip_special_tokens, resize_string, &out);
+			}
+
+			/*!
+			 * \brief Decode a batch into out, text i at [offsets[i], offsets[i + 1]).
+			 * \returns The total byte length, out is resized to it.
+			 */
+			template <class _Array,
+					  typename std::enable_if_t<is_array_type_of_v<_Array, uint32_t> || is_array_type_of_v<_Array, int32_t>, int> = 0>
+			inline size_t decode_into(const std::vector<_Array>& ids, std::string& out, std::vector<size_t>& offsets, bool skip_special_tokens = true)
+			{
+				offsets.resize(ids.size() + 1);
+				return tokenizers_decode_batch_into_alloc(*handle, &ids, ids.size(), skip_special_tokens, get_subarray_warp(ids),
+					resize_string, &out, offsets.data());
+			}
+
 			inline ::rust::String id_to_token(uint32_t id)
 			{
 				return ::rust::String(std::make_shared<::rust::SharedStringHandle>(tokenizers_id_to_token(*handle, id)));
 			}
 
+			inline std::vector<std::string> vocab_tokens()
+			{
+				std::vector<std::string> tokens;
+				tokenizers_vocab_tokens(
+					*handle,
+					tokenizers::reserve_vector_warp(tokens),
+					&tokens,
+					tokenizers::emplace_back_warp(tokens));
+				return tokens;
+			}
+
+			inline std::vector<std::string> vocab_token_bytes()
+			{
+				std::vector<std::string> tokens;
+				tokenizers_vocab_token_bytes(
+					*handle,
+					tokenizers::reserve_vector_warp(tokens),
+					&tokens,
+					tokenizers::emplace_back_warp(tokens));
+				return tokens;
+			}
+
 			inline uint32_t token_to_id(std::string_view token)
 			{
 				return tokenizers_token_to_id(*handle, token.data(), token.size());
@@ -384,6 +545,34 @@ namespace tokenizers
 				return tokenizers_get_vocab_size(*handle);
 			}
 
+			template <class _String, typename std::enable_if_t<is_string_type_v<_String>, int> = 0>
+			inline size_t add_special_tokens(const std::vector<_String>& tokens)
+			{
+				return tokenizers_add_special_tokens(*handle, &tokens, tokens.size(), get_subarray_warp(tokens));
+			}
+
+			inline ::rust::MemoryUsage memory_usage()
+			{
+				return tokenizers_memory_usage(*handle);
+			}
+
+			/*!
+			 * \brief Split with a hand-coded scanner instead of the onig regex when the
+			 *  pre-tokenizer uses a known pattern, on by default. Returns whether it is in use.
+			 */
+			inline bool use_fast_pre_tokenizer(bool enable = true)
+			{
+				return tokenizers_use_fast_pre_tokenizer(*handle, enable) != 0;
+			}
+
+			/*!
+			 * \brief Bound the work of encode and count calls, an all-zero guard removes it.
+			 */
+			inline void set_encode_guard(const rust::EncodeGuard& guard)
+			{
+				tokenizers_set_encode_guard(*handle, &guard);
+			}
+
 		private:
 			std::shared_ptr<SharedTokenizerHandle> handle;
 		};
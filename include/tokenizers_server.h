@@ -0,0 +1,118 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_server.h
+ * \brief Wire protocol of tokenizer_server, the tokenizer daemon
+ *
+ *  Clients connect to the server's Unix domain socket and receive a
+ *  HelloMessage carrying, as SCM_RIGHTS ancillary data, the descriptor of a
+ *  shared memory ring private to the connection. Each request is a
+ *  RequestHeader followed by payload_bytes of payload; each response is a
+ *  ResponseHeader whose result lies in the ring, so large batches never pass
+ *  through the socket. Responses come in request order.
+ *
+ *  All integers are in host byte order, client and server share the machine.
+ */
+#ifndef TOKENIZERS_SERVER_H_
+#define TOKENIZERS_SERVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace tokenizers::server
+{
+	constexpr uint32_t kMagic = 0x544B5A31; // "TKZ1"
+	constexpr uint32_t kVersion = 1;
+
+	enum class Op : uint32_t
+	{
+		/*!
+		 * \brief Encode count texts. Payload: count uint32 byte lengths, then
+		 *  the texts back to back. Result: count + 1 uint32 offsets into the
+		 *  ids, then the uint32 ids of all texts back to back.
+		 */
+		kEncode = 1,
+		/*!
+		 * \brief Decode count id sequences. Payload: count uint32 lengths, then
+		 *  the uint32 ids back to back. Result: count + 1 uint32 byte offsets,
+		 *  then the texts back to back.
+		 */
+		kDecode = 2,
+	};
+
+	/*! \brief Bits of RequestHeader::flags. */
+	enum RequestFlags : uint32_t
+	{
+		kAddSpecialTokens = 1,
+		kSkipSpecialTokens = 2,
+	};
+
+	enum class Status : int32_t
+	{
+		kOk = 0,
+		/*! \brief Malformed request, the connection is closed after the response. */
+		kBadRequest = 1,
+		/*! \brief The result does not fit the ring even when it is empty. */
+		kTooLarge = 2,
+		/*! \brief The tokenizer threw, e.g. on invalid UTF-8. */
+		kFailed = 3,
+	};
+
+	struct HelloMessage
+	{
+		uint32_t magic = kMagic;
+		uint32_t version = kVersion;
+		/*! \brief Size of the shared memory object, the RingHeader included. */
+		uint64_t mapping_bytes = 0;
+	};
+
+	struct RequestHeader
+	{
+		uint32_t magic = kMagic;
+		/*! \brief An Op. */
+		uint32_t op = 0;
+		/*! \brief Echoed in the response. */
+		uint64_t request_id = 0;
+		/*! \brief RequestFlags. */
+		uint32_t flags = 0;
+		uint32_t count = 0;
+		uint64_t payload_bytes = 0;
+	};
+
+	struct ResponseHeader
+	{
+		uint64_t request_id = 0;
+		/*! \brief A Status, the ring fields are 0 unless it is kOk. */
+		int32_t status = 0;
+		uint32_t count = 0;
+		/*! \brief Ring position of the result, see RingHeader. */
+		uint64_t ring_position = 0;
+		uint64_t ring_bytes = 0;
+	};
+
+	/*!
+	 * \brief Start of the shared memory object, followed at kRingDataOffset
+	 *  by capacity bytes of data.
+	 *
+	 *  Positions count bytes since the connection opened and never wrap; the
+	 *  data of position p is at data[p % capacity]. The server writes each
+	 *  result contiguously, skipping the tail end of the data when a result
+	 *  does not fit before it, and publishes head after the bytes. The client
+	 *  releases results in response order by storing the end position of the
+	 *  last one it is done with in tail. The server never writes more than
+	 *  capacity bytes past tail.
+	 */
+	struct RingHeader
+	{
+		uint64_t capacity;
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+	};
+
+	/*! \brief Offset of the data, results start 8-byte aligned. */
+	constexpr size_t kRingDataOffset = 4096;
+
+	static_assert(sizeof(RingHeader) <= kRingDataOffset);
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring is shared across processes");
+} // namespace tokenizers::server
+#endif // TOKENIZERS_SERVER_H_
@@ -0,0 +1,62 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_threads.h
+ * \brief Worker pool shared by the Rust and C++ batch paths
+ */
+#ifndef TOKENIZERS_THREADS_H_
+#define TOKENIZERS_THREADS_H_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace tokenizers
+{
+	/*! \brief Size, placement and ownership of the tokenizer workers. */
+	struct ThreadPoolOptions
+	{
+		/*! \brief Number of workers, 0 for the default pool sized to the machine. */
+		size_t num_threads = 0;
+
+		/*!
+		 * \brief CPUs the workers are pinned to, worker i to cpus[i % cpus.size()],
+		 *  e.g. to keep tokenization off the cores of latency-critical threads.
+		 *  Empty leaves the affinity alone.
+		 */
+		std::vector<int> cpus;
+
+		/*!
+		 * \brief Runs a worker loop on a thread of the caller's pool instead of a
+		 *  thread spawned by the library. The loop returns once the pool is
+		 *  replaced and its work is done, so it occupies that thread until then.
+		 *  Empty to let the library spawn the workers.
+		 */
+		std::function<void(std::function<void()> worker)> spawn;
+	};
+
+	/*!
+	 * \brief The one pool all batch calls run on: encode/decode/count batches of
+	 *  the Rust backend, and the batch loops of the C++ backends, which call
+	 *  Encode and Decode of a tokenizer from several workers at once.
+	 */
+	class ThreadPool
+	{
+	public:
+		/*!
+		 * \brief Replace the pool. Calls already running finish on the old one.
+		 *  Throws std::runtime_error if the workers cannot be started, in which
+		 *  case the previous pool stays in use.
+		 */
+		static void Configure(const ThreadPoolOptions& options);
+
+		/*!
+		 * \brief Call fn(i) for each i in [0, n) on the pool and wait for all of
+		 *  them. The first exception thrown by fn is rethrown here.
+		 */
+		static void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+		/*! \brief Pin the calling thread to cpu, false if the platform refuses or has no support. */
+		static bool PinCurrentThread(int cpu);
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_THREADS_H_
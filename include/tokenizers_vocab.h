@@ -0,0 +1,230 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_vocab.h
+ * \brief Contiguous vocabulary table shared by all tokenizer backends
+ */
+#ifndef TOKENIZERS_VOCAB_H_
+#define TOKENIZERS_VOCAB_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tokenizers
+{
+	/*!
+	 * \brief Vocabulary of a tokenizer, built once when the tokenizer is loaded.
+	 *
+	 *  All token bytes live in one blob indexed by an offsets array, so IdToToken
+	 *  is a bounds check plus two loads. TokenToId goes through a minimal perfect
+	 *  hash (hash and displace) over the non-empty tokens and verifies the bytes
+	 *  of the single candidate it lands on.
+	 */
+	class VocabTable
+	{
+	public:
+		static constexpr uint32_t kNotFound = static_cast<uint32_t>(-1);
+
+		VocabTable() = default;
+
+		/*!
+		 * \brief Build the table.
+		 * \param tokens The token bytes indexed by id, empty entries are unused ids.
+		 *  When the same bytes appear under several ids, TokenToId returns the smallest.
+		 */
+		explicit VocabTable(const std::vector<std::string_view>& tokens);
+
+		VocabTable(const VocabTable&) = delete;
+		VocabTable& operator=(const VocabTable&) = delete;
+
+		/*!
+		 * \brief The arrays of a built table, e.g. emitted as static data by
+		 *  tokenizer_codegen so that loading it costs nothing.
+		 */
+		struct Image
+		{
+			std::string_view blob;
+			const uint32_t* offsets = nullptr;
+			size_t num_offsets = 0;
+			const uint32_t* seeds = nullptr;
+			size_t num_seeds = 0;
+			const uint32_t* slots = nullptr;
+			size_t num_slots = 0;
+		};
+
+		/*!
+		 * \brief A table over the arrays of image, which are borrowed and must
+		 *  outlive it. Nothing is copied or hashed.
+		 */
+		static std::shared_ptr<VocabTable> FromImage(const Image& image);
+
+		/*! \brief The arrays of this table, valid as long as it is alive. */
+		inline const Image& GetImage() const { return image_; }
+
+		/*!
+		 * \brief Token bytes of id, empty if id is out of range or unused.
+		 */
+		inline std::string_view IdToToken(uint32_t id) const
+		{
+			if (id >= Size())
+				return {};
+			return { image_.blob.data() + image_.offsets[id], image_.offsets[id + 1] - image_.offsets[id] };
+		}
+
+		/*!
+		 * \brief Id of the given token bytes, kNotFound if it is not in the vocabulary.
+		 */
+		uint32_t TokenToId(std::string_view token) const;
+
+		/*! \brief Number of ids covered by the table, i.e. the largest id plus one. */
+		inline size_t Size() const { return image_.num_offsets ? image_.num_offsets - 1 : 0; }
+
+		/*! \brief Number of ids that map to a non-empty token. */
+		inline size_t NumTokens() const { return image_.num_slots; }
+
+		/*! \brief Byte length of the token of id, 0 if it is out of range. */
+		inline uint32_t TokenLength(uint32_t id) const
+		{
+			return id < Size() ? image_.offsets[id + 1] - image_.offsets[id] : 0;
+		}
+
+		/*! \brief The blob holding all token bytes back to back. */
+		inline const char* Data() const { return image_.blob.data(); }
+
+		/*! \brief Offsets of each token into Data(), Size() + 1 entries. */
+		inline const uint32_t* Offsets() const { return image_.offsets; }
+
+		/*! \brief Heap bytes held by the table, borrowed image arrays are not counted. */
+		inline size_t MemoryUsage() const
+		{
+			return blob_.capacity() + (offsets_.capacity() + seeds_.capacity() + slots_.capacity()) * sizeof(uint32_t);
+		}
+
+	private:
+		// views of the arrays below, or of a borrowed image
+		Image image_;
+
+		std::string blob_;
+		std::vector<uint32_t> offsets_;
+		// minimal perfect hash: displacement seed per bucket, id per slot
+		std::vector<uint32_t> seeds_;
+		std::vector<uint32_t> slots_;
+	};
+
+	/*!
+	 * \brief Byte-level acceptor driven by TokenBytesIndex::FillMask, e.g. a
+	 *  grammar matcher. Any class with the same two member functions can be
+	 *  passed to the FillMask template directly to avoid the virtual calls.
+	 */
+	class ByteAcceptor
+	{
+	public:
+		virtual ~ByteAcceptor() {}
+
+		/*!
+		 * \brief Consume one byte. On rejection the state must be left unchanged.
+		 * \returns Whether the byte is accepted.
+		 */
+		virtual bool Advance(uint8_t byte) = 0;
+
+		/*!
+		 * \brief Undo the last num_bytes accepted bytes.
+		 */
+		virtual void Rollback(size_t num_bytes) = 0;
+	};
+
+	/*!
+	 * \brief Decoded token bytes sorted lexicographically, with the length of the
+	 *  prefix each token shares with its predecessor.
+	 *
+	 *  FillMask walks the sorted tokens like a trie: bytes shared with the
+	 *  previous token are not fed to the acceptor again, and once a prefix is
+	 *  rejected every following token sharing it is skipped with a SIMD scan of
+	 *  the shared-prefix array.
+	 */
+	class TokenBytesIndex
+	{
+	public:
+		/*!
+		 * \brief Build the index.
+		 * \param decoded The decoded bytes of every token. Tokens with empty bytes,
+		 *  such as special tokens, are left out and never set in a mask.
+		 */
+		explicit TokenBytesIndex(std::shared_ptr<const VocabTable> decoded);
+
+		/*! \brief Number of ids covered by a mask. */
+		inline size_t VocabSize() const { return decoded_->Size(); }
+
+		/*! \brief Number of 32-bit words of a mask. */
+		inline size_t MaskWords() const { return (VocabSize() + 31) / 32; }
+
+		/*! \brief The decoded vocabulary this index was built from. */
+		inline const VocabTable& Decoded() const { return *decoded_; }
+
+		/*! \brief Heap bytes held by the index, not counting Decoded(). */
+		inline size_t MemoryUsage() const
+		{
+			return order_.capacity() * sizeof(uint32_t) + lcp_.capacity() * sizeof(uint16_t);
+		}
+
+		/*!
+		 * \brief Set bit id of bitmask for every token whose bytes are fully
+		 *  accepted from the acceptor's current state, clear all other bits.
+		 *  The acceptor is returned in the state it was passed in.
+		 * \param bitmask MaskWords() words, bit (id % 32) of word (id / 32).
+		 */
+		template <class _Acceptor>
+		void FillMask(_Acceptor& acceptor, uint32_t* bitmask) const
+		{
+			std::memset(bitmask, 0, MaskWords() * sizeof(uint32_t));
+
+			const char* data = decoded_->Data();
+			const uint32_t* offsets = decoded_->Offsets();
+			const size_t n = order_.size();
+
+			// number of bytes of the previous token currently fed to the acceptor
+			size_t depth = 0;
+			size_t i = 0;
+			while (i < n)
+			{
+				size_t shared = lcp_[i];
+				if (depth < shared)
+				{
+					// the previous token failed inside the prefix this one shares
+					i = SkipRejected(i + 1, depth);
+					continue;
+				}
+				if (depth > shared)
+				{
+					acceptor.Rollback(depth - shared);
+					depth = shared;
+				}
+
+				uint32_t id = order_[i];
+				const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data + offsets[id]);
+				size_t len = offsets[id + 1] - offsets[id];
+				while (depth < len && acceptor.Advance(bytes[depth]))
+					++depth;
+				if (depth == len)
+					bitmask[id / 32] |= 1u << (id % 32);
+				++i;
+			}
+			acceptor.Rollback(depth);
+		}
+
+		void FillMask(ByteAcceptor& acceptor, uint32_t* bitmask) const;
+
+	private:
+		/*! \brief First position from begin whose shared prefix is at most depth. */
+		size_t SkipRejected(size_t begin, size_t depth) const;
+
+		std::shared_ptr<const VocabTable> decoded_;
+		// token ids in byte order, and the prefix length shared with the previous one
+		std::vector<uint32_t> order_;
+		std::vector<uint16_t> lcp_;
+	};
+} // namespace tokenizers
+#endif // TOKENIZERS_VOCAB_H_
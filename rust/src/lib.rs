@@ -1,10 +1,33 @@
 // A simple C wrapper of tokenzier library
 use serde_json::Value;
-use std::{ collections::HashMap, ffi::c_void, mem, str::FromStr };
+use std::{
+    collections::{ HashMap, HashSet },
+    ffi::c_void,
+    mem,
+    cell::{ Cell, RefCell },
+    str::FromStr,
+    sync::{ atomic::{ AtomicU64, Ordering }, Arc, OnceLock, RwLock },
+    time::{ Duration, Instant },
+};
+use rayon::{ ThreadBuilder, ThreadPool, ThreadPoolBuilder };
 use tokenizers::{
-    models::bpe::BPE,
+    models::{ bpe::BPE, ModelWrapper },
+    pad_encodings,
     pre_tokenizers::byte_level::ByteLevel,
-    tokenizer::{ Encoding, Tokenizer },
+    tokenizer::{ pattern::Pattern, Encoding, Tokenizer },
+    utils::parallelism::{ get_parallelism, set_parallelism, MaybeParallelIterator },
+    AddedToken,
+    Model,
+    OffsetReferential,
+    OffsetType,
+    Offsets,
+    PaddingStrategy,
+    PostProcessor,
+    PreTokenizedString,
+    PreTokenizer,
+    SplitDelimiterBehavior,
+    Token,
+    TruncationDirection,
 };
 
 type CustomAllocatorArgs = *mut c_void;
@@ -64,56 +87,917 @@ unsafe fn resize_cvec(
     return allocator(len, allocator_args);
 }
 
+// Deserializes straight into the map, without building a Value tree first.
+#[inline]
+fn parse_vocab(json: &str, what: &str) -> HashMap<String, u32> {
+    if json.trim().is_empty() {
+        return HashMap::new();
+    }
+    return serde_json
+        ::from_str::<HashMap<String, u32>>(json)
+        .unwrap_or_else(|err| panic!("Invalid {} file: {}", what, err));
+}
+
+// One "left right" pair per line. The lines are split in parallel, only the
+// pairs handed to the BPE builder are owned.
+#[inline]
+fn parse_merges(merges: &str) -> Merges {
+    let lines: Vec<&str> = merges
+        .lines()
+        .filter(|line| !line.starts_with("#version") && !line.trim_end().is_empty())
+        .collect::<Vec<&str>>();
+    return lines
+        .into_maybe_par_iter()
+        .map(|line| {
+            match line.split_once(' ') {
+                Some((left, right)) if !right.contains(' ') => (left.to_string(), right.to_string()),
+                _ => panic!("Invalid merges.txt file."),
+            }
+        })
+        .collect::<Merges>();
+}
+
 #[inline]
 fn byte_level_bpe_from_str(vocab: &str, merges: &str, added_tokens: &str) -> Tokenizer {
-    let vocab_json: Value = serde_json::from_str(vocab).unwrap();
-    let added_tokens_json: Value = serde_json::from_str(added_tokens).unwrap();
-    let mut vocab: HashMap<String, u32> = HashMap::new();
-    match vocab_json {
-        Value::Object(m) => {
-            for (token, id) in m {
-                if let Value::Number(id) = id {
-                    let id = id.as_u64().unwrap() as u32;
-                    vocab.insert(token, id);
+    let mut vocab: Vocab = parse_vocab(vocab, "vocab.json");
+    vocab.extend(parse_vocab(added_tokens, "added_tokens.json"));
+    let merges: Merges = parse_merges(merges);
+
+    let byte_level = ByteLevel::new(false, false, false);
+    let mut tokenizer: Tokenizer = Tokenizer::new(BPE::new(vocab, merges));
+    tokenizer.with_pre_tokenizer(Some(byte_level)).with_decoder(Some(byte_level));
+    return tokenizer;
+}
+
+// Hand-coded scanners for the split regexes of the common byte-level BPE
+// tokenizers. They only handle ASCII input, where the Unicode classes reduce to
+// \p{L} = [A-Za-z], \p{N} = [0-9] and \s = [\t\n\x0b\x0c\r ], and otherwise
+// report an error so the caller falls back to the onig regex.
+const GPT2_SPLIT_REGEX: &str =
+    r"'s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+";
+const LLAMA3_SPLIT_REGEX: &str =
+    r"(?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+";
+const QWEN2_SPLIT_REGEX: &str =
+    r"(?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+";
+
+#[derive(Clone, Copy)]
+enum SplitScanner {
+    Gpt2,
+    // Llama-3 and Qwen2 only differ in the length of digit runs
+    Cl100k {
+        max_digits: usize,
+    },
+}
+
+#[inline]
+fn is_space(b: u8) -> bool {
+    return b == b' ' || (b'\t'..=b'\r').contains(&b);
+}
+
+#[inline]
+fn is_newline(b: u8) -> bool {
+    return b == b'\r' || b == b'\n';
+}
+
+#[inline]
+fn is_other(b: u8) -> bool {
+    return !is_space(b) && !b.is_ascii_alphanumeric();
+}
+
+// End of the run of bytes matching pred that starts at i.
+#[inline]
+fn run_end(s: &[u8], mut i: usize, pred: fn(u8) -> bool) -> usize {
+    while i < s.len() && pred(s[i]) {
+        i += 1;
+    }
+    return i;
+}
+
+// Length of 's|'t|'re|'ve|'m|'ll|'d at i, 0 if none.
+#[inline]
+fn contraction_len(s: &[u8], i: usize, ignore_case: bool) -> usize {
+    if s[i] != b'\'' || i + 1 >= s.len() {
+        return 0;
+    }
+    let fold = |b: u8| if ignore_case { b.to_ascii_lowercase() } else { b };
+    let first: u8 = fold(s[i + 1]);
+    if matches!(first, b's' | b't' | b'm' | b'd') {
+        return 2;
+    }
+    if i + 2 < s.len() && matches!((first, fold(s[i + 2])), (b'r', b'e') | (b'v', b'e') | (b'l', b'l')) {
+        return 3;
+    }
+    return 0;
+}
+
+// \s+(?!\S)|\s+ at the whitespace byte i: the run leaves its last byte to the
+// next token when a non-space follows, unless that byte is all there is.
+#[inline]
+fn space_end(s: &[u8], i: usize) -> usize {
+    let end: usize = run_end(s, i, is_space);
+    return if end < s.len() && end - i > 1 { end - 1 } else { end };
+}
+
+impl SplitScanner {
+    fn from_regex(regex: &str) -> Option<SplitScanner> {
+        return match regex {
+            GPT2_SPLIT_REGEX => Some(SplitScanner::Gpt2),
+            LLAMA3_SPLIT_REGEX => Some(SplitScanner::Cl100k { max_digits: 3 }),
+            QWEN2_SPLIT_REGEX => Some(SplitScanner::Cl100k { max_digits: 1 }),
+            _ => None,
+        };
+    }
+
+    // End of the token starting at i, trying the alternatives in regex order.
+    #[inline]
+    fn token_end(&self, s: &[u8], i: usize) -> usize {
+        let c: u8 = s[i];
+        let next: Option<u8> = s.get(i + 1).copied();
+        match *self {
+            SplitScanner::Gpt2 => {
+                let len: usize = contraction_len(s, i, false);
+                if len > 0 {
+                    return i + len;
+                }
+                // ' ?' only takes the space when a letter, digit or other follows
+                let start: usize = if c == b' ' && next.map_or(false, |b| !is_space(b)) { i + 1 } else { i };
+                let first: u8 = s[start];
+                if first.is_ascii_alphabetic() {
+                    return run_end(s, start, |b| b.is_ascii_alphabetic());
                 }
+                if first.is_ascii_digit() {
+                    return run_end(s, start, |b| b.is_ascii_digit());
+                }
+                if is_other(first) {
+                    return run_end(s, start, is_other);
+                }
+                return space_end(s, i);
+            }
+            SplitScanner::Cl100k { max_digits } => {
+                let len: usize = contraction_len(s, i, true);
+                if len > 0 {
+                    return i + len;
+                }
+                if c.is_ascii_alphabetic() {
+                    return run_end(s, i, |b| b.is_ascii_alphabetic());
+                }
+                if !is_newline(c) && !c.is_ascii_digit() && next.map_or(false, |b| b.is_ascii_alphabetic()) {
+                    return run_end(s, i + 1, |b| b.is_ascii_alphabetic());
+                }
+                if c.is_ascii_digit() {
+                    return run_end(s, i, |b| b.is_ascii_digit()).min(i + max_digits);
+                }
+                let start: usize = if c == b' ' && next.map_or(false, is_other) { i + 1 } else { i };
+                if is_other(s[start]) {
+                    return run_end(s, run_end(s, start, is_other), is_newline);
+                }
+                // \s*[\r\n]+ backtracks to the last newline of the whitespace run
+                let end: usize = run_end(s, i, is_space);
+                if let Some(k) = (i..end).rev().find(|&k| is_newline(s[k])) {
+                    return k + 1;
+                }
+                return space_end(s, i);
             }
         }
-        _ => panic!("Invalid vocab.json file."),
     }
-    match added_tokens_json {
-        Value::Object(m) => {
-            for (token, id) in m {
-                if let Value::Number(id) = id {
-                    let id = id.as_u64().unwrap() as u32;
-                    vocab.insert(token, id);
-                }
+}
+
+impl Pattern for SplitScanner {
+    fn find_matches(&self, inside: &str) -> tokenizers::Result<Vec<(Offsets, bool)>> {
+        if inside.is_empty() {
+            return Ok(vec![((0, 0), false)]);
+        }
+        if !inside.is_ascii() {
+            return Err("split scanners only handle ASCII input".into());
+        }
+        let s: &[u8] = inside.as_bytes();
+        let mut matches: Vec<(Offsets, bool)> = Vec::with_capacity(s.len() / 4 + 1);
+        let mut i: usize = 0;
+        while i < s.len() {
+            let end: usize = self.token_end(s, i);
+            matches.push(((i, end), true));
+            i = end;
+        }
+        return Ok(matches);
+    }
+}
+
+// A pre-tokenizer whose split regex has a scanner. It splits the same way and
+// then applies the byte-level mapping of the configured pre-tokenizer.
+#[derive(Clone, Copy)]
+struct FastPreTokenizer {
+    scanner: SplitScanner,
+    // ByteLevel with use_regex prepends the space before splitting
+    prefix_space: bool,
+    byte_level: ByteLevel,
+}
+
+impl FastPreTokenizer {
+    // Recognizes ByteLevel with its builtin GPT-2 regex, and Sequence[Split,
+    // ByteLevel] as written by Llama-3 and Qwen2 tokenizer.json files.
+    fn detect(tokenizer: &Tokenizer) -> Option<FastPreTokenizer> {
+        let value: Value = serde_json::to_value(tokenizer.get_pre_tokenizer()?).ok()?;
+        let byte_level = |v: &Value| -> Option<(bool, bool, bool)> {
+            if v.get("type")?.as_str()? != "ByteLevel" {
+                return None;
             }
+            return Some((
+                v.get("add_prefix_space")?.as_bool()?,
+                v.get("trim_offsets")?.as_bool()?,
+                v.get("use_regex")?.as_bool()?,
+            ));
+        };
+
+        if let Some((prefix_space, trim_offsets, true)) = byte_level(&value) {
+            return Some(FastPreTokenizer {
+                scanner: SplitScanner::Gpt2,
+                prefix_space: prefix_space,
+                byte_level: ByteLevel::new(false, trim_offsets, false),
+            });
+        }
+
+        if value.get("type")?.as_str()? != "Sequence" {
+            return None;
         }
-        _ => panic!("Invalid added_tokens.json file."),
+        let steps: &Vec<Value> = value.get("pretokenizers")?.as_array()?;
+        if steps.len() != 2 {
+            return None;
+        }
+        let split: &Value = &steps[0];
+        if
+            split.get("type")?.as_str()? != "Split" ||
+            split.get("behavior")?.as_str()? != "Isolated" ||
+            split.get("invert")?.as_bool()?
+        {
+            return None;
+        }
+        let scanner: SplitScanner = SplitScanner::from_regex(split.get("pattern")?.get("Regex")?.as_str()?)?;
+        let (prefix_space, trim_offsets, use_regex) = byte_level(&steps[1])?;
+        if use_regex {
+            return None;
+        }
+        return Some(FastPreTokenizer {
+            scanner: scanner,
+            prefix_space: false,
+            byte_level: ByteLevel::new(prefix_space, trim_offsets, false),
+        });
     }
 
-    let merges: Vec<(String, String)> = merges
-        .lines()
-        .filter(|line| !line.starts_with("#version"))
-        .map(|line| {
-            let parts = line.split(' ').collect::<Vec<_>>();
-            if parts.len() != 2 {
-                panic!("Invalid merges.txt file.");
+    fn pre_tokenize(&self, pretokenized: &mut PreTokenizedString) -> tokenizers::Result<()> {
+        pretokenized.split(|_, mut normalized| {
+            if self.prefix_space && !normalized.get().starts_with(' ') {
+                normalized.prepend(" ");
+            }
+            normalized.split(self.scanner, SplitDelimiterBehavior::Isolated)
+        })?;
+        return self.byte_level.pre_tokenize(pretokenized);
+    }
+}
+
+// Fast pre-tokenizers of the live handles, keyed by handle address. Handles
+// without an entry use their own pre-tokenizer.
+fn fast_pre_tokenizers() -> &'static RwLock<HashMap<usize, FastPreTokenizer>> {
+    static FAST_PRE_TOKENIZERS: OnceLock<RwLock<HashMap<usize, FastPreTokenizer>>> = OnceLock::new();
+    return FAST_PRE_TOKENIZERS.get_or_init(|| RwLock::new(HashMap::new()));
+}
+
+#[inline]
+fn fast_pre_tokenizer(handle: *const Tokenizer) -> Option<FastPreTokenizer> {
+    return fast_pre_tokenizers()
+        .read()
+        .unwrap()
+        .get(&(handle as usize))
+        .copied();
+}
+
+// Boxes a new tokenizer for the C side, with the fast path on when it applies.
+fn into_handle(tokenizer: Tokenizer) -> *mut Tokenizer {
+    let fast: Option<FastPreTokenizer> = FastPreTokenizer::detect(&tokenizer);
+    let handle: *mut Tokenizer = Box::into_raw(Box::new(tokenizer));
+    if let Some(fast) = fast {
+        fast_pre_tokenizers().write().unwrap().insert(handle as usize, fast);
+    }
+    return handle;
+}
+
+// Bounds on the work of one encode call, so that pathological inputs such as
+// long base64 runs cannot stall a worker. See tokenizers_set_encode_guard.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct EncodeGuard {
+    // pre-tokens longer than this are cut into pieces of at most this many bytes, 0 for no cap
+    max_piece_bytes: usize,
+    // bytes of pieces the model may merge per call, 0 for no limit
+    work_budget: usize,
+    // wall-clock budget per call in microseconds, 0 for none
+    time_budget_us: u64,
+}
+
+// Number of times the guards triggered, across all handles.
+#[repr(C)]
+pub struct EncodeGuardStats {
+    pieces_split: u64,
+    budget_exceeded: u64,
+}
+
+static PIECES_SPLIT: AtomicU64 = AtomicU64::new(0);
+static BUDGETS_EXCEEDED: AtomicU64 = AtomicU64::new(0);
+
+// Guards of the live handles, keyed by handle address like the fast pre-tokenizers.
+fn encode_guards() -> &'static RwLock<HashMap<usize, EncodeGuard>> {
+    static ENCODE_GUARDS: OnceLock<RwLock<HashMap<usize, EncodeGuard>>> = OnceLock::new();
+    return ENCODE_GUARDS.get_or_init(|| RwLock::new(HashMap::new()));
+}
+
+#[inline]
+fn encode_guard(handle: *const Tokenizer) -> Option<EncodeGuard> {
+    return encode_guards()
+        .read()
+        .unwrap()
+        .get(&(handle as usize))
+        .copied();
+}
+
+// Cuts a pre-token into pieces of at most max_bytes, at char boundaries.
+// Isolated keeps every piece, so the cut is the same on every call.
+#[derive(Clone, Copy)]
+struct PieceChunks {
+    max_bytes: usize,
+}
+
+impl Pattern for PieceChunks {
+    fn find_matches(&self, inside: &str) -> tokenizers::Result<Vec<(Offsets, bool)>> {
+        if inside.len() <= self.max_bytes {
+            return Ok(vec![((0, inside.len()), false)]);
+        }
+        PIECES_SPLIT.fetch_add(1, Ordering::Relaxed);
+        let mut matches: Vec<(Offsets, bool)> = Vec::with_capacity(inside.len() / self.max_bytes + 1);
+        let mut start: usize = 0;
+        while start < inside.len() {
+            let mut end: usize = (start + self.max_bytes).min(inside.len());
+            while !inside.is_char_boundary(end) {
+                end -= 1;
+            }
+            if end == start {
+                // a single char longer than the cap
+                end = start + inside[start..].chars().next().unwrap().len_utf8();
+            }
+            matches.push(((start, end), true));
+            start = end;
+        }
+        return Ok(matches);
+    }
+}
+
+// Work and time left to one call. Once either runs out it stays out, and the
+// rest of the input is tokenized char by char, which is linear in any model.
+struct EncodeBudget {
+    work_left: Cell<usize>,
+    deadline: Option<Instant>,
+    exceeded: Cell<bool>,
+}
+
+impl EncodeBudget {
+    fn new(guard: &EncodeGuard) -> EncodeBudget {
+        return EncodeBudget {
+            work_left: Cell::new(if guard.work_budget > 0 { guard.work_budget } else { usize::MAX }),
+            deadline: if guard.time_budget_us > 0 {
+                Some(Instant::now() + Duration::from_micros(guard.time_budget_us))
+            } else {
+                None
+            },
+            exceeded: Cell::new(false),
+        };
+    }
+
+    // Whether the model may merge a piece of len bytes.
+    #[inline]
+    fn spend(&self, len: usize) -> bool {
+        if self.exceeded.get() {
+            return false;
+        }
+        let late: bool = self.deadline.map_or(false, |deadline| Instant::now() >= deadline);
+        if late || len > self.work_left.get() {
+            self.exceeded.set(true);
+            BUDGETS_EXCEEDED.fetch_add(1, Ordering::Relaxed);
+            return false;
+        }
+        self.work_left.set(self.work_left.get() - len);
+        return true;
+    }
+}
+
+// Tokens of each char of piece on its own, offsets relative to piece.
+fn tokenize_chars(model: &impl Model, piece: &str) -> tokenizers::Result<Vec<Token>> {
+    let mut tokens: Vec<Token> = Vec::with_capacity(piece.len());
+    for (start, c) in piece.char_indices() {
+        for mut token in model.tokenize(&piece[start..start + c.len_utf8()])? {
+            token.offsets = (token.offsets.0 + start, token.offsets.1 + start);
+            tokens.push(token);
+        }
+    }
+    return Ok(tokens);
+}
+
+// Added tokens extracted, normalized and pre-tokenized, by the scanner when
+// it handles the input and by the configured pre-tokenizer otherwise.
+fn pre_tokenize(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    input: &str
+) -> tokenizers::Result<PreTokenizedString> {
+    let extract = || {
+        tokenizer.get_added_vocabulary().extract_and_normalize(tokenizer.get_normalizer(), input)
+    };
+    let mut pretokenized: PreTokenizedString = extract();
+    if let Some(fast) = fast.filter(|_| input.is_ascii()) {
+        if fast.pre_tokenize(&mut pretokenized).is_ok() {
+            return Ok(pretokenized);
+        }
+        pretokenized = extract();
+    }
+    if let Some(pre_tokenizer) = tokenizer.get_pre_tokenizer() {
+        pre_tokenizer.pre_tokenize(&mut pretokenized)?;
+    }
+    return Ok(pretokenized);
+}
+
+// pre_tokenize with the pre-tokens longer than the guard's cap cut.
+fn pre_tokenize_guarded(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: &EncodeGuard,
+    input: &str
+) -> tokenizers::Result<PreTokenizedString> {
+    let mut pretokenized: PreTokenizedString = pre_tokenize(tokenizer, fast, input)?;
+    if guard.max_piece_bytes > 0 {
+        let chunks = PieceChunks { max_bytes: guard.max_piece_bytes };
+        pretokenized.split(|_, normalized| normalized.split(chunks, SplitDelimiterBehavior::Isolated))?;
+    }
+    return Ok(pretokenized);
+}
+
+// One sequence tokenized under the guard, if any, but not post-processed.
+fn encode_sequence(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    input: &str,
+    type_id: u32
+) -> tokenizers::Result<Encoding> {
+    let model = tokenizer.get_model();
+    let mut pretokenized: PreTokenizedString = match guard {
+        Some(guard) => {
+            let mut pretokenized: PreTokenizedString = pre_tokenize_guarded(tokenizer, fast, guard, input)?;
+            let budget = EncodeBudget::new(guard);
+            pretokenized.tokenize(|normalized| {
+                let piece: &str = normalized.get();
+                if budget.spend(piece.len()) { model.tokenize(piece) } else { tokenize_chars(model, piece) }
+            })?;
+            pretokenized
+        }
+        None => {
+            let mut pretokenized: PreTokenizedString = pre_tokenize(tokenizer, fast, input)?;
+            pretokenized.tokenize(|normalized| model.tokenize(normalized.get()))?;
+            pretokenized
+        }
+    };
+    return pretokenized.into_encoding(None, type_id, OffsetType::Byte);
+}
+
+// Tokenizer::encode under a guard.
+fn encode_guarded(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: &EncodeGuard,
+    input: &str,
+    add_special_tokens: bool
+) -> tokenizers::Result<Encoding> {
+    let encoding: Encoding = encode_sequence(tokenizer, fast, Some(guard), input, 0)?;
+    return tokenizer.post_process(encoding, None, add_special_tokens);
+}
+
+// Pre-tokens per task of encode_parallel, most are a few bytes long.
+const PIECES_PER_TASK: usize = 1024;
+
+// Tokenizer::encode of one long input with the model run on the worker pool.
+// The model never merges across pre-tokens, so tokenizing them in parallel
+// gives the same encoding as the sequential pipeline. Normalization and
+// pre-tokenization stay sequential, they are linear and cheap next to the
+// merges.
+fn encode_parallel(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    input: &str,
+    add_special_tokens: bool
+) -> tokenizers::Result<Encoding> {
+    // budgets are spent in input order, which a parallel run does not have
+    if let Some(guard) = guard.filter(|g| g.work_budget > 0 || g.time_budget_us > 0) {
+        return encode_guarded(tokenizer, fast, guard, input, add_special_tokens);
+    }
+    let mut pretokenized: PreTokenizedString = match guard {
+        Some(guard) => pre_tokenize_guarded(tokenizer, fast, guard, input)?,
+        None => pre_tokenize(tokenizer, fast, input)?,
+    };
+
+    let model = tokenizer.get_model();
+    let mut tokenized: Vec<Vec<Token>> = Vec::new();
+    {
+        // added tokens already have their tokens and are skipped by tokenize
+        let pieces: Vec<&str> = pretokenized
+            .get_splits(OffsetReferential::Original, OffsetType::Byte)
+            .into_iter()
+            .filter(|(_, _, tokens)| tokens.is_none())
+            .map(|(piece, _, _)| piece)
+            .collect();
+        let tasks: Vec<&[&str]> = pieces.chunks(PIECES_PER_TASK).collect();
+        let results: Vec<tokenizers::Result<Vec<Vec<Token>>>> = tasks
+            .into_maybe_par_iter()
+            .map(|task| {
+                task.iter()
+                    .map(|piece| model.tokenize(piece))
+                    .collect::<tokenizers::Result<Vec<Vec<Token>>>>()
+            })
+            .collect();
+        tokenized.reserve(pieces.len());
+        for result in results {
+            tokenized.extend(result?);
+        }
+    }
+
+    // hands the tokens back in split order
+    let queue = RefCell::new(tokenized.into_iter());
+    pretokenized.tokenize(|_| Ok(queue.borrow_mut().next().unwrap_or_default()))?;
+    let encoding: Encoding = pretokenized.into_encoding(None, 0, OffsetType::Byte)?;
+    return tokenizer.post_process(encoding, None, add_special_tokens);
+}
+
+// Tokenizer::encode with the split done by the scanner.
+fn encode_fast(
+    tokenizer: &Tokenizer,
+    fast: &FastPreTokenizer,
+    input: &str,
+    add_special_tokens: bool
+) -> tokenizers::Result<Encoding> {
+    let mut pretokenized: PreTokenizedString = tokenizer
+        .get_added_vocabulary()
+        .extract_and_normalize(tokenizer.get_normalizer(), input);
+    fast.pre_tokenize(&mut pretokenized)?;
+    pretokenized.tokenize(|normalized| tokenizer.get_model().tokenize(normalized.get()))?;
+    let encoding: Encoding = pretokenized.into_encoding(None, 0, OffsetType::Byte)?;
+    return tokenizer.post_process(encoding, None, add_special_tokens);
+}
+
+// Non-ASCII input, or anything else the fast path rejects, goes through onig.
+#[inline]
+fn encode(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    input: &str,
+    add_special_tokens: bool
+) -> Encoding {
+    if let Some(guard) = guard {
+        return encode_guarded(tokenizer, fast, guard, input, add_special_tokens).unwrap();
+    }
+    if let Some(fast) = fast.filter(|_| input.is_ascii()) {
+        if let Ok(encoding) = encode_fast(tokenizer, fast, input, add_special_tokens) {
+            return encoding;
+        }
+    }
+    return tokenizer.encode(input, add_special_tokens).unwrap();
+}
+
+fn encode_batch(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    input: Vec<&str>,
+    add_special_tokens: bool
+) -> Vec<Encoding> {
+    if fast.is_none() && guard.is_none() {
+        return tokenizer.encode_batch(input, add_special_tokens).unwrap();
+    }
+    let mut encodings: Vec<Encoding> = input
+        .into_maybe_par_iter()
+        .map(|s| encode(tokenizer, fast, guard, s, add_special_tokens))
+        .collect::<Vec<Encoding>>();
+    if let Some(padding) = tokenizer.get_padding() {
+        pad_encodings(&mut encodings, padding).unwrap();
+    }
+    return encodings;
+}
+
+// Truncation strategies of encode_pair_batch, the values of tokenizers::TruncationStrategy.
+const TRUNCATE_LONGEST_FIRST: i32 = 0;
+const TRUNCATE_ONLY_SECOND: i32 = 1;
+
+// Lengths the sequences of a pair are cut to so that together they fit
+// max_length, by the rules of the crate's truncate_encodings. Where the crate
+// fails, only_second with a first sequence that alone is too long, the second
+// sequence is dropped and the first kept whole.
+fn pair_lengths(n1: usize, n2: usize, max_length: usize, strategy: i32) -> (usize, usize) {
+    if n1 + n2 <= max_length {
+        return (n1, n2);
+    }
+    if strategy == TRUNCATE_ONLY_SECOND {
+        return (n1, n2.saturating_sub(n1 + n2 - max_length));
+    }
+    debug_assert!(strategy == TRUNCATE_LONGEST_FIRST);
+    // the longer one is cut to what the shorter leaves, or both to half
+    let short: usize = n1.min(n2);
+    let (mut short_len, mut long_len) = (short, if short > max_length { short } else { short.max(max_length - short) });
+    if short_len + long_len > max_length {
+        short_len = max_length / 2;
+        long_len = short_len + (max_length % 2);
+    }
+    return if n1 <= n2 { (short_len, long_len) } else { (long_len, short_len) };
+}
+
+// The pairs (firsts[first_index[i]], seconds[i]) through the post-processor's
+// pair template, as Tokenizer::encode of a dual input with the given
+// truncation instead of the tokenizer's. Each first is tokenized once and
+// cloned into its pairs, so one query against many passages costs one query.
+fn encode_pair_batch(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    firsts: Vec<&str>,
+    seconds: Vec<&str>,
+    first_index: &[usize],
+    add_special_tokens: bool,
+    max_length: usize,
+    strategy: i32
+) -> Vec<Encoding> {
+    let encode_all = |input: Vec<&str>, type_id: u32| {
+        input
+            .into_maybe_par_iter()
+            .map(|s| encode_sequence(tokenizer, fast, guard, s, type_id).unwrap())
+            .collect::<Vec<Encoding>>()
+    };
+    let firsts: Vec<Encoding> = encode_all(firsts, 0);
+    let seconds: Vec<Encoding> = encode_all(seconds, 1);
+
+    let processor = tokenizer.get_post_processor();
+    // max_length counts the special tokens the template adds
+    let budget: Option<usize> = if max_length == 0 {
+        None
+    } else if add_special_tokens {
+        Some(max_length.saturating_sub(processor.map_or(0, |p| p.added_tokens(true))))
+    } else {
+        Some(max_length)
+    };
+
+    let pairs: Vec<(usize, Encoding)> = first_index.iter().copied().zip(seconds).collect();
+    let mut encodings: Vec<Encoding> = pairs
+        .into_maybe_par_iter()
+        .map(|(i, mut second)| {
+            let mut first: Encoding = firsts[i].clone();
+            if let Some(budget) = budget {
+                let (n1, n2) = pair_lengths(first.len(), second.len(), budget, strategy);
+                first.truncate(n1, 0, TruncationDirection::Right);
+                second.truncate(n2, 0, TruncationDirection::Right);
+            }
+            match processor {
+                Some(processor) => processor.process(first, Some(second), add_special_tokens).unwrap(),
+                None => <dyn PostProcessor>::default_process(vec![first, second], add_special_tokens)
+                    .unwrap()
+                    .pop()
+                    .unwrap(),
             }
-            return (parts[0].to_string(), parts[1].to_string()); // Add the `return` keyword here
         })
-        .collect::<Vec<(String, String)>>();
-    let byte_level = ByteLevel::new(false, false, false);
-    let mut tokenizer: Tokenizer = Tokenizer::new(BPE::new(vocab, merges));
-    tokenizer.with_pre_tokenizer(Some(byte_level)).with_decoder(Some(byte_level));
-    return tokenizer;
+        .collect();
+    if let Some(padding) = tokenizer.get_padding() {
+        pad_encodings(&mut encodings, padding).unwrap();
+    }
+    return encodings;
+}
+
+// Pool the batch entry points run on, rayon's global pool when None.
+fn thread_pool() -> &'static RwLock<Option<Arc<ThreadPool>>> {
+    static THREAD_POOL: OnceLock<RwLock<Option<Arc<ThreadPool>>>> = OnceLock::new();
+    return THREAD_POOL.get_or_init(|| RwLock::new(None));
+}
+
+// Parallelism in effect before a pool was configured, from the environment or
+// an earlier set_parallelism, put back when the pool is reset.
+fn parallelism_before_pool() -> &'static RwLock<Option<bool>> {
+    static PARALLELISM_BEFORE_POOL: OnceLock<RwLock<Option<bool>>> = OnceLock::new();
+    return PARALLELISM_BEFORE_POOL.get_or_init(|| RwLock::new(None));
+}
+
+// Runs op on the configured pool, so the parallel iterators inside it use
+// that pool's workers. In-flight calls keep a replaced pool alive.
+#[inline]
+fn with_thread_pool<R: Send>(op: impl FnOnce() -> R + Send) -> R {
+    let pool: Option<Arc<ThreadPool>> = thread_pool().read().unwrap().clone();
+    return match pool {
+        Some(pool) => pool.install(op),
+        None => op(),
+    };
+}
+
+// Raw pointers handed back to the C side from worker threads.
+#[derive(Clone, Copy)]
+struct SendPtr(*mut c_void);
+
+unsafe impl Send for SendPtr {}
+unsafe impl Sync for SendPtr {}
+
+impl SendPtr {
+    #[inline]
+    fn get(self) -> *mut c_void {
+        return self.0;
+    }
+}
+
+type ThreadStartHandler = unsafe extern fn(usize, *mut c_void);
+type WorkerMain = unsafe extern fn(*mut c_void);
+type SpawnWorker = unsafe extern fn(WorkerMain, *mut c_void, *mut c_void) -> i32;
+type ParallelForBody = unsafe extern fn(*mut c_void, usize);
+
+#[repr(C)]
+pub struct ThreadPoolConfig {
+    // 0 goes back to rayon's global pool
+    num_threads: usize,
+    // called on each worker thread as it starts, e.g. to pin it to a CPU
+    on_thread_start: Option<ThreadStartHandler>,
+    // runs a worker on a thread of the caller instead of a new one, returns 0 on success
+    spawn: Option<SpawnWorker>,
+    user_data: *mut c_void,
+}
+
+unsafe extern fn run_worker(worker: *mut c_void) {
+    let thread: Box<ThreadBuilder> = Box::from_raw(worker as *mut ThreadBuilder);
+    thread.run();
+}
+
+fn build_thread_pool(config: &ThreadPoolConfig) -> Result<ThreadPool, rayon::ThreadPoolBuildError> {
+    let user_data: SendPtr = SendPtr(config.user_data);
+    let mut builder = ThreadPoolBuilder::new()
+        .num_threads(config.num_threads)
+        .thread_name(|index| format!("tokenizers-{}", index));
+    if let Some(on_thread_start) = config.on_thread_start {
+        builder = builder.start_handler(move |index| unsafe { on_thread_start(index, user_data.get()) });
+    }
+    if let Some(spawn) = config.spawn {
+        return builder
+            .spawn_handler(move |thread| unsafe {
+                let worker: *mut ThreadBuilder = Box::into_raw(Box::new(thread));
+                if spawn(run_worker, worker as *mut c_void, user_data.get()) != 0 {
+                    mem::drop(Box::from_raw(worker));
+                    return Err(std::io::Error::new(std::io::ErrorKind::Other, "spawn callback failed"));
+                }
+                return Ok(());
+            })
+            .build();
+    }
+    return builder.build();
+}
+
+// Runs the encode pipeline up to the model, but only keeps the running count of
+// tokens, then applies the truncation and padding of the tokenizer to it the
+// way post_process does. Stops as soon as the count exceeds `limit`, or reaches
+// what truncation keeps, so the result is only exact when it is <= `limit`.
+#[inline]
+fn count_tokens(
+    tokenizer: &Tokenizer,
+    fast: Option<&FastPreTokenizer>,
+    guard: Option<&EncodeGuard>,
+    input: &str,
+    add_special_tokens: bool,
+    limit: usize
+) -> usize {
+    let added: usize = if add_special_tokens {
+        tokenizer.get_post_processor().map_or(0, |p| p.added_tokens(false))
+    } else {
+        0
+    };
+    // truncation keeps what the special tokens leave of max_length
+    let keep: usize = tokenizer.get_truncation().map_or(usize::MAX, |t| t.max_length.saturating_sub(added));
+
+    let mut count: usize = 0;
+    if added <= limit && keep > 0 {
+        // counted the way encode would tokenize, so a guard applies here too
+        let pretokenized: PreTokenizedString = match guard {
+            Some(guard) => pre_tokenize_guarded(tokenizer, fast, guard, input).unwrap(),
+            None => pre_tokenize(tokenizer, fast, input).unwrap(),
+        };
+        let budget: Option<EncodeBudget> = guard.map(EncodeBudget::new);
+        let model = tokenizer.get_model();
+        for (split, _, tokens) in pretokenized.get_splits(OffsetReferential::Original, OffsetType::Byte) {
+            count += match tokens {
+                Some(tokens) => tokens.len(),
+                None if budget.as_ref().map_or(true, |b| b.spend(split.len())) => model.tokenize(split).unwrap().len(),
+                None => tokenize_chars(model, split).unwrap().len(),
+            };
+            if count >= keep || count + added > limit {
+                break;
+            }
+        }
+    }
+
+    let mut total: usize = count.min(keep) + added;
+    if let Some(padding) = tokenizer.get_padding() {
+        let mut pad_length: usize = match padding.strategy {
+            PaddingStrategy::Fixed(size) => size,
+            PaddingStrategy::BatchLongest => total,
+        };
+        if let Some(multiple) = padding.pad_to_multiple_of.filter(|m| *m > 0) {
+            pad_length = pad_length.div_ceil(multiple) * multiple;
+        }
+        total = total.max(pad_length);
+    }
+    return total;
+}
+
+// Tokens indexed by id, "" for ids that are not used.
+#[inline]
+fn vocab_by_id(vocab: &HashMap<String, u32>) -> Vec<&str> {
+    let len: usize = vocab.values().max().map_or(0, |id| (*id as usize) + 1);
+    let mut tokens: Vec<&str> = vec![""; len];
+    vocab.iter().for_each(|(token, id)| {
+        tokens[*id as usize] = token.as_str();
+    });
+    return tokens;
+}
+
+// GPT-2 byte-level alphabet, mapping each printable char back to its byte.
+fn byte_level_alphabet() -> HashMap<char, u8> {
+    let mut bytes: Vec<u8> = (b'!'..=b'~').chain(0xa1..=0xac).chain(0xae..=0xff).collect();
+    let mut chars: Vec<u32> = bytes
+        .iter()
+        .map(|b| *b as u32)
+        .collect();
+    let mut n: u32 = 0;
+    for b in 0..=255u8 {
+        if !bytes.contains(&b) {
+            bytes.push(b);
+            chars.push(256 + n);
+            n += 1;
+        }
+    }
+    return bytes
+        .into_iter()
+        .zip(chars)
+        .map(|(b, c)| (char::from_u32(c).unwrap(), b))
+        .collect();
+}
+
+fn collect_types(value: &Value, types: &mut Vec<String>) {
+    match value {
+        Value::Object(m) => {
+            if let Some(Value::String(t)) = m.get("type") {
+                types.push(t.clone());
+            }
+            m.values().for_each(|v| collect_types(v, types));
+        }
+        Value::Array(a) => a.iter().for_each(|v| collect_types(v, types)),
+        _ => {}
+    }
+}
+
+// The bytes a single token contributes to decoded text, for the decoders in
+// common use. Leading-space stripping of the first token is not applied.
+fn token_bytes(
+    token: &str,
+    byte_level: Option<&HashMap<char, u8>>,
+    byte_fallback: bool,
+    metaspace: bool,
+    wordpiece: bool
+) -> Vec<u8> {
+    if let Some(alphabet) = byte_level {
+        let bytes: Option<Vec<u8>> = token
+            .chars()
+            .map(|c| alphabet.get(&c).copied())
+            .collect();
+        if let Some(bytes) = bytes {
+            return bytes;
+        }
+    }
+    if byte_fallback && token.len() == 6 && token.starts_with("<0x") && token.ends_with('>') {
+        if let Ok(byte) = u8::from_str_radix(&token[3..5], 16) {
+            return vec![byte];
+        }
+    }
+    if wordpiece {
+        return match token.strip_prefix("##") {
+            Some(rest) => rest.as_bytes().to_vec(),
+            None => format!(" {}", token).into_bytes(),
+        };
+    }
+    if metaspace {
+        return token.replace('\u{2581}', " ").into_bytes();
+    }
+    return token.as_bytes().to_vec();
 }
 
 #[no_mangle]
 extern "C" fn tokenizers_new_from_str(input_cstr: *const u8, len: usize) -> *mut Tokenizer {
     unsafe {
         let json: &str = std::str::from_utf8(std::slice::from_raw_parts(input_cstr, len)).unwrap();
-        return Box::into_raw(Box::new(Tokenizer::from_str(json).unwrap().into()));
+        return into_handle(Tokenizer::from_str(json).unwrap());
     }
 }
 
@@ -121,7 +1005,7 @@ extern "C" fn tokenizers_new_from_str(input_cstr: *const u8, len: usize) -> *mut
 extern "C" fn tokenizers_new_from_file(input_cstr: *const u8, len: usize) -> *mut Tokenizer {
     unsafe {
         let path: &str = std::str::from_utf8(std::slice::from_raw_parts(input_cstr, len)).unwrap();
-        return Box::into_raw(Box::new(Tokenizer::from_file(path)).unwrap().into());
+        return into_handle(Tokenizer::from_file(path).unwrap());
     }
 }
 
@@ -144,7 +1028,7 @@ extern "C" fn tokenizers_new_from_byte_level_bpe(
         let added_tokens: &str = std::str
             ::from_utf8(std::slice::from_raw_parts(input_added_tokens_str, len_added_tokens))
             .unwrap();
-        return Box::into_raw(Box::new(byte_level_bpe_from_str(vocab, merges, added_tokens)));
+        return into_handle(byte_level_bpe_from_str(vocab, merges, added_tokens));
     }
 }
 
@@ -159,12 +1043,88 @@ extern "C" fn tokenizers_encode(
         let input_data: &str = std::str
             ::from_utf8(std::slice::from_raw_parts(input_cstr, len))
             .unwrap();
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
         return Box::into_raw(
-            Box::new((*handle).encode(input_data, add_special_tokens != 0).unwrap() as Encoding)
+            Box::new(encode(&*handle, fast.as_ref(), guard.as_ref(), input_data, add_special_tokens != 0))
         );
     }
 }
 
+// tokenizers_encode of one long input, the pre-tokens tokenized on the pool.
+#[no_mangle]
+extern "C" fn tokenizers_encode_parallel(
+    handle: *mut Tokenizer,
+    input_cstr: *const u8,
+    len: usize,
+    add_special_tokens: i32
+) -> *mut Encoding {
+    unsafe {
+        let input_data: &str = std::str
+            ::from_utf8(std::slice::from_raw_parts(input_cstr, len))
+            .unwrap();
+        let tokenizer: &Tokenizer = &*handle;
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        let encoding: Encoding = with_thread_pool(|| {
+            encode_parallel(tokenizer, fast.as_ref(), guard.as_ref(), input_data, add_special_tokens != 0).unwrap()
+        });
+        return Box::into_raw(Box::new(encoding));
+    }
+}
+
+#[no_mangle]
+extern "C" fn tokenizers_count_tokens(
+    handle: *mut Tokenizer,
+    input_cstr: *const u8,
+    len: usize,
+    add_special_tokens: i32,
+    limit: usize
+) -> usize {
+    unsafe {
+        let input_data: &str = std::str
+            ::from_utf8(std::slice::from_raw_parts(input_cstr, len))
+            .unwrap();
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        return count_tokens(&*handle, fast.as_ref(), guard.as_ref(), input_data, add_special_tokens != 0, limit);
+    }
+}
+
+#[no_mangle]
+extern "C" fn tokenizers_count_tokens_batch(
+    handle: *mut Tokenizer,
+    input_cstr: *const c_void,
+    num_seqs: usize,
+    add_special_tokens: i32,
+    limit: usize,
+    convert_array_offset: CustomConvertArrayHandleOffset,
+    output: *mut usize
+) {
+    unsafe {
+        let input_data: Vec<&str> = (0..num_seqs)
+            .map(|i: usize| {
+                let array_handle = convert_array_offset(input_cstr, i);
+                std::str
+                    ::from_utf8(
+                        std::slice::from_raw_parts(array_handle.ptr as *const u8, array_handle.len)
+                    )
+                    .unwrap()
+            })
+            .collect::<Vec<&str>>();
+        let tokenizer: &Tokenizer = &*handle;
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        let counts: Vec<usize> = with_thread_pool(|| {
+            input_data
+                .into_maybe_par_iter()
+                .map(|s| count_tokens(tokenizer, fast.as_ref(), guard.as_ref(), s, add_special_tokens != 0, limit))
+                .collect::<Vec<usize>>()
+        });
+        std::ptr::copy_nonoverlapping(counts.as_ptr(), output, num_seqs);
+    }
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_encoding_ids(encoding_handle: *mut Encoding) -> RustArrayHandle {
     unsafe {
@@ -241,14 +1201,158 @@ extern "C" fn tokenizers_encode_batch(
                     .unwrap()
             })
             .collect::<Vec<&str>>();
-        let encodings: Vec<Encoding> = (*handle)
-            .encode_batch(input_data, add_special_tokens != 0)
-            .unwrap();
+        let tokenizer: &Tokenizer = &*handle;
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        let encodings: Vec<Encoding> = with_thread_pool(|| {
+            encode_batch(tokenizer, fast.as_ref(), guard.as_ref(), input_data, add_special_tokens != 0)
+        });
 
         return export_vec(encodings);
     }
 }
 
+// A whole encoded batch in one u32 allocation: offsets (num_seqs + 1), then
+// ids, type_ids, attention_mask and special_tokens_mask, num_tokens each.
+// Item i spans [offsets[i], offsets[i + 1]) of every field.
+#[repr(C)]
+pub struct FlatEncodings {
+    num_seqs: usize,
+    num_tokens: usize,
+    offsets: *const u32,
+    ids: *const u32,
+    type_ids: *const u32,
+    attention_mask: *const u32,
+    special_tokens_mask: *const u32,
+    buffer: ExportVec<u32>,
+}
+
+fn flatten_encodings(encodings: &[Encoding]) -> FlatEncodings {
+    let num_seqs: usize = encodings.len();
+    let num_tokens: usize = encodings
+        .iter()
+        .map(|e| e.len())
+        .sum();
+    if u32::try_from(num_tokens).is_err() {
+        panic!("Flat batch of {} tokens overflows its u32 offsets.", num_tokens);
+    }
+
+    let mut buffer: Vec<u32> = Vec::with_capacity(num_seqs + 1 + 4 * num_tokens);
+    buffer.push(0);
+    let mut offset: u32 = 0;
+    encodings.iter().for_each(|e| {
+        offset += e.len() as u32;
+        buffer.push(offset);
+    });
+    encodings.iter().for_each(|e| buffer.extend_from_slice(e.get_ids()));
+    encodings.iter().for_each(|e| buffer.extend_from_slice(e.get_type_ids()));
+    encodings.iter().for_each(|e| buffer.extend_from_slice(e.get_attention_mask()));
+    encodings.iter().for_each(|e| buffer.extend_from_slice(e.get_special_tokens_mask()));
+
+    let base: *const u32 = buffer.as_ptr();
+    unsafe {
+        let ids: *const u32 = base.add(num_seqs + 1);
+        return FlatEncodings {
+            num_seqs: num_seqs,
+            num_tokens: num_tokens,
+            offsets: base,
+            ids: ids,
+            type_ids: ids.add(num_tokens),
+            attention_mask: ids.add(2 * num_tokens),
+            special_tokens_mask: ids.add(3 * num_tokens),
+            buffer: export_vec(buffer),
+        };
+    }
+}
+
+// encode_batch without per-item handles: one call returns every field.
+#[no_mangle]
+extern "C" fn tokenizers_encode_batch_flat(
+    handle: *mut Tokenizer,
+    input_cstr: *const c_void,
+    num_seqs: usize,
+    add_special_tokens: i32,
+    convert_array_offset: CustomConvertArrayHandleOffset
+) -> FlatEncodings {
+    unsafe {
+        let input_data: Vec<&str> = (0..num_seqs)
+            .map(|i: usize| {
+                let array_handle = convert_array_offset(input_cstr, i);
+                std::str
+                    ::from_utf8(
+                        std::slice::from_raw_parts(array_handle.ptr as *const u8, array_handle.len)
+                    )
+                    .unwrap()
+            })
+            .collect::<Vec<&str>>();
+        let tokenizer: &Tokenizer = &*handle;
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        let encodings: Vec<Encoding> = with_thread_pool(|| {
+            encode_batch(tokenizer, fast.as_ref(), guard.as_ref(), input_data, add_special_tokens != 0)
+        });
+        return flatten_encodings(&encodings);
+    }
+}
+
+// encode_batch_flat of the pairs (firsts[first_index[i]], seconds[i]).
+// max_length includes the special tokens of the pair template, 0 for no
+// truncation; truncation is one of the TRUNCATE_* strategies.
+#[no_mangle]
+extern "C" fn tokenizers_encode_pair_batch_flat(
+    handle: *mut Tokenizer,
+    firsts_cstr: *const c_void,
+    num_firsts: usize,
+    seconds_cstr: *const c_void,
+    num_pairs: usize,
+    first_index: *const usize,
+    add_special_tokens: i32,
+    max_length: usize,
+    truncation: i32,
+    convert_array_offset: CustomConvertArrayHandleOffset
+) -> FlatEncodings {
+    unsafe {
+        let fetch = |input: *const c_void, n: usize| {
+            (0..n)
+                .map(|i: usize| {
+                    let array_handle = convert_array_offset(input, i);
+                    std::str
+                        ::from_utf8(
+                            std::slice::from_raw_parts(array_handle.ptr as *const u8, array_handle.len)
+                        )
+                        .unwrap()
+                })
+                .collect::<Vec<&str>>()
+        };
+        let firsts: Vec<&str> = fetch(firsts_cstr, num_firsts);
+        let seconds: Vec<&str> = fetch(seconds_cstr, num_pairs);
+        let first_index: &[usize] = if num_pairs > 0 { std::slice::from_raw_parts(first_index, num_pairs) } else { &[] };
+        if first_index.iter().any(|i| *i >= num_firsts) {
+            panic!("Pair refers to a first sequence past the {} given.", num_firsts);
+        }
+        if truncation != TRUNCATE_LONGEST_FIRST && truncation != TRUNCATE_ONLY_SECOND {
+            panic!("Unknown truncation strategy {}.", truncation);
+        }
+        let tokenizer: &Tokenizer = &*handle;
+        let fast: Option<FastPreTokenizer> = fast_pre_tokenizer(handle);
+        let guard: Option<EncodeGuard> = encode_guard(handle);
+        let encodings: Vec<Encoding> = with_thread_pool(|| {
+            encode_pair_batch(
+                tokenizer,
+                fast.as_ref(),
+                guard.as_ref(),
+                firsts,
+                seconds,
+                first_index,
+                add_special_tokens != 0,
+                max_length,
+                truncation
+            )
+        });
+        return flatten_encodings(&encodings);
+    }
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_decode(
     handle: *mut Tokenizer,
@@ -263,6 +1367,183 @@ extern "C" fn tokenizers_decode(
     }
 }
 
+// A decoded text that did not fit the caller's buffer, kept for the call that
+// follows with a large enough one, so a size query and the fill decode once.
+struct PendingDecode {
+    handle: usize,
+    skip_special_tokens: bool,
+    ids: Vec<u32>,
+    text: String,
+}
+
+thread_local! {
+    static PENDING_DECODE: RefCell<Option<PendingDecode>> = RefCell::new(None);
+}
+
+// Decodes into out[0, capacity). Returns the byte length of the text, which is
+// only written when it fits, so a call with capacity 0 is a size query. The
+// text of a query is kept until the next decode of the calling thread, which
+// takes it when it asks for the same ids.
+#[no_mangle]
+extern "C" fn tokenizers_decode_into(
+    handle: *mut Tokenizer,
+    input_ids: *const u32,
+    len: usize,
+    skip_special_tokens: i32,
+    out: *mut u8,
+    capacity: usize
+) -> usize {
+    unsafe {
+        let input_data: &[u32] = std::slice::from_raw_parts(input_ids, len);
+        let skip: bool = skip_special_tokens != 0;
+        let pending: Option<PendingDecode> = PENDING_DECODE.with(|p| p.borrow_mut().take());
+        let text: String = match pending {
+            Some(p) if p.handle == (handle as usize) && p.skip_special_tokens == skip && p.ids == input_data => p.text,
+            _ => (*handle).decode(input_data, skip).unwrap(),
+        };
+        let text_len: usize = text.len();
+        if text_len > capacity {
+            PENDING_DECODE.with(|p| {
+                *p.borrow_mut() = Some(PendingDecode {
+                    handle: handle as usize,
+                    skip_special_tokens: skip,
+                    ids: input_data.to_vec(),
+                    text: text,
+                });
+            });
+        } else if text_len > 0 {
+            std::ptr::copy_nonoverlapping(text.as_ptr(), out, text_len);
+        }
+        return text_len;
+    }
+}
+
+// Decodes into the buffer allocator(len, allocator_args) returns for the byte
+// length of the text, e.g. a caller's string resized to it. Returns that length.
+#[no_mangle]
+extern "C" fn tokenizers_decode_into_alloc(
+    handle: *mut Tokenizer,
+    input_ids: *const u32,
+    len: usize,
+    skip_special_tokens: i32,
+    allocator: CustomAllocator,
+    allocator_args: CustomAllocatorArgs
+) -> usize {
+    unsafe {
+        let input_data: &[u32] = std::slice::from_raw_parts(input_ids, len);
+        let text: String = (*handle).decode(input_data, skip_special_tokens != 0).unwrap();
+        let out: *mut u8 = resize_cvec(text.len(), allocator, allocator_args).cast();
+        if !text.is_empty() {
+            std::ptr::copy_nonoverlapping(text.as_ptr(), out, text.len());
+        }
+        return text.len();
+    }
+}
+
+// Decodes a batch, writes the num_seqs + 1 item offsets, item i spanning
+// [offsets[i], offsets[i + 1]), and returns the texts for the caller to place.
+unsafe fn decode_batch_offsets(
+    handle: *mut Tokenizer,
+    input_ids: *const c_void,
+    num_seqs: usize,
+    skip_special_tokens: i32,
+    convert_array_offset: CustomConvertArrayHandleOffset,
+    offsets: *mut usize
+) -> Vec<String> {
+    let input_data: Vec<&[u32]> = (0..num_seqs)
+        .map(|i: usize| {
+            let array_handle = convert_array_offset(input_ids, i);
+            std::slice::from_raw_parts(array_handle.ptr as *const u32, array_handle.len)
+        })
+        .collect::<Vec<&[u32]>>();
+
+    let tokenizer: &Tokenizer = &*handle;
+    let decoded: Vec<String> = with_thread_pool(|| {
+        tokenizer.decode_batch(&input_data, skip_special_tokens != 0).unwrap()
+    });
+
+    let offsets: &mut [usize] = std::slice::from_raw_parts_mut(offsets, num_seqs + 1);
+    offsets[0] = 0;
+    decoded
+        .iter()
+        .enumerate()
+        .for_each(|(i, s)| {
+            offsets[i + 1] = offsets[i] + s.len();
+        });
+    return decoded;
+}
+
+unsafe fn copy_decoded(decoded: &[String], out: *mut u8) {
+    let mut offset: usize = 0;
+    for s in decoded {
+        std::ptr::copy_nonoverlapping(s.as_ptr(), out.add(offset), s.len());
+        offset += s.len();
+    }
+}
+
+// Decodes a batch into out[0, capacity), item i at [offsets[i], offsets[i + 1]).
+// The num_seqs + 1 offsets are always written, the texts only when all of them
+// fit, so capacity 0 is a size query. Returns the total byte length.
+#[no_mangle]
+extern "C" fn tokenizers_decode_batch_into(
+    handle: *mut Tokenizer,
+    input_ids: *const c_void,
+    num_seqs: usize,
+    skip_special_tokens: i32,
+    convert_array_offset: CustomConvertArrayHandleOffset,
+    out: *mut u8,
+    capacity: usize,
+    offsets: *mut usize
+) -> usize {
+    unsafe {
+        let decoded: Vec<String> = decode_batch_offsets(
+            handle,
+            input_ids,
+            num_seqs,
+            skip_special_tokens,
+            convert_array_offset,
+            offsets
+        );
+        let total: usize = *offsets.add(num_seqs);
+        if total > 0 && total <= capacity {
+            copy_decoded(&decoded, out);
+        }
+        return total;
+    }
+}
+
+// Decodes a batch into one buffer from allocator(total, allocator_args), item i
+// at [offsets[i], offsets[i + 1]) of the num_seqs + 1 offsets. Returns the total
+// byte length.
+#[no_mangle]
+extern "C" fn tokenizers_decode_batch_into_alloc(
+    handle: *mut Tokenizer,
+    input_ids: *const c_void,
+    num_seqs: usize,
+    skip_special_tokens: i32,
+    convert_array_offset: CustomConvertArrayHandleOffset,
+    allocator: CustomAllocator,
+    allocator_args: CustomAllocatorArgs,
+    offsets: *mut usize
+) -> usize {
+    unsafe {
+        let decoded: Vec<String> = decode_batch_offsets(
+            handle,
+            input_ids,
+            num_seqs,
+            skip_special_tokens,
+            convert_array_offset,
+            offsets
+        );
+        let total: usize = *offsets.add(num_seqs);
+        let out: *mut u8 = resize_cvec(total, allocator, allocator_args).cast();
+        if total > 0 {
+            copy_decoded(&decoded, out);
+        }
+        return total;
+    }
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_decode_batch(
     handle: *mut Tokenizer,
@@ -279,10 +1560,12 @@ extern "C" fn tokenizers_decode_batch(
             })
             .collect::<Vec<&[u32]>>();
 
+        let tokenizer: &Tokenizer = &*handle;
+        let decoded: Vec<String> = with_thread_pool(|| {
+            tokenizer.decode_batch(&input_data, skip_special_tokens != 0).unwrap()
+        });
         return export_vec(
-            (*handle)
-                .decode_batch(&input_data, skip_special_tokens != 0)
-                .unwrap()
+            decoded
                 .into_iter()
                 .map(|s| { export_string(s) })
                 .collect::<Vec<ExportVec<u8>>>()
@@ -305,6 +1588,147 @@ extern "C" fn tokenizers_id_to_token(handle: *mut Tokenizer, id: u32) -> ExportV
     }
 }
 
+#[no_mangle]
+extern "C" fn tokenizers_vocab_tokens(
+    handle: *mut Tokenizer,
+    allocator: CustomAllocator,
+    allocator_args: CustomAllocatorArgs,
+    emplace_back: CustomEmplaceBackArray
+) {
+    unsafe {
+        let vocab: HashMap<String, u32> = (*handle).get_vocab(true);
+        let tokens: Vec<&str> = vocab_by_id(&vocab);
+        resize_cvec(tokens.len(), allocator, allocator_args);
+        tokens.iter().for_each(|token| {
+            emplace_back(allocator_args, token.as_ptr().cast(), token.len());
+        });
+    }
+}
+
+#[no_mangle]
+extern "C" fn tokenizers_vocab_token_bytes(
+    handle: *mut Tokenizer,
+    allocator: CustomAllocator,
+    allocator_args: CustomAllocatorArgs,
+    emplace_back: CustomEmplaceBackArray
+) {
+    unsafe {
+        let tokenizer: &Tokenizer = &*handle;
+        let mut types: Vec<String> = Vec::new();
+        if let Some(decoder) = tokenizer.get_decoder() {
+            collect_types(&serde_json::to_value(decoder).unwrap(), &mut types);
+        }
+        let has = |name: &str| types.iter().any(|t| t == name);
+        let alphabet: Option<HashMap<char, u8>> = if has("ByteLevel") {
+            Some(byte_level_alphabet())
+        } else {
+            None
+        };
+        let byte_fallback: bool = has("ByteFallback");
+        let metaspace: bool = has("Metaspace") || has("Replace");
+        let wordpiece: bool = has("WordPiece");
+
+        let special: HashSet<u32> = tokenizer
+            .get_added_tokens_decoder()
+            .iter()
+            .filter(|(_, token)| token.special)
+            .map(|(id, _)| *id)
+            .collect();
+
+        let vocab: HashMap<String, u32> = tokenizer.get_vocab(true);
+        let tokens: Vec<&str> = vocab_by_id(&vocab);
+        resize_cvec(tokens.len(), allocator, allocator_args);
+        tokens
+            .iter()
+            .enumerate()
+            .for_each(|(id, token)| {
+                let bytes: Vec<u8> = if special.contains(&(id as u32)) {
+                    Vec::new()
+                } else {
+                    token_bytes(token, alphabet.as_ref(), byte_fallback, metaspace, wordpiece)
+                };
+                emplace_back(allocator_args, bytes.as_ptr().cast(), bytes.len());
+            });
+    }
+}
+
+// Marks existing tokens as special, so that the added vocabulary splits them
+// off the input and decoding can skip them. Returns the number of new tokens.
+#[no_mangle]
+extern "C" fn tokenizers_add_special_tokens(
+    handle: *mut Tokenizer,
+    input_cstr: *const c_void,
+    num_tokens: usize,
+    convert_array_offset: CustomConvertArrayHandleOffset
+) -> usize {
+    unsafe {
+        let tokens: Vec<AddedToken> = (0..num_tokens)
+            .map(|i: usize| {
+                let array_handle = convert_array_offset(input_cstr, i);
+                let token = std::str
+                    ::from_utf8(std::slice::from_raw_parts(array_handle.ptr as *const u8, array_handle.len))
+                    .unwrap();
+                AddedToken::from(token.to_string(), true)
+            })
+            .collect::<Vec<AddedToken>>();
+        return (*handle).add_special_tokens(&tokens);
+    }
+}
+
+#[repr(C)]
+pub struct MemoryUsage {
+    vocab: usize,
+    merges: usize,
+    added_tokens: usize,
+}
+
+// Heap bytes of a hash map holding len entries: buckets grow in powers of two
+// up to a 7/8 load, with one control byte each.
+#[inline]
+fn hash_map_bytes(len: usize, entry_size: usize) -> usize {
+    if len == 0 {
+        return 0;
+    }
+    return ((len * 8) / 7 + 1).next_power_of_two() * (entry_size + 1);
+}
+
+// Estimated from entry counts, the model internals are not public.
+fn memory_usage(tokenizer: &Tokenizer) -> MemoryUsage {
+    // models keep the vocabulary in both directions, each side owning its strings
+    let vocab: HashMap<String, u32> = tokenizer.get_model().get_vocab();
+    let vocab_strings: usize = vocab.keys().map(|token| token.len()).sum();
+    let vocab_bytes: usize =
+        2 * (vocab_strings + hash_map_bytes(vocab.len(), mem::size_of::<(String, u32)>()));
+
+    // the merges, stored as pair -> (rank, id), are private to the model. Each one
+    // makes a token of two, so the tokens past the single-character alphabet
+    // estimate their number without serializing the model
+    let num_merges: usize = match tokenizer.get_model() {
+        ModelWrapper::BPE(_) => vocab.keys().filter(|token| token.chars().nth(1).is_some()).count(),
+        _ => 0,
+    };
+    let merges_bytes: usize = hash_map_bytes(num_merges, mem::size_of::<((u32, u32), (u32, u32))>());
+
+    // the added vocabulary maps tokens both ways and keeps them in its split automata
+    let added = tokenizer.get_added_tokens_decoder();
+    let added_strings: usize = added.values().map(|token| token.content.len()).sum();
+    let added_bytes: usize =
+        3 * added_strings + 2 * hash_map_bytes(added.len(), mem::size_of::<(String, u32)>());
+
+    return MemoryUsage {
+        vocab: vocab_bytes,
+        merges: merges_bytes,
+        added_tokens: added_bytes,
+    };
+}
+
+#[no_mangle]
+extern "C" fn tokenizers_memory_usage(handle: *mut Tokenizer) -> MemoryUsage {
+    unsafe {
+        return memory_usage(&*handle);
+    }
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_token_to_id(handle: *mut Tokenizer, ctoken: *const u8, len: usize) -> u32 {
     unsafe {
@@ -313,9 +1737,104 @@ extern "C" fn tokenizers_token_to_id(handle: *mut Tokenizer, ctoken: *const u8,
     }
 }
 
+// Replaces the pool the batch calls run on. Returns 0 on success, -1 when the
+// pool could not be built, in which case the previous one stays in use.
+#[no_mangle]
+extern "C" fn tokenizers_configure_thread_pool(config: *const ThreadPoolConfig) -> i32 {
+    unsafe {
+        let config: &ThreadPoolConfig = &*config;
+        // held throughout, so that concurrent calls save and restore in turn
+        let mut before = parallelism_before_pool().write().unwrap();
+        if config.num_threads == 0 {
+            *thread_pool().write().unwrap() = None;
+            if let Some(parallelism) = before.take() {
+                set_parallelism(parallelism);
+            }
+            return 0;
+        }
+        return match build_thread_pool(config) {
+            Ok(pool) => {
+                before.get_or_insert_with(get_parallelism);
+                set_parallelism(config.num_threads > 1);
+                *thread_pool().write().unwrap() = Some(Arc::new(pool));
+                0
+            }
+            Err(_) => -1,
+        };
+    }
+}
+
+// Calls body(ctx, i) for i in [0, n) on the configured pool, so that batch
+// loops of the C++ backends share the workers of the Rust ones.
+#[no_mangle]
+extern "C" fn tokenizers_parallel_for(n: usize, body: ParallelForBody, ctx: *mut c_void) {
+    let ctx: SendPtr = SendPtr(ctx);
+    with_thread_pool(|| {
+        (0..n).into_maybe_par_iter().for_each(|i| unsafe { body(ctx.get(), i) });
+    });
+}
+
+// Turns the scanner pre-tokenizer on or off for this handle. Returns 1 when
+// it is in use afterwards, 0 when the handle's own pre-tokenizer is.
+#[no_mangle]
+extern "C" fn tokenizers_use_fast_pre_tokenizer(handle: *mut Tokenizer, enable: i32) -> i32 {
+    unsafe {
+        let fast: Option<FastPreTokenizer> = if enable != 0 {
+            FastPreTokenizer::detect(&*handle)
+        } else {
+            None
+        };
+        let mut fast_pre_tokenizers = fast_pre_tokenizers().write().unwrap();
+        return match fast {
+            Some(fast) => {
+                fast_pre_tokenizers.insert(handle as usize, fast);
+                1
+            }
+            None => {
+                fast_pre_tokenizers.remove(&(handle as usize));
+                0
+            }
+        };
+    }
+}
+
+// Sets the guard of this handle's encode and count calls, NULL or an all-zero
+// guard to remove it.
+#[no_mangle]
+extern "C" fn tokenizers_set_encode_guard(handle: *mut Tokenizer, guard: *const EncodeGuard) {
+    unsafe {
+        let mut encode_guards = encode_guards().write().unwrap();
+        match guard.as_ref() {
+            Some(guard) if guard.max_piece_bytes > 0 || guard.work_budget > 0 || guard.time_budget_us > 0 => {
+                encode_guards.insert(handle as usize, *guard);
+            }
+            _ => {
+                encode_guards.remove(&(handle as usize));
+            }
+        }
+    }
+}
+
+#[no_mangle]
+extern "C" fn tokenizers_encode_guard_stats() -> EncodeGuardStats {
+    return EncodeGuardStats {
+        pieces_split: PIECES_SPLIT.load(Ordering::Relaxed),
+        budget_exceeded: BUDGETS_EXCEEDED.load(Ordering::Relaxed),
+    };
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_free(handle: *mut Tokenizer) {
     unsafe {
+        fast_pre_tokenizers().write().unwrap().remove(&(handle as usize));
+        encode_guards().write().unwrap().remove(&(handle as usize));
+        // a later handle at this address must not take a text decoded by this one
+        PENDING_DECODE.with(|p| {
+            let mut p = p.borrow_mut();
+            if p.as_ref().map_or(false, |d| d.handle == (handle as usize)) {
+                *p = None;
+            }
+        });
         mem::drop(Box::from_raw(handle));
     }
 }
@@ -339,6 +1858,18 @@ extern "C" fn tokenizers_encodings_free(handle: *mut ExportVec<Encoding>) {
     }
 }
 
+#[no_mangle]
+extern "C" fn tokenizers_flat_encodings_free(handle: *mut FlatEncodings) {
+    unsafe {
+        let buffer = Vec::from_raw_parts(
+            (*handle).buffer.ptr as *mut u32,
+            (*handle).buffer.len,
+            (*handle).buffer.capacity
+        );
+        mem::drop(buffer);
+    }
+}
+
 #[no_mangle]
 extern "C" fn tokenizers_exported_string_free(handle: *mut ExportVec<u8>) {
     unsafe {
@@ -390,3 +1921,90 @@ extern "C" fn tokenizers_exported_strings_free_without_string_free(handle: *mut
         mem::drop(exported_strings);
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tokenizers::pre_tokenizers::split::{ Split, SplitPattern };
+    use tokenizers::utils::truncation::{ truncate_encodings, TruncationParams, TruncationStrategy };
+
+    fn pieces(pretokenized: &PreTokenizedString) -> Vec<(String, Offsets)> {
+        return pretokenized
+            .get_splits(OffsetReferential::Original, OffsetType::Byte)
+            .into_iter()
+            .map(|(piece, offsets, _)| (piece.to_owned(), offsets))
+            .collect();
+    }
+
+    // ASCII text dense in contractions, digit runs and whitespace before
+    // newlines, where the regex alternatives are easiest to get wrong
+    fn random_ascii(state: &mut u64, len: usize) -> String {
+        const ALPHABET: &[u8] = b"aZk09 '\t\n\r\x0b\x0c!.,-sStTmMdDlLrRvVeE";
+        return (0..len)
+            .map(|_| {
+                *state ^= *state << 13;
+                *state ^= *state >> 7;
+                *state ^= *state << 17;
+                ALPHABET[(*state % (ALPHABET.len() as u64)) as usize] as char
+            })
+            .collect();
+    }
+
+    #[test]
+    fn split_scanners_match_regexes() {
+        let mut state: u64 = 0x9e3779b97f4a7c15;
+        for regex in [GPT2_SPLIT_REGEX, LLAMA3_SPLIT_REGEX, QWEN2_SPLIT_REGEX] {
+            let scanner: SplitScanner = SplitScanner::from_regex(regex).unwrap();
+            let split = Split::new(SplitPattern::Regex(regex.to_owned()), SplitDelimiterBehavior::Isolated, false).unwrap();
+            for round in 0..20000 {
+                let text: String = random_ascii(&mut state, round % 40);
+                let mut fast = PreTokenizedString::from(text.as_str());
+                fast.split(|_, normalized| normalized.split(scanner, SplitDelimiterBehavior::Isolated)).unwrap();
+                let mut slow = PreTokenizedString::from(text.as_str());
+                split.pre_tokenize(&mut slow).unwrap();
+                assert_eq!(pieces(&fast), pieces(&slow), "{:?} split by {}", text, regex);
+            }
+        }
+    }
+
+    #[test]
+    fn split_scanners_reject_non_ascii() {
+        assert!(SplitScanner::Gpt2.find_matches("caf\u{e9}").is_err());
+        assert!(SplitScanner::Gpt2.find_matches("").is_ok());
+    }
+
+    fn encoding_of_len(n: usize) -> Encoding {
+        let tokens: Vec<Token> = (0..n).map(|i| Token::new(i as u32, String::new(), (i, i + 1))).collect();
+        return Encoding::from_tokens(tokens, 0);
+    }
+
+    #[test]
+    fn pair_lengths_match_truncate_encodings() {
+        let strategies = [
+            (TRUNCATE_LONGEST_FIRST, TruncationStrategy::LongestFirst),
+            (TRUNCATE_ONLY_SECOND, TruncationStrategy::OnlySecond),
+        ];
+        for (strategy, crate_strategy) in strategies {
+            for max_length in 1..24 {
+                for n1 in 0..24 {
+                    for n2 in 0..24 {
+                        let params = TruncationParams { max_length, strategy: crate_strategy, ..Default::default() };
+                        let expected: (usize, usize) = match truncate_encodings(encoding_of_len(n1), Some(encoding_of_len(n2)), &params) {
+                            Ok((first, second)) => (first.len(), second.map_or(0, |e| e.len())),
+                            // only_second with a first that fills max_length alone
+                            Err(_) => (n1, 0),
+                        };
+                        assert_eq!(
+                            pair_lengths(n1, n2, max_length, strategy),
+                            expected,
+                            "n1 {} n2 {} max_length {}",
+                            n1,
+                            n2,
+                            max_length
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+// Compares encode throughput with the scanner pre-tokenizer against the onig
+// regex path, and checks that both produce the same ids.
+//
+//   bench_pre_tokenizer <tokenizer.json> [corpus.txt] [rounds]
+#include <tokenizers_c.h>
+#include <tokenizers_rust.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using tokenizers::rust_impl::Tokenizer;
+
+static std::string ReadFile(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    std::exit(1);
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+static std::vector<std::string> Lines(const std::string& text) {
+  std::vector<std::string> lines;
+  std::istringstream stream(text);
+  for (std::string line; std::getline(stream, line);) {
+    if (!line.empty()) lines.push_back(line);
+  }
+  return lines;
+}
+
+static std::vector<std::string> SyntheticCorpus() {
+  const char* kLines[] = {
+      "The quick brown fox jumps over the lazy dog, isn't it? It's 2025 and we'll see.",
+      "    def encode(self, text: str) -> list[int]:\n        return self._tok.encode(text)\n",
+      "Prices rose 12.5% to $1,234,567.89 in Q3; analysts expected 987654321 units.",
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{\"ids\": [1, 2, 3]}",
+      "I'M SURE THEY'VE GONE -- she'd said so... twice!!   Then   silence.\n\n\n",
+  };
+  std::vector<std::string> corpus;
+  for (int i = 0; i < 4000; ++i) corpus.emplace_back(kLines[i % 5]);
+  return corpus;
+}
+
+static double EncodeSeconds(Tokenizer& tok, const std::vector<std::string>& corpus, int rounds,
+                            std::vector<std::vector<uint32_t>>& ids) {
+  ids.assign(corpus.size(), {});
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < corpus.size(); ++i) {
+      auto encoding = tok.encode(corpus[i], false);
+      if (r == 0) ids[i].assign(encoding.ids.begin(), encoding.ids.end());
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <tokenizer.json> [corpus.txt] [rounds]\n", argv[0]);
+    return 2;
+  }
+  Tokenizer tok = Tokenizer::from_json(ReadFile(argv[1]));
+  std::vector<std::string> corpus = argc > 2 ? Lines(ReadFile(argv[2])) : SyntheticCorpus();
+  int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+  size_t bytes = 0;
+  for (auto& line : corpus) bytes += line.size();
+
+  if (!tok.use_fast_pre_tokenizer(true)) {
+    std::printf("no scanner for this pre-tokenizer, only the onig path is available\n");
+    return 0;
+  }
+  std::vector<std::vector<uint32_t>> fast_ids, onig_ids;
+  double fast = EncodeSeconds(tok, corpus, rounds, fast_ids);
+  tok.use_fast_pre_tokenizer(false);
+  double onig = EncodeSeconds(tok, corpus, rounds, onig_ids);
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < corpus.size(); ++i) mismatches += fast_ids[i] != onig_ids[i];
+
+  double mb = static_cast<double>(bytes) * rounds / (1 << 20);
+  std::printf("lines=%zu bytes=%zu rounds=%d\n", corpus.size(), bytes, rounds);
+  std::printf("onig:    %8.3f s  %8.2f MB/s\n", onig, mb / onig);
+  std::printf("scanner: %8.3f s  %8.2f MB/s  (%.2fx)\n", fast, mb / fast, onig / fast);
+  std::printf("mismatched lines: %zu\n", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -6,6 +6,9 @@
 #include <tokenizers_rust.h>
 #include <tokenizers_cpp.h>
 
+#include "tokenizers_backends.h"
+#include "tokenizers_payload.h"
+
 namespace tokenizers
 {
 
@@ -16,11 +19,20 @@ namespace tokenizers
 	{
 	public:
 		using api = rust_impl::Tokenizer;
-		inline explicit RustTokenizer(std::shared_ptr<rust_impl::SharedTokenizerHandle> handle) : rust_impl::Tokenizer(handle)
+		inline explicit RustTokenizer(std::shared_ptr<rust_impl::SharedTokenizerHandle> handle,
+			std::shared_ptr<VocabTable> vocab = nullptr) : rust_impl::Tokenizer(handle)
 		{
 #ifdef COMPILE_WASM_RUNTIME
 			setenv("TOKENIZERS_PARALLELISM", "false", true);
 #endif
+			if (vocab)
+			{
+				vocab_table_ = std::move(vocab);
+				return;
+			}
+			// one FFI call for the whole vocabulary instead of one per IdToToken
+			auto tokens = api::vocab_tokens();
+			vocab_table_ = std::make_shared<VocabTable>(std::vector<std::string_view>(tokens.begin(), tokens.end()));
 		}
 
 		inline ~RustTokenizer()
@@ -34,11 +46,11 @@ namespace tokenizers
 			return RustTokenizer(handle);
 		}
 
-		static RustTokenizer from_json(std::string_view json)
+		static RustTokenizer from_json(std::string_view json, std::shared_ptr<VocabTable> vocab = nullptr)
 		{
 			std::shared_ptr<rust_impl::SharedTokenizerHandle> handle = std::make_shared<rust_impl::SharedTokenizerHandle>();
 			handle->operator void*& () = tokenizers_new_from_str(json.data(), json.size());
-			return RustTokenizer(handle);
+			return RustTokenizer(handle, std::move(vocab));
 		}
 
 		static RustTokenizer from_byte_level_bpe(std::string_view vocab, std::string_view merges, std::string_view added_tokens)
@@ -85,106 +97,185 @@ namespace tokenizers
 		// use i32 to be consistent with sentencepiece
 		Encoding Encode(std::string_view text, bool add_special_tokens) final
 		{
-			auto encoding = api::encode(text, add_special_tokens);
-			std::vector<std::string_view> tokens = convert_string_list(encoding.tokens);
+			return Wrap(api::encode(text, add_special_tokens));
+		}
 
-			auto& pool = rust::HandlePool::instance();
-			std::shared_ptr<AutoPayload> payload = std::make_shared<AutoPayload>();
-			payload->payloads.push_back(pool.register_handle(encoding.get_handle()));
+		// the model runs on the pre-tokens in parallel, which it never merges across
+		Encoding EncodeParallel(std::string_view text, bool add_special_tokens) final
+		{
+			return Wrap(api::encode_parallel(text, add_special_tokens));
+		}
 
-			Encoding result = { {{.ids = encoding.ids,
-								 .type_ids = encoding.type_ids,
-								 .tokens = tokens,
-								 .special_tokens_mask = encoding.special_tokens_mask,
-								 .attention_mask = encoding.attention_mask},
-								{.payload = payload}} };
+		// one FFI call for the whole batch, rows view the flat buffer, which has
+		// no token strings; those take one Rust encoding per row
+		EncodingBatch EncodeRows(const std::vector<std::string_view>& texts, bool add_special_tokens) final
+		{
+			if (batch_tokens_)
+				return TokenRows(api::encode(texts, add_special_tokens));
+			return Rows(api::encode_flat(texts, add_special_tokens));
+		}
 
-			return result;
+		// the pair template and truncation are applied on the Rust side
+		EncodingBatch EncodePairRows(const std::vector<std::string_view>& firsts,
+			const std::vector<size_t>& first_index, const std::vector<std::string_view>& seconds,
+			bool add_special_tokens, size_t max_length, TruncationStrategy truncation) final
+		{
+			return Rows(api::encode_pair_flat(firsts, first_index, seconds, add_special_tokens,
+				max_length, static_cast<int32_t>(truncation)));
 		}
 
-		EncodingBatch EncodeBatch(const std::vector<std::string_view>& texts, bool add_special_tokens) final
+		size_t CountTokens(std::string_view text, bool add_special_tokens, size_t limit) final
 		{
-			auto encodings = api::encode(texts, add_special_tokens);
+			return api::count_tokens(text, add_special_tokens, limit);
+		}
 
-			auto& pool = rust::HandlePool::instance();
-			std::shared_ptr<AutoPayload> payload = std::make_shared<AutoPayload>();
+		std::vector<size_t> CountTokensBatch(const std::vector<std::string_view>& texts, bool add_special_tokens, size_t limit) final
+		{
+			return api::count_tokens(texts, add_special_tokens, limit);
+		}
 
-			EncodingBatch result = { {}, {.payload = payload} };
+		// use i32 to be consistent with sentencepiece
+		Decoding Decode(array_view<uint32_t> ids, bool skip_special_tokens) final
+		{
+			std::shared_ptr<std::string> text = make_payload<std::string>();
+			api::decode_into(ids, *text, skip_special_tokens);
 
-			result.encodings.reserve(encodings.size());
+			Decoding result;
+			result.payload = *text;
+			result.handle = text;
+			return result;
+		}
 
-			for (size_t i = 0; i < encodings.size(); i++)
+		// use i32 to be consistent with sentencepiece
+		DecodingBatch DecodeBatch(const std::vector<array_view<uint32_t>>& ids_batch, bool skip_special_tokens) final
+		{
+			std::shared_ptr<std::string> text = make_payload<std::string>();
+			std::vector<size_t> offsets;
+			api::decode_into(ids_batch, *text, offsets, skip_special_tokens);
+
+			// all texts view the one shared buffer
+			DecodingBatch result(ids_batch.size());
+			for (size_t i = 0; i < result.size(); i++)
 			{
-				payload->payloads.push_back(pool.register_handle(encodings[i].get_handle()));
+				result[i].payload = std::string_view(*text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+				result[i].handle = text;
+			}
 
-				std::vector<std::string_view> tokens = convert_string_list(encodings[i].tokens);
+			return result;
+		}
 
-				result.encodings.emplace_back(BaseEncode{ .ids = encodings[i].ids, .type_ids = encodings[i].type_ids, .tokens = tokens, .special_tokens_mask = encodings[i].special_tokens_mask, .attention_mask = encodings[i].attention_mask });
-			}
+		size_t DecodeInto(array_view<uint32_t> ids, std::string& out, bool skip_special_tokens) final
+		{
+			return api::decode_into(ids, out, skip_special_tokens);
+		}
 
-			result.update();
+		size_t DecodeBatchInto(const std::vector<array_view<uint32_t>>& ids_batch,
+			std::string& out, std::vector<size_t>& offsets, bool skip_special_tokens) final
+		{
+			return api::decode_into(ids_batch, out, offsets, skip_special_tokens);
+		}
 
-			return result;
+		size_t GetVocabSize() final
+		{
+			return api::get_vocab_size();
 		}
 
-		inline Decoding convert(rust::String&& s)
+		// the added vocabulary of the Rust tokenizer splits them off, tokens that
+		// tokenizer.json already marks as special stay special. The Rust
+		// tokenizer is shared by the encoding threads and not locked, hence the
+		// "not while encoding" of the contract
+		void SetAddedTokens(const std::vector<std::string_view>& tokens) final
 		{
-			auto& pool = rust::HandlePool::instance();
-			std::shared_ptr<AutoPayload> payload = std::make_shared<AutoPayload>();
-			payload->payloads.push_back(pool.register_handle(s.get_handle()));
+			tokenizers::Tokenizer::SetAddedTokens(tokens);
+			added_tokens_ = nullptr;
+			api::add_special_tokens(tokens);
+			// the decoded vocabulary is built from the Rust special tokens
+			ResetLazyTables();
+		}
 
-			Decoding result = { .payload = s };
-			result.handle = payload;
+		// the guard is applied inside the Rust encode pipeline
+		void SetEncodeGuard(const EncodeGuard& guard) final
+		{
+			tokenizers::Tokenizer::SetEncodeGuard(guard);
+			api::set_encode_guard({ guard.max_piece_bytes, guard.work_budget,
+				static_cast<uint64_t>(std::max<int64_t>(guard.time_budget.count(), 0)) });
+		}
 
-			return result;
+		MemoryReport MemoryUsage() final
+		{
+			MemoryReport report = tokenizers::Tokenizer::MemoryUsage();
+			auto usage = api::memory_usage();
+			report.components.push_back({ "rust_vocab", usage.vocab });
+			report.components.push_back({ "rust_merges", usage.merges });
+			report.components.push_back({ "rust_added_tokens", usage.added_tokens });
+			return report;
 		}
 
-		// use i32 to be consistent with sentencepiece
-		Decoding Decode(array_view<uint32_t> ids, bool skip_special_tokens) final
+	protected:
+		std::shared_ptr<VocabTable> BuildDecodedVocab() final
 		{
-			return convert(api::decode(ids, skip_special_tokens));
+			auto tokens = api::vocab_token_bytes();
+			return std::make_shared<VocabTable>(std::vector<std::string_view>(tokens.begin(), tokens.end()));
 		}
 
-		// use i32 to be consistent with sentencepiece
-		DecodingBatch DecodeBatch(const std::vector<array_view<uint32_t>>& ids_batch, bool skip_special_tokens) final
+	private:
+		// rows viewing the flat buffer, which the payload keeps alive
+		EncodingBatch Rows(rust_impl::FlatEncodings encodings)
 		{
-			auto decoded = api::decode(ids_batch, skip_special_tokens);
-			DecodingBatch result;
-			result.reserve(decoded.size());
+			std::shared_ptr<rust_impl::FlatEncodings> flat = make_payload<rust_impl::FlatEncodings>(std::move(encodings));
 
-			for (size_t i = 0; i < decoded.size(); i++)
+			EncodingBatch result = { {}, {.payload = flat} };
+
+			result.encodings.reserve(flat->size());
+
+			for (size_t i = 0; i < flat->size(); i++)
 			{
-				result.emplace_back(convert(std::move(decoded[i])));
+				result.encodings.emplace_back(BaseEncode{ .ids = flat->ids(i), .type_ids = flat->type_ids(i), .special_tokens_mask = flat->special_tokens_mask(i), .attention_mask = flat->attention_mask(i) });
 			}
 
 			return result;
 		}
 
-		size_t GetVocabSize() final
+		// rows viewing the Rust encodings, tokens included, which the payload keeps alive
+		EncodingBatch TokenRows(std::vector<rust_impl::Encoding> encodings)
 		{
-			return api::get_vocab_size();
-		}
+			auto& pool = rust::HandlePool::instance();
+			std::shared_ptr<AutoPayload> payload = make_payload<AutoPayload>();
 
-		Decoding IdToToken(uint32_t id) final
-		{
-			auto token = api::id_to_token(id);
+			EncodingBatch result = { {}, {.payload = payload} };
 
-			auto& pool = rust::HandlePool::instance();
-			std::shared_ptr<AutoPayload> payload = std::make_shared<AutoPayload>();
-			payload->payloads.push_back(pool.register_handle(token.get_handle()));
+			result.encodings.reserve(encodings.size());
 
-			Decoding result = { .payload = token };
-			result.handle = payload;
+			for (size_t i = 0; i < encodings.size(); i++)
+			{
+				payload->payloads.push_back(pool.register_handle(encodings[i].get_handle()));
+
+				std::vector<std::string_view> tokens = convert_string_list(encodings[i].tokens);
+
+				result.encodings.emplace_back(BaseEncode{ .ids = encodings[i].ids, .type_ids = encodings[i].type_ids, .tokens = tokens, .special_tokens_mask = encodings[i].special_tokens_mask, .attention_mask = encodings[i].attention_mask });
+			}
 
 			return result;
 		}
 
-		uint32_t TokenToId(std::string_view token) final
+		// Encoding viewing the Rust encoding, which the payload keeps alive
+		Encoding Wrap(rust_impl::Encoding encoding)
 		{
-			return api::token_to_id(token);
-		}
+			std::vector<std::string_view> tokens = convert_string_list(encoding.tokens);
 
-	private:
+			auto& pool = rust::HandlePool::instance();
+			std::shared_ptr<AutoPayload> payload = make_payload<AutoPayload>();
+			payload->payloads.push_back(pool.register_handle(encoding.get_handle()));
+
+			Encoding result = { {{.ids = encoding.ids,
+								 .type_ids = encoding.type_ids,
+								 .tokens = tokens,
+								 .special_tokens_mask = encoding.special_tokens_mask,
+								 .attention_mask = encoding.attention_mask},
+								{.payload = payload}} };
+
+			return result;
+		}
 	};
 
 	std::unique_ptr<Tokenizer> Tokenizer::FromBlobJSONFile(std::string_view json_file)
@@ -197,6 +288,11 @@ namespace tokenizers
 		return std::make_unique<RustTokenizer>(RustTokenizer::from_json(json));
 	}
 
+	std::unique_ptr<Tokenizer> MakeHuggingFaceTokenizer(std::string_view json, std::shared_ptr<VocabTable> vocab)
+	{
+		return std::make_unique<RustTokenizer>(RustTokenizer::from_json(json, std::move(vocab)));
+	}
+
 	std::unique_ptr<Tokenizer> Tokenizer::FromBlobByteLevelBPE(std::string_view vocab,
 		std::string_view merges,
 		std::string_view added_tokens)
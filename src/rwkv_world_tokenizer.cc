@@ -7,6 +7,13 @@
 
 #include <tokenizers_cpp.h>
 
+#include "tokenizers_backends.h"
+#include "tokenizers_guard.h"
+#include "tokenizers_payload.h"
+
+#include <tokenizers_threads.h>
+
+#include <cstring>
 #include <fstream>
 #include <msgpack.hpp>
 
@@ -19,17 +26,21 @@ namespace tokenizers
 		std::string_view word;
 		std::optional<int> token_id;
 
-		TrieTree(const std::unordered_map<std::string_view, int>& word2id)
+		TrieTree(const VocabTable& vocab)
 		{
-			for (auto& pair : word2id)
+			for (uint32_t id = 0; id < vocab.Size(); ++id)
 			{
-				add_word(pair.first, pair.second);
+				auto word = vocab.IdToToken(id);
+				if (!word.empty() && vocab.TokenToId(word) == id)
+				{
+					add_word(word, id);
+				}
 			}
 		}
 
-		std::pair<std::string, int> find_longest_prefix(std::string_view str) const
+		std::pair<std::string_view, int> find_longest_prefix(std::string_view str) const
 		{
-			std::string prefix;
+			std::string_view prefix;
 			int token_id = -1;
 			const TrieTree* node = this;
 			for (int i = 0; i < str.size(); ++i)
@@ -52,6 +63,32 @@ namespace tokenizers
 			return { prefix, token_id };
 		}
 
+		/*! \brief Whether a token starts with all of str and goes on past it. */
+		bool extends_past(std::string_view str) const
+		{
+			const TrieTree* node = this;
+			for (char c : str)
+			{
+				auto it = node->children.find(c);
+				if (it == node->children.end())
+					return false;
+				node = it->second.get();
+			}
+			return !node->children.empty();
+		}
+
+		/*! \brief Heap bytes of the subtree, estimated for the hash map nodes. */
+		size_t memory_usage() const
+		{
+			using Entry = std::pair<const int, std::unique_ptr<TrieTree>>;
+			// each map node holds the entry, a next pointer and the cached hash
+			size_t bytes = children.bucket_count() * sizeof(void*) +
+				children.size() * (sizeof(Entry) + 2 * sizeof(void*));
+			for (auto& [c, child] : children)
+				bytes += sizeof(TrieTree) + child->memory_usage();
+			return bytes;
+		}
+
 	private:
 		TrieTree() = default;
 		void add_word(std::string_view word, int token_id) { return _add_word(word, token_id, 0); }
@@ -75,7 +112,21 @@ namespace tokenizers
 	class RWKVWorldTokenizer : public Tokenizer
 	{
 	public:
-		explicit RWKVWorldTokenizer(std::string_view path)
+		explicit RWKVWorldTokenizer(std::string_view path) : RWKVWorldTokenizer(LoadVocab(path))
+		{
+		}
+
+		explicit RWKVWorldTokenizer(std::shared_ptr<VocabTable> vocab)
+		{
+			vocab_table_ = std::move(vocab);
+			_tree = std::make_unique<TrieTree>(*vocab_table_);
+			// ids of the id -> word map, words repeated under several ids included
+			for (uint32_t id = 0; id < vocab_table_->Size(); ++id)
+				num_ids_ += vocab_table_->TokenLength(id) != 0;
+		}
+
+		/*! \brief The vocabulary of a msgpack id -> bytes map file. */
+		static std::shared_ptr<VocabTable> LoadVocab(std::string_view path)
 		{
 			std::ifstream infile;
 			infile.open(path.data(), std::ios::binary | std::ios::in);
@@ -89,88 +140,273 @@ namespace tokenizers
 			auto unpacker = msgpack::unpack(data, length);
 			auto obj = unpacker.get();
 			delete[] data;
-			_idx2word = obj.as<std::unordered_map<int, std::string>>();
-			for (auto& pair : _idx2word)
+
+			// id -> bytes map, the words are held by the unpacker's zone
+			auto& map = obj.via.map;
+			std::vector<std::string_view> words;
+			for (uint32_t i = 0; i < map.size; ++i)
 			{
-				_word2idx[pair.second] = pair.first;
+				auto id = map.ptr[i].key.as<uint32_t>();
+				auto& word = map.ptr[i].val;
+				if (id >= words.size())
+					words.resize(id + 1);
+				if (word.type == msgpack::type::BIN)
+					words[id] = std::string_view(word.via.bin.ptr, word.via.bin.size);
+				else
+					words[id] = std::string_view(word.via.str.ptr, word.via.str.size);
 			}
-			_tree = std::make_unique<TrieTree>(_word2idx);
+			return std::make_shared<VocabTable>(words);
 		}
 
 		Encoding Encode(std::string_view str, bool add_special_tokens) final
 		{
-			std::shared_ptr<std::vector<uint32_t>> ids;
-			size_t str_idx = 0;
-
-			while (str_idx < str.size())
-			{
-				auto [prefix, token_id] = _tree->find_longest_prefix(str.substr(str_idx));
-				ids->push_back(token_id);
-				str_idx += prefix.size();
-			}
+			std::shared_ptr<std::vector<uint32_t>> ids = make_payload<std::vector<uint32_t>>();
+			EncodeBudget budget(encode_guard_);
+			ForEachSegment(str, [&](std::string_view text, uint32_t id) {
+				if (id != AddedTokenSplitter::kText)
+				{
+					ids->push_back(id);
+					return;
+				}
+				EncodeText(text, budget, [&](uint32_t token_id) {
+					ids->push_back(token_id);
+					return true;
+				});
+			});
 
 			Encoding result = { {{.ids = array_view<uint32_t>(ids->data(), ids->size())}, {.payload = ids}} };
 
 			return result;
 		}
 
+		size_t CountTokens(std::string_view str, bool add_special_tokens, size_t limit) final
+		{
+			size_t count = 0;
+			EncodeBudget budget(encode_guard_);
+			ForEachSegment(str, [&](std::string_view text, uint32_t id) {
+				if (id != AddedTokenSplitter::kText)
+				{
+					++count;
+					return;
+				}
+				EncodeText(text, budget, [&](uint32_t) { return ++count <= limit; });
+			});
+
+			return count;
+		}
+
 		Decoding Decode(array_view<uint32_t> ids, bool skip_special_tokens) final
 		{
-			std::string str;
-			for (auto id : ids)
+			std::shared_ptr<std::string> text = make_payload<std::string>();
+			DecodeInto(ids, *text, skip_special_tokens);
+
+			Decoding result;
+			result.payload = *text;
+			result.handle = text;
+			return result;
+		}
+
+		size_t DecodeInto(array_view<uint32_t> ids, std::string& out, bool skip_special_tokens) final
+		{
+			out.resize(DecodedLength(ids, skip_special_tokens));
+			CopyDecoded(ids, skip_special_tokens, out.data());
+			return out.size();
+		}
+
+		DecodingBatch DecodeBatch(const std::vector<array_view<uint32_t>>& ids_batch, bool skip_special_tokens) final
+		{
+			std::shared_ptr<std::string> text = make_payload<std::string>();
+			std::vector<size_t> offsets;
+			DecodeBatchInto(ids_batch, *text, offsets, skip_special_tokens);
+
+			// all texts view the one shared buffer
+			DecodingBatch result(ids_batch.size());
+			for (size_t i = 0; i < result.size(); i++)
 			{
-				str += IdToToken(id).payload;
+				result[i].payload = std::string_view(*text).substr(offsets[i], offsets[i + 1] - offsets[i]);
+				result[i].handle = text;
 			}
-			Decoding result = { {.buff = std::move(str)} };
-			result.payload = result.buff.value();
 			return result;
 		}
 
+		// rows are measured and copied on the worker pool, into one allocation
+		size_t DecodeBatchInto(const std::vector<array_view<uint32_t>>& ids_batch,
+			std::string& out, std::vector<size_t>& offsets, bool skip_special_tokens) final
+		{
+			size_t n = ids_batch.size();
+			offsets.assign(n + 1, 0);
+			ThreadPool::ParallelFor(n, [&](size_t i) {
+				offsets[i + 1] = DecodedLength(ids_batch[i], skip_special_tokens);
+			});
+			for (size_t i = 0; i < n; ++i)
+				offsets[i + 1] += offsets[i];
+
+			out.resize(offsets[n]);
+			ThreadPool::ParallelFor(n, [&](size_t i) {
+				CopyDecoded(ids_batch[i], skip_special_tokens, out.data() + offsets[i]);
+			});
+			return out.size();
+		}
+
+		void SetAddedTokens(const std::vector<std::string_view>& tokens) final
+		{
+			Tokenizer::SetAddedTokens(tokens);
+			skip_lengths_.clear();
+			if (!added_tokens_)
+				return;
+			skip_lengths_.resize(vocab_table_->Size());
+			for (uint32_t id = 0; id < skip_lengths_.size(); ++id)
+				skip_lengths_[id] = added_tokens_->IsAdded(id) ? 0 : vocab_table_->TokenLength(id);
+		}
+
 		size_t GetVocabSize() final
 		{
-			auto size = _idx2word.size();
+			auto size = num_ids_;
 			RV_CHECK(size > 0);
 			return size;
 		}
 
-		std::string_view GetToken(uint32_t token_id)
+		MemoryReport MemoryUsage() final
+		{
+			MemoryReport report = Tokenizer::MemoryUsage();
+			report.components.push_back({ "trie", sizeof(TrieTree) + _tree->memory_usage() });
+			return report;
+		}
+
+	private:
+		// lengths to decode with, NULL for the plain token lengths
+		const uint32_t* SkipLengths(bool skip_special_tokens) const
+		{
+			return skip_special_tokens && !skip_lengths_.empty() ? skip_lengths_.data() : nullptr;
+		}
+
+		size_t DecodedLength(array_view<uint32_t> ids, bool skip_special_tokens) const
 		{
-			auto it = _idx2word.find(token_id);
-			if (it == _idx2word.end())
+			const uint32_t* offsets = vocab_table_->Offsets();
+			const uint32_t* lengths = SkipLengths(skip_special_tokens);
+			const size_t size = vocab_table_->Size();
+			size_t total = 0;
+			for (uint32_t id : ids)
 			{
-				return "<unk>";
+				RV_CHECK(id < size) << "token id " << id << " is out of the vocabulary";
+				total += lengths ? lengths[id] : offsets[id + 1] - offsets[id];
 			}
-			else
+			return total;
+		}
+
+		// dst holds DecodedLength(ids) bytes, which checked the ids, returns the
+		// end of the copied text
+		char* CopyDecoded(array_view<uint32_t> ids, bool skip_special_tokens, char* dst) const
+		{
+			const char* data = vocab_table_->Data();
+			const uint32_t* offsets = vocab_table_->Offsets();
+			const uint32_t* lengths = SkipLengths(skip_special_tokens);
+			for (uint32_t id : ids)
 			{
-				return it->second;
+				uint32_t len = lengths ? lengths[id] : offsets[id + 1] - offsets[id];
+				std::memcpy(dst, data + offsets[id], len);
+				dst += len;
 			}
+			return dst;
+		}
+
+		// fn(id) per token of a text segment, until fn returns false. Tokens do
+		// not span the guard's piece cuts, and past the budget only single
+		// bytes are matched, so the work stays linear in the input.
+		template <class _Fn>
+		void EncodeText(std::string_view text, EncodeBudget& budget, _Fn&& fn)
+		{
+			// with a budget the tokens depend on the work done before them
+			EncodeCache* cache = encode_guard_.work_budget || encode_guard_.time_budget.count() > 0
+				? nullptr : encode_cache_.get();
+			std::vector<uint32_t> ids;
+			bool more = true;
+			for_each_piece(text, encode_guard_.max_piece_bytes, [&](std::string_view piece) {
+				size_t pos = 0;
+				while (more && pos < piece.size())
+				{
+					// matching always starts at a token boundary, where the cached
+					// words are cut
+					size_t end = piece.size();
+					if (cache)
+					{
+						end = WordEnd(piece, pos);
+						std::string_view word = piece.substr(pos, end - pos);
+						ids.clear();
+						if (word.size() <= EncodeCache::kMaxPieceBytes && !cache->Lookup(word, ids))
+							EncodeWord(word, *cache, ids);
+						if (!ids.empty())
+						{
+							for (size_t i = 0; more && i < ids.size(); ++i)
+								more = fn(ids[i]);
+							pos = end;
+							continue;
+						}
+					}
+					// tokens that may reach into the next word are matched in place
+					do
+					{
+						auto [prefix, token_id] = _tree->find_longest_prefix(
+							budget.Exceeded() ? piece.substr(pos, 1) : piece.substr(pos));
+						more = fn(static_cast<uint32_t>(token_id));
+						pos += prefix.size();
+						budget.Spend(prefix.size());
+					} while (more && pos < end);
+				}
+			});
 		}
 
-		Decoding IdToToken(uint32_t token_id) final
+		// end of the word at pos, its leading whitespace and the rest up to the
+		// next whitespace
+		static size_t WordEnd(std::string_view piece, size_t pos)
 		{
-			RV_CHECK(_idx2word.size() > 0);
-			return { .payload = GetToken(token_id) };
+			auto is_space = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
+			while (pos < piece.size() && is_space(piece[pos]))
+				++pos;
+			while (pos < piece.size() && !is_space(piece[pos]))
+				++pos;
+			return pos;
 		}
 
-		uint32_t TokenToId(std::string_view token) final
+		// ids of word matched on its own, cached when the text that follows it
+		// cannot change them: no token starting at one of them goes on past the
+		// word. Others are cached without ids, to be matched in place.
+		void EncodeWord(std::string_view word, EncodeCache& cache, std::vector<uint32_t>& ids)
 		{
-			RV_CHECK(_word2idx.size() > 0);
-			auto it = _word2idx.find(token);
-			if (it == _word2idx.end())
+			for (size_t pos = 0; pos < word.size();)
 			{
-				return -1;
+				if (_tree->extends_past(word.substr(pos)))
+				{
+					ids.clear();
+					break;
+				}
+				auto [prefix, token_id] = _tree->find_longest_prefix(word.substr(pos));
+				ids.push_back(static_cast<uint32_t>(token_id));
+				pos += prefix.size();
 			}
-			else
+			cache.Insert(word, ids.data(), ids.size());
+		}
+
+		// fn(text, id) per segment, the whole string as text unless added tokens are set
+		template <class _Fn>
+		void ForEachSegment(std::string_view str, _Fn&& fn)
+		{
+			if (!added_tokens_)
 			{
-				return it->second;
+				fn(str, AddedTokenSplitter::kText);
+				return;
 			}
+			added_tokens_->Split(str, [&](const AddedTokenSplitter::Segment& segment) { fn(segment.text, segment.id); });
 		}
 
-	private:
-		// the tokenizer
-		std::unordered_map<std::string_view, int> _word2idx;
-		std::unordered_map<int, std::string> _idx2word;
+		// the tokenizer, words are views into vocab_table_
 		std::unique_ptr<TrieTree> _tree;
+
+		// token lengths with added tokens zeroed, empty when there are none
+		std::vector<uint32_t> skip_lengths_;
+
+		// number of ids with a word, the vocabulary size
+		size_t num_ids_ = 0;
 	};
 
 	std::unique_ptr<Tokenizer> Tokenizer::FromBlobRWKVWorld(std::string_view model_blob)
@@ -178,4 +414,9 @@ namespace tokenizers
 		return std::make_unique<RWKVWorldTokenizer>(model_blob);
 	}
 
+	std::unique_ptr<Tokenizer> MakeRWKVWorldTokenizer(std::shared_ptr<VocabTable> vocab)
+	{
+		return std::make_unique<RWKVWorldTokenizer>(std::move(vocab));
+	}
+
 } // namespace tokenizers
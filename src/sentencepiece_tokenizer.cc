@@ -6,6 +6,10 @@
 #include <sentencepiece_processor.h>
 #include <tokenizers_cpp.h>
 
+#include "tokenizers_backends.h"
+#include "tokenizers_payload.h"
+
+#include <algorithm>
 #include <cassert>
 
 namespace tokenizers
@@ -13,25 +17,120 @@ namespace tokenizers
 
 #ifdef MLC_ENABLE_SENTENCEPIECE_TOKENIZER
 
+	namespace
+	{
+		// varint at data[pos], advancing pos, false if it runs past the end
+		inline bool ReadVarint(std::string_view data, size_t& pos, uint64_t& value)
+		{
+			value = 0;
+			for (int shift = 0; shift < 64 && pos < data.size(); shift += 7)
+			{
+				uint8_t byte = static_cast<uint8_t>(data[pos++]);
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					return true;
+			}
+			return false;
+		}
+
+		// fn(field, value, bytes) per field of a serialized protobuf message, with
+		// the value of varint fields and the payload of length-delimited ones.
+		// Returns false on malformed input.
+		template <class _Fn>
+		bool ForEachProtoField(std::string_view message, _Fn&& fn)
+		{
+			size_t pos = 0;
+			while (pos < message.size())
+			{
+				uint64_t key, value = 0;
+				std::string_view bytes;
+				if (!ReadVarint(message, pos, key))
+					return false;
+				switch (key & 7)
+				{
+				case 0:
+					if (!ReadVarint(message, pos, value))
+						return false;
+					break;
+				case 1:
+					if (message.size() - pos < 8)
+						return false;
+					pos += 8;
+					break;
+				case 2:
+					if (!ReadVarint(message, pos, value) || value > message.size() - pos)
+						return false;
+					bytes = message.substr(pos, value);
+					pos += value;
+					break;
+				case 5:
+					if (message.size() - pos < 4)
+						return false;
+					pos += 4;
+					break;
+				default:
+					return false;
+				}
+				fn(static_cast<uint32_t>(key >> 3), value, bytes);
+			}
+			return true;
+		}
+	} // namespace
+
 	class SentencePieceTokenizer : public Tokenizer
 	{
 	public:
-		explicit SentencePieceTokenizer(std::string_view model_blob)
+		explicit SentencePieceTokenizer(std::string_view model_blob, std::shared_ptr<VocabTable> vocab = nullptr)
 		{
 			sentence_piece_.LoadFromSerializedProto({ model_blob.data(), model_blob.size() });
+
+			std::vector<std::string_view> pieces(sentence_piece_.GetPieceSize());
+			for (int id = 0; id < sentence_piece_.GetPieceSize(); ++id)
+			{
+				pieces[id] = sentence_piece_.IdToPiece(id);
+			}
+			vocab_table_ = vocab ? std::move(vocab) : std::make_shared<VocabTable>(pieces);
+			words_encode_alone_ = WordsEncodeAlone(model_blob);
 		}
 
 		Encoding Encode(std::string_view text, bool add_special_tokens) final
 		{
-			std::shared_ptr<std::vector<int32_t>> tokens = std::make_shared<std::vector<int32_t>>();
-			sentence_piece_.Encode({ text.data(), text.size() }, tokens.get()).IgnoreError();
+			std::shared_ptr<std::vector<int32_t>> tokens = make_payload<std::vector<int32_t>>();
+			EncodeInto(text, *tokens);
 			return { {{.ids = array_view<uint32_t>{reinterpret_cast<uint32_t*>(tokens->data()), tokens->size()}}, {.payload = tokens}} };
 		}
 
+		size_t CountTokens(std::string_view text, bool add_special_tokens, size_t limit) final
+		{
+			// sentencepiece has no incremental API, so limit is not used: the pieces
+			// are counted in full, but never handed out
+			std::vector<int32_t> tokens;
+			EncodeInto(text, tokens);
+			return tokens.size();
+		}
+
 		Decoding Decode(array_view<uint32_t> ids, bool skip_special_tokens) final
 		{
 			std::string text;
-			sentence_piece_.Decode(array_view<int32_t>(reinterpret_cast<const int32_t*>(ids.data()), ids.size()), &text).IgnoreError();
+			if (!added_tokens_ || std::none_of(ids.begin(), ids.end(), [&](uint32_t id) { return added_tokens_->IsAdded(id); }))
+			{
+				DecodeAppend(ids, text);
+			}
+			else
+			{
+				// one decode of the whole sequence, so that a piece after an added
+				// token keeps its leading space, with the surface of each added
+				// token, empty for control pieces, replaced by its text
+				auto decoded = sentence_piece_.DecodeIdsAsImmutableProto(std::vector<int>(ids.begin(), ids.end()));
+				for (int i = 0; i < decoded.pieces_size(); ++i)
+				{
+					auto piece = decoded.pieces(i);
+					if (!added_tokens_->IsAdded(piece.id()))
+						text.append(piece.surface());
+					else if (!skip_special_tokens)
+						text.append(added_tokens_->Token(piece.id()));
+				}
+			}
 
 			Decoding result = { {.buff = std::move(text)} };
 			result.payload = result.buff.value();
@@ -41,13 +140,7 @@ namespace tokenizers
 
 		Decoding Decode(const std::vector<uint32_t>& ids, bool skip_special_tokens) final
 		{
-			std::string text;
-			sentence_piece_.Decode(array_view<int32_t>(reinterpret_cast<const int32_t*>(ids.data()), ids.size()), &text).IgnoreError();
-
-			Decoding result = { {.buff = std::move(text)} };
-			result.payload = result.buff.value();
-
-			return result;
+			return Decode(array_view<uint32_t>(ids.data(), ids.size()), skip_special_tokens);
 		}
 
 		size_t GetVocabSize() final
@@ -57,25 +150,198 @@ namespace tokenizers
 			return size;
 		}
 
-		Decoding IdToToken(uint32_t id) final { return { .payload = sentence_piece_.IdToPiece(id) }; }
-
+		// unknown pieces map to the id of the unknown piece, as with PieceToId
 		uint32_t TokenToId(std::string_view token) final { return sentence_piece_.PieceToId({ token.data(), token.size() }); }
 
+		MemoryReport MemoryUsage() final
+		{
+			// the model proto is not exposed by the installed headers: count each
+			// piece's bytes, its proto message and its entry in the piece lookup
+			constexpr size_t kPieceOverhead = sizeof(std::string) + 4 * sizeof(void*) +
+				sizeof(std::pair<std::string_view, int>) + 2 * sizeof(void*);
+
+			MemoryReport report = Tokenizer::MemoryUsage();
+			size_t bytes = 0;
+			for (int id = 0; id < sentence_piece_.GetPieceSize(); ++id)
+				bytes += sentence_piece_.IdToPiece(id).size() + kPieceOverhead;
+			report.components.push_back({ "sentencepiece_model", bytes });
+			return report;
+		}
+
+	protected:
+		std::shared_ptr<VocabTable> BuildDecodedVocab() final
+		{
+			static const std::string_view kSpace = "\xe2\x96\x81";
+
+			std::vector<std::string> bytes(sentence_piece_.GetPieceSize());
+			for (int id = 0; id < sentence_piece_.GetPieceSize(); ++id)
+			{
+				if (sentence_piece_.IsControl(id) || sentence_piece_.IsUnknown(id) || sentence_piece_.IsUnused(id))
+					continue;
+
+				std::string_view piece = sentence_piece_.IdToPiece(id);
+				if (sentence_piece_.IsByte(id))
+				{
+					// byte pieces are spelled <0xXX>
+					bytes[id].push_back(static_cast<char>(std::stoi(std::string(piece.substr(3, 2)), nullptr, 16)));
+					continue;
+				}
+				for (size_t pos = piece.find(kSpace); pos != std::string_view::npos; pos = piece.find(kSpace))
+				{
+					bytes[id].append(piece.substr(0, pos)).push_back(' ');
+					piece.remove_prefix(pos + kSpace.size());
+				}
+				bytes[id].append(piece);
+			}
+			return std::make_shared<VocabTable>(std::vector<std::string_view>(bytes.begin(), bytes.end()));
+		}
+
 	private:
+		// sentencepiece adds no special tokens of its own, only added tokens set
+		// by SetAddedTokens are matched in the text
+		void EncodeInto(std::string_view text, std::vector<int32_t>& tokens)
+		{
+			EncodeCache* cache = words_encode_alone_ ? encode_cache_.get() : nullptr;
+			if (!added_tokens_ && !cache)
+			{
+				sentence_piece_.Encode({ text.data(), text.size() }, &tokens).IgnoreError();
+				return;
+			}
+
+			std::vector<int32_t> pieces;
+			auto encode_text = [&](std::string_view segment) {
+				if (!cache)
+				{
+					sentence_piece_.Encode({ segment.data(), segment.size() }, &pieces).IgnoreError();
+					tokens.insert(tokens.end(), pieces.begin(), pieces.end());
+					return;
+				}
+				ForEachWord(segment, [&](std::string_view word) {
+					if (word.size() <= EncodeCache::kMaxPieceBytes && cache->Lookup(word, tokens))
+						return;
+					sentence_piece_.Encode({ word.data(), word.size() }, &pieces).IgnoreError();
+					tokens.insert(tokens.end(), pieces.begin(), pieces.end());
+					cache->Insert(word, pieces.data(), pieces.size());
+				});
+			};
+
+			if (!added_tokens_)
+			{
+				encode_text(text);
+				return;
+			}
+			added_tokens_->Split(text, [&](const AddedTokenSplitter::Segment& segment) {
+				if (segment.id != AddedTokenSplitter::kText)
+				{
+					tokens.push_back(static_cast<int32_t>(segment.id));
+					return;
+				}
+				encode_text(segment.text);
+			});
+		}
+
+		// fn(word) per run of text between spaces
+		template <class _Fn>
+		static void ForEachWord(std::string_view text, _Fn&& fn)
+		{
+			size_t pos = 0;
+			while (pos < text.size())
+			{
+				size_t begin = text.find_first_not_of(' ', pos);
+				if (begin == std::string_view::npos)
+					return;
+				pos = std::min(text.find(' ', begin), text.size());
+				fn(text.substr(begin, pos - begin));
+			}
+		}
+
+		// Words can be cached when the model encodes them the same on their own
+		// as in running text, which holds when it adds a dummy prefix, collapses
+		// and escapes whitespace, and no piece spans whitespace. The specs are
+		// read from the serialized model proto, whose class is not exposed by
+		// the installed headers.
+		bool WordsEncodeAlone(std::string_view model_blob)
+		{
+			// defaults of the proto fields
+			bool add_dummy_prefix = true, remove_extra_whitespaces = true, escape_whitespaces = true;
+			bool split_by_whitespace = true, treat_whitespace_as_suffix = false, allow_whitespace_only_pieces = false;
+
+			bool specs_ok = true;
+			bool model_ok = ForEachProtoField(model_blob, [&](uint32_t field, uint64_t, std::string_view spec) {
+				if (field == 2) // trainer_spec
+				{
+					specs_ok &= ForEachProtoField(spec, [&](uint32_t field, uint64_t value, std::string_view) {
+						if (field == 22)
+							split_by_whitespace = value != 0;
+						else if (field == 24)
+							treat_whitespace_as_suffix = value != 0;
+						else if (field == 26)
+							allow_whitespace_only_pieces = value != 0;
+					});
+				}
+				else if (field == 3) // normalizer_spec
+				{
+					specs_ok &= ForEachProtoField(spec, [&](uint32_t field, uint64_t value, std::string_view) {
+						if (field == 3)
+							add_dummy_prefix = value != 0;
+						else if (field == 4)
+							remove_extra_whitespaces = value != 0;
+						else if (field == 5)
+							escape_whitespaces = value != 0;
+					});
+				}
+			});
+			if (!model_ok || !specs_ok || !add_dummy_prefix || !remove_extra_whitespaces || !escape_whitespaces ||
+				!split_by_whitespace || treat_whitespace_as_suffix || allow_whitespace_only_pieces)
+				return false;
+
+			// user defined pieces are not trained, and may hold whitespace past their start
+			static constexpr std::string_view kSpace = "\xe2\x96\x81";
+			for (int id = 0; id < sentence_piece_.GetPieceSize(); ++id)
+			{
+				if (std::string_view(sentence_piece_.IdToPiece(id)).find(kSpace, 1) != std::string_view::npos)
+					return false;
+			}
+			return true;
+		}
+
+		void DecodeAppend(array_view<uint32_t> ids, std::string& text)
+		{
+			if (ids.empty())
+				return;
+			std::string piece;
+			sentence_piece_.Decode(array_view<int32_t>(reinterpret_cast<const int32_t*>(ids.data()), ids.size()), &piece).IgnoreError();
+			text.append(piece);
+		}
+
 		// the tokenizer
 		sentencepiece::SentencePieceProcessor sentence_piece_;
+
+		// whether words may be encoded one at a time, see WordsEncodeAlone
+		bool words_encode_alone_ = false;
 	};
 
 	std::unique_ptr<Tokenizer> Tokenizer::FromBlobSentencePiece(std::string_view model_blob)
 	{
 		return std::make_unique<SentencePieceTokenizer>(model_blob);
 	}
+
+	std::unique_ptr<Tokenizer> MakeSentencePieceTokenizer(std::string_view model_blob, std::shared_ptr<VocabTable> vocab)
+	{
+		return std::make_unique<SentencePieceTokenizer>(model_blob, std::move(vocab));
+	}
 #else
 	std::unique_ptr<Tokenizer> Tokenizer::FromBlobSentencePiece(const std::string& model_blob)
 	{
 		assert(false);
 		throw;
 	}
+
+	std::unique_ptr<Tokenizer> MakeSentencePieceTokenizer(std::string_view model_blob, std::shared_ptr<VocabTable> vocab)
+	{
+		assert(false);
+		throw;
+	}
 #endif // MLC_ENABLE_SENTENCEPIECE_TOKENIZER
 
 } // namespace tokenizers
@@ -0,0 +1,774 @@
+// Behavior tests of the C++ side of the tokenizers: vocabulary tables,
+// added-token matching, batch encoding and the dataset format.
+#include <tokenizers_cache.h>
+#include <tokenizers_cpp.h>
+#include <tokenizers_dataset.h>
+#include <tokenizers_match.h>
+#include <tokenizers_vocab.h>
+
+#include "tokenizers_backends.h"
+#include "tokenizers_guard.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using tokenizers::Tokenizer;
+using tokenizers::VocabTable;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,     \
+                   __LINE__, #cond);                                  \
+      std::exit(1);                                                   \
+    }                                                                 \
+  } while (0)
+
+template <class _Fn>
+static bool Throws(_Fn&& fn) {
+  try {
+    fn();
+  } catch (const std::exception&) {
+    return true;
+  }
+  return false;
+}
+
+// Every 1- and 2-byte string, which includes tokens whose zero-padded tails
+// are equal, e.g. "\x03" and "\x00\x00" hashed to the same value before the
+// length was folded into the tail word and failed the build.
+static void TestVocabTableShortTokens() {
+  std::vector<std::string> storage;
+  for (int a = 0; a < 256; ++a) storage.emplace_back(1, static_cast<char>(a));
+  for (int a = 0; a < 256; ++a) {
+    for (int b = 0; b < 256; ++b) {
+      storage.push_back({static_cast<char>(a), static_cast<char>(b)});
+    }
+  }
+  std::vector<std::string_view> tokens(storage.begin(), storage.end());
+
+  VocabTable table(tokens);
+  CHECK(table.Size() == tokens.size());
+  CHECK(table.NumTokens() == tokens.size());
+  for (uint32_t id = 0; id < tokens.size(); ++id) {
+    CHECK(table.IdToToken(id) == tokens[id]);
+    CHECK(table.TokenToId(tokens[id]) == id);
+  }
+  CHECK(table.TokenToId(std::string_view("\x03", 1)) == 3);
+  CHECK(table.TokenToId(std::string_view("\x00\x00", 2)) == 256);
+  CHECK(table.TokenToId("abc") == VocabTable::kNotFound);
+  CHECK(table.TokenToId("") == VocabTable::kNotFound);
+}
+
+static void TestVocabTableUnusedAndDuplicateIds() {
+  std::vector<std::string_view> tokens = {"a", "", "bc", "a", "defghijkl", ""};
+  VocabTable table(tokens);
+  CHECK(table.Size() == 6);
+  CHECK(table.NumTokens() == 3);
+  CHECK(table.TokenToId("a") == 0);
+  CHECK(table.TokenToId("bc") == 2);
+  CHECK(table.TokenToId("defghijkl") == 4);
+  CHECK(table.TokenToId("defghijk") == VocabTable::kNotFound);
+  CHECK(table.IdToToken(1).empty());
+  CHECK(table.IdToToken(6).empty());
+  CHECK(table.TokenLength(4) == 9);
+
+  // a table over the arrays of another one answers the same
+  auto image = VocabTable::FromImage(table.GetImage());
+  for (uint32_t id = 0; id < tokens.size(); ++id) {
+    CHECK(image->IdToToken(id) == tokens[id]);
+  }
+  CHECK(image->TokenToId("a") == 0);
+  CHECK(image->TokenToId("defghijkl") == 4);
+}
+
+// Random DFA over bytes, a missing transition rejects; the states fed so
+// far are kept on a stack for Rollback.
+class RandomDFA : public tokenizers::ByteAcceptor {
+ public:
+  RandomDFA(std::mt19937& rng, int num_states, uint32_t start) : next_(num_states * 256), states_{start} {
+    for (int& state : next_) state = rng() % 10 < 3 ? -1 : static_cast<int>(rng() % num_states);
+  }
+
+  bool Advance(uint8_t byte) override {
+    int state = next_[states_.back() * 256 + byte];
+    if (state < 0) return false;
+    states_.push_back(state);
+    return true;
+  }
+
+  void Rollback(size_t num_bytes) override { states_.resize(states_.size() - num_bytes); }
+
+  bool Accepts(std::string_view bytes) const {
+    int state = static_cast<int>(states_.back());
+    for (unsigned char c : bytes) {
+      state = next_[state * 256 + c];
+      if (state < 0) return false;
+    }
+    return true;
+  }
+
+  size_t Depth() const { return states_.size(); }
+
+ private:
+  std::vector<int> next_;
+  std::vector<uint32_t> states_;
+};
+
+// FillMask skips the tokens sharing a rejected prefix, which must set the
+// same bits as feeding every token on its own.
+static void TestTokenBytesIndexFillMask() {
+  std::mt19937 rng(6);
+  for (int round = 0; round < 40; ++round) {
+    std::vector<std::string> storage;
+    size_t num_tokens = 1 + rng() % 4000;
+    for (size_t i = 0; i < num_tokens; ++i) {
+      // short tokens over few bytes share prefixes, some long ones share a lot
+      std::string token(rng() % 8 == 0 ? rng() % 40 : rng() % 6, ' ');
+      for (char& c : token) c = "abcd\xff"[rng() % (rng() % 4 == 0 ? 5 : 2)];
+      storage.push_back(token);
+    }
+    std::vector<std::string_view> tokens(storage.begin(), storage.end());
+    tokenizers::TokenBytesIndex index(std::make_shared<VocabTable>(tokens));
+
+    std::vector<uint32_t> mask(index.MaskWords()), generic(index.MaskWords());
+    for (int start = 0; start < 4; ++start) {
+      int num_states = 1 + rng() % 6;
+      RandomDFA dfa(rng, num_states, start % num_states);
+      index.FillMask(static_cast<tokenizers::ByteAcceptor&>(dfa), mask.data());
+      CHECK(dfa.Depth() == 1);
+      index.FillMask(dfa, generic.data());
+      CHECK(dfa.Depth() == 1);
+      CHECK(mask == generic);
+      for (uint32_t id = 0; id < tokens.size(); ++id) {
+        bool expected = !tokens[id].empty() && dfa.Accepts(tokens[id]);
+        CHECK(((mask[id / 32] >> (id % 32)) & 1) == expected);
+      }
+    }
+  }
+}
+
+// RWKV world tokenizer over every single byte followed by words
+static std::unique_ptr<Tokenizer> MakeRWKV(const std::vector<std::string>& words) {
+  std::vector<std::string> storage;
+  for (int c = 0; c < 256; ++c) storage.emplace_back(1, static_cast<char>(c));
+  storage.insert(storage.end(), words.begin(), words.end());
+  std::vector<std::string_view> tokens(storage.begin(), storage.end());
+  return tokenizers::MakeRWKVWorldTokenizer(std::make_shared<VocabTable>(tokens));
+}
+
+static void TestRWKVDecodeRejectsUnknownIds() {
+  auto tokenizer = MakeRWKV({"hello", " world"});
+  std::vector<uint32_t> ids = {256, 257, '!'};
+  CHECK(tokenizer->Decode(ids).payload == "hello world!");
+
+  bool thrown = false;
+  try {
+    tokenizer->Decode(std::vector<uint32_t>{256, 258});
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  thrown = false;
+  try {
+    std::vector<std::vector<uint32_t>> batch = {{256}, {1u << 31}};
+    tokenizer->DecodeBatch(batch);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+// random text over a small alphabet, so that words repeat and tokens overlap
+static std::string RandomText(std::mt19937& rng, size_t max_len) {
+  static const char kAlphabet[] = "ab c\nd";
+  std::string text(rng() % max_len, ' ');
+  for (char& c : text) c = kAlphabet[rng() % (sizeof(kAlphabet) - 1)];
+  return text;
+}
+
+static std::vector<uint32_t> Ids(const tokenizers::BaseEncode& encoding) {
+  return std::vector<uint32_t>(encoding.ids->begin(), encoding.ids->end());
+}
+
+// Greedy matching with the encode cache must give the ids it gives without,
+// including for words that a token starting inside them reaches past.
+static void TestRWKVEncodeCacheMatchesGreedy() {
+  std::mt19937 rng(1);
+  std::vector<std::string> words;
+  for (int i = 0; i < 400; ++i) {
+    std::string word = RandomText(rng, 6);
+    if (word.size() >= 2) words.push_back(word);
+  }
+  auto plain = MakeRWKV(words);
+  auto cached = MakeRWKV(words);
+  cached->SetEncodeCache(50);
+
+  for (int i = 0; i < 3000; ++i) {
+    std::string text = RandomText(rng, 80);
+    auto expected = Ids(plain->Encode(text));
+    CHECK(Ids(cached->Encode(text)) == expected);
+    CHECK(cached->CountTokens(text) == expected.size());
+  }
+  CHECK(cached->GetEncodeCache()->GetStats().hits > 0);
+}
+
+// distinct random patterns over a few bytes, so that they overlap and nest
+static std::vector<std::string> RandomPatterns(std::mt19937& rng, size_t count,
+                                               std::string_view alphabet = "ab<>") {
+  std::vector<std::string> patterns;
+  while (patterns.size() < count) {
+    std::string pattern(1 + rng() % 4, ' ');
+    for (char& c : pattern) c = alphabet[rng() % alphabet.size()];
+    if (std::find(patterns.begin(), patterns.end(), pattern) == patterns.end()) {
+      patterns.push_back(pattern);
+    }
+  }
+  return patterns;
+}
+
+static bool EndsWith(std::string_view text, size_t end, std::string_view pattern) {
+  return pattern.size() <= end && text.substr(end - pattern.size(), pattern.size()) == pattern;
+}
+
+// A stop string is reported at the first byte that completes one, the
+// longest one ending there, with the tokens that hold it.
+static void TestStopSequenceMatcher() {
+  std::mt19937 rng(2);
+  for (int round = 0; round < 300; ++round) {
+    auto patterns = RandomPatterns(rng, 1 + rng() % 6);
+    std::vector<std::string_view> views(patterns.begin(), patterns.end());
+    tokenizers::StopSequenceMatcher matcher(views);
+    tokenizers::StopSequenceMatcher::State state;
+
+    std::string text;
+    std::vector<size_t> token_ends;
+    for (int step = 0; step < 40; ++step) {
+      std::string token(rng() % 4, ' ');
+      for (char& c : token) c = "ab<>x"[rng() % 5];
+      size_t before = text.size();
+      text += token;
+      token_ends.push_back(text.size());
+
+      int expected = -1;
+      size_t end = before + 1;
+      for (; end <= text.size() && expected < 0; ++end) {
+        for (size_t i = 0; i < patterns.size(); ++i) {
+          if (EndsWith(text, end, patterns[i]) &&
+              (expected < 0 || patterns[i].size() > patterns[expected].size())) {
+            expected = static_cast<int>(i);
+          }
+        }
+      }
+      --end;
+
+      auto match = matcher.Feed(state, token);
+      CHECK(match.has_value() == (expected >= 0));
+      if (!match) {
+        continue;
+      }
+      CHECK(match->stop_index == static_cast<size_t>(expected));
+      size_t start = end - patterns[expected].size();
+      CHECK(match->rollback_bytes == text.size() - start);
+      size_t tokens = 0;
+      while (tokens < token_ends.size() && token_ends[token_ends.size() - 1 - tokens] > start) ++tokens;
+      CHECK(match->rollback_tokens == tokens);
+      break;
+    }
+  }
+}
+
+// Added tokens split leftmost-longest like HF tokenizers, both when the
+// first bytes of the tokens are few enough for the SIMD scan and when not.
+static void TestAddedTokenSplitterLeftmostLongest() {
+  std::mt19937 rng(3);
+  for (std::string_view alphabet : {"ab<>", "abcdefghijkl"}) {
+    for (int round = 0; round < 300; ++round) {
+      auto patterns = RandomPatterns(rng, 1 + rng() % 12, alphabet);
+      std::vector<std::string_view> views(patterns.begin(), patterns.end());
+      std::vector<uint32_t> ids;
+      for (size_t i = 0; i < patterns.size(); ++i) ids.push_back(static_cast<uint32_t>(1000 + i));
+      tokenizers::AddedTokenSplitter splitter(views, ids);
+
+      std::string text(rng() % 60, ' ');
+      for (char& c : text) c = rng() % 3 ? alphabet[rng() % alphabet.size()] : 'x';
+
+      std::vector<tokenizers::AddedTokenSplitter::Segment> expected;
+      size_t pos = 0, text_start = 0;
+      while (pos < text.size()) {
+        int best = -1;
+        for (size_t i = 0; i < patterns.size(); ++i) {
+          if (text.compare(pos, patterns[i].size(), patterns[i]) == 0 &&
+              (best < 0 || patterns[i].size() > patterns[best].size())) {
+            best = static_cast<int>(i);
+          }
+        }
+        if (best < 0) {
+          ++pos;
+          continue;
+        }
+        std::string_view view(text);
+        if (pos > text_start) {
+          expected.push_back({view.substr(text_start, pos - text_start), tokenizers::AddedTokenSplitter::kText});
+        }
+        expected.push_back({view.substr(pos, patterns[best].size()), ids[best]});
+        pos += patterns[best].size();
+        text_start = pos;
+      }
+      if (text_start < text.size()) {
+        expected.push_back({std::string_view(text).substr(text_start), tokenizers::AddedTokenSplitter::kText});
+      }
+
+      auto segments = splitter.Split(text);
+      CHECK(segments.size() == expected.size());
+      for (size_t i = 0; i < segments.size(); ++i) {
+        CHECK(segments[i].text == expected[i].text);
+        CHECK(segments[i].id == expected[i].id);
+      }
+    }
+  }
+}
+
+// byte-level BPE over a few letters, with an added token
+static const char kBPEJson[] = R"({
+  "version": "1.0",
+  "truncation": null,
+  "padding": null,
+  "added_tokens": [{"id": 8, "content": "<s>", "single_word": false, "lstrip": false,
+                    "rstrip": false, "normalized": false, "special": true}],
+  "normalizer": null,
+  "pre_tokenizer": {"type": "ByteLevel", "add_prefix_space": false, "trim_offsets": true, "use_regex": true},
+  "post_processor": null,
+  "decoder": {"type": "ByteLevel", "add_prefix_space": false, "trim_offsets": true, "use_regex": true},
+  "model": {
+    "type": "BPE", "dropout": null, "unk_token": null, "continuing_subword_prefix": null,
+    "end_of_word_suffix": null, "fuse_unk": false, "byte_fallback": false, "ignore_merges": false,
+    "vocab": {"a": 0, "b": 1, "\u0120": 2, "\u010a": 3, "ab": 4, "\u0120a": 5, "\u0120ab": 6, "ba": 7},
+    "merges": ["a b", "\u0120 a", "\u0120a b", "b a"]
+  }
+})";
+
+// Texts long enough to spread over several tasks of the pool encode the same
+// in parallel as sequentially, added tokens included.
+static void TestEncodeParallelMatchesEncode() {
+  auto tokenizer = Tokenizer::FromBlobJSON(kBPEJson);
+  std::mt19937 rng(4);
+  for (size_t len : {size_t(0), size_t(10), size_t(5000), size_t(40000)}) {
+    std::string text;
+    while (text.size() < len) {
+      static const char* kWords[] = {"ab", " ab", " a", "ba", " ", "\n", "<s>", "bab"};
+      text += kWords[rng() % 8];
+    }
+    auto expected = Ids(tokenizer->Encode(text));
+    CHECK(Ids(tokenizer->EncodeParallel(text)) == expected);
+    CHECK(Ids(tokenizer->EncodeParallel(text, false)) == Ids(tokenizer->Encode(text, false)));
+  }
+}
+
+static void TestEncodeCacheBounds() {
+  tokenizers::EncodeCache cache(100);
+  std::vector<uint32_t> ids = {9};
+  CHECK(!cache.Lookup("a", ids));
+  cache.Insert("a", std::vector<uint32_t>{1, 2}.data(), 2);
+  CHECK(cache.Lookup("a", ids));
+  CHECK((ids == std::vector<uint32_t>{9, 1, 2}));
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    std::string piece = "piece" + std::to_string(i);
+    cache.Insert(piece, &i, 1);
+  }
+  auto stats = cache.GetStats();
+  CHECK(stats.entries <= stats.capacity);
+  CHECK(stats.capacity == 100);
+  CHECK(stats.hits == 1 && stats.misses == 1);
+
+  cache.Clear();
+  stats = cache.GetStats();
+  CHECK(stats.entries == 0 && stats.hits == 0 && stats.misses == 0);
+}
+
+// Batches share the cache between the pool threads and encode the same.
+static void TestRWKVEncodeCacheBatch() {
+  std::mt19937 rng(5);
+  std::vector<std::string> words;
+  for (int i = 0; i < 200; ++i) words.push_back(RandomText(rng, 5));
+  auto plain = MakeRWKV(words);
+  auto cached = MakeRWKV(words);
+  cached->SetEncodeCache(20);
+
+  std::vector<std::string> storage;
+  for (int i = 0; i < 500; ++i) storage.push_back(RandomText(rng, 200));
+  std::vector<std::string_view> texts(storage.begin(), storage.end());
+  for (int round = 0; round < 2; ++round) {
+    auto expected = plain->EncodeBatch(texts);
+    auto batch = cached->EncodeBatch(texts);
+    for (size_t i = 0; i < texts.size(); ++i) {
+      CHECK(Ids(batch.encodings[i]) == Ids(expected.encodings[i]));
+    }
+  }
+  auto stats = cached->GetEncodeCache()->GetStats();
+  CHECK(stats.hits > 0 && stats.entries <= stats.capacity);
+}
+
+// text of ASCII letters, whitespace and 2 to 4-byte UTF-8 characters
+static std::string RandomUtf8(std::mt19937& rng, size_t max_chars) {
+  static const char* kChars[] = {"a", "b", " ", "\n", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9d\x84\x9e"};
+  std::string text;
+  for (size_t i = 0, n = rng() % max_chars; i < n; ++i) text += kChars[rng() % 7];
+  return text;
+}
+
+static bool IsSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+static bool IsContinuation(char c) { return (static_cast<unsigned char>(c) & 0xC0) == 0x80; }
+
+// Pieces rejoin to the text, cuts fall on character boundaries, runs without
+// whitespace stay within the cap unless they are one character, and each cut
+// run is counted once.
+static void TestForEachPiece() {
+  std::mt19937 rng(8);
+  for (int round = 0; round < 3000; ++round) {
+    std::string text = RandomUtf8(rng, 120);
+    size_t max_piece_bytes = rng() % 12;
+    uint64_t before = tokenizers::guard_pieces_split.load();
+    std::vector<std::string_view> pieces;
+    tokenizers::for_each_piece(text, max_piece_bytes, [&](std::string_view piece) { pieces.push_back(piece); });
+
+    std::string joined;
+    for (size_t k = 0; k < pieces.size(); ++k) {
+      if (k) CHECK(!pieces[k].empty() && !IsContinuation(pieces[k][0]));
+      joined += pieces[k];
+    }
+    CHECK(joined == text);
+
+    // a run is cut when it holds several characters and more bytes than the cap
+    uint64_t cut_runs = 0;
+    bool guarded = max_piece_bytes && text.size() > max_piece_bytes;
+    for (size_t i = 0; i < text.size();) {
+      if (IsSpace(text[i])) {
+        ++i;
+        continue;
+      }
+      size_t end = i, chars = 0;
+      for (; end < text.size() && !IsSpace(text[end]); ++end) chars += !IsContinuation(text[end]);
+      if (guarded && chars > 1 && end - i > max_piece_bytes) ++cut_runs;
+      i = end;
+    }
+    CHECK(tokenizers::guard_pieces_split.load() - before == cut_runs);
+
+    if (!guarded) {
+      CHECK(pieces.size() == 1);
+      continue;
+    }
+    for (auto piece : pieces) {
+      for (size_t i = 0; i < piece.size();) {
+        if (IsSpace(piece[i])) {
+          ++i;
+          continue;
+        }
+        size_t end = i, chars = 0;
+        for (; end < piece.size() && !IsSpace(piece[end]); ++end) chars += !IsContinuation(piece[end]);
+        CHECK(end - i <= max_piece_bytes || chars == 1);
+        i = end;
+      }
+    }
+  }
+}
+
+// Guarded encodes equal unguarded ones piece by piece, and exactly where no
+// guard triggers.
+static void TestRWKVEncodeGuard() {
+  std::mt19937 rng(9);
+  std::vector<std::string> words = {"aa", "aaaa", "aaaaaaaa", "ab", "ba", "\xc3\xa9\xc3\xa9", "a\xe2\x82\xac"};
+  auto plain = MakeRWKV(words);
+  auto guarded = MakeRWKV(words);
+
+  for (int round = 0; round < 2000; ++round) {
+    std::string text = RandomUtf8(rng, 80);
+    tokenizers::EncodeGuard guard;
+    guard.max_piece_bytes = rng() % 10;
+    guarded->SetEncodeGuard(guard);
+
+    std::vector<uint32_t> expected;
+    tokenizers::for_each_piece(text, guard.max_piece_bytes, [&](std::string_view piece) {
+      auto ids = Ids(plain->Encode(piece));
+      expected.insert(expected.end(), ids.begin(), ids.end());
+    });
+    auto stats = Tokenizer::GetEncodeGuardStats();
+    auto ids = Ids(guarded->Encode(text));
+    CHECK(ids == expected);
+    CHECK(guarded->CountTokens(text) == expected.size());
+    if (Tokenizer::GetEncodeGuardStats().pieces_split == stats.pieces_split) {
+      CHECK(ids == Ids(plain->Encode(text)));
+    }
+  }
+
+  // a budget smaller than the text runs out once per call and falls back to
+  // single bytes, which still decode to the text
+  std::string text(100, 'a');
+  tokenizers::EncodeGuard guard;
+  guard.work_budget = 1000;
+  guarded->SetEncodeGuard(guard);
+  uint64_t exceeded = Tokenizer::GetEncodeGuardStats().budget_exceeded;
+  CHECK(Ids(guarded->Encode(text)) == Ids(plain->Encode(text)));
+  CHECK(Tokenizer::GetEncodeGuardStats().budget_exceeded == exceeded);
+
+  guard.work_budget = 10;
+  guarded->SetEncodeGuard(guard);
+  auto ids = Ids(guarded->Encode(text));
+  CHECK(Tokenizer::GetEncodeGuardStats().budget_exceeded == exceeded + 1);
+  CHECK(ids.size() > plain->Encode(text).ids->size());
+  CHECK(guarded->Decode(ids).payload == text);
+}
+
+// Scheduled sub-batches hold every row once, scattered back through
+// permutation they equal the unscheduled batch, and they keep the budgets.
+static void TestScheduledEncodeBatch() {
+  using Order = tokenizers::BatchSchedule::Order;
+  std::mt19937 rng(7);
+  std::vector<std::string> words;
+  for (int i = 0; i < 100; ++i) words.push_back(RandomText(rng, 5));
+  auto tokenizer = MakeRWKV(words);
+
+  for (int round = 0; round < 60; ++round) {
+    std::vector<std::string> storage;
+    for (size_t i = 0, n = rng() % 200; i < n; ++i) storage.push_back(RandomText(rng, 1 + rng() % 300));
+    std::vector<std::string_view> texts(storage.begin(), storage.end());
+    auto expected = tokenizer->EncodeBatch(texts);
+
+    tokenizers::BatchSchedule schedule;
+    schedule.order = static_cast<Order>(round % 3);
+    schedule.bucket_width = 1 + rng() % 64;
+    schedule.max_tokens = rng() % 2 ? 0 : rng() % 2000;
+    schedule.max_rows = rng() % 2 ? 0 : 1 + rng() % 40;
+    auto batches = tokenizer->EncodeBatch(texts, schedule);
+
+    std::vector<bool> seen(texts.size());
+    size_t next_input = 0, last_len = 0;
+    for (auto& batch : batches) {
+      size_t rows = batch.encodings.size();
+      CHECK(rows > 0 && batch.permutation.size() == rows);
+      CHECK(!schedule.max_rows || rows <= schedule.max_rows);
+      CHECK(!schedule.max_tokens || rows == 1 || rows * batch.max_len <= schedule.max_tokens);
+      for (size_t j = 0; j < rows; ++j) {
+        size_t i = batch.permutation[j];
+        CHECK(i < texts.size() && !seen[i]);
+        seen[i] = true;
+        auto ids = Ids(batch.encodings[j]);
+        CHECK(ids == Ids(expected.encodings[i]));
+        for (size_t k = 0; k < batch.max_len; ++k) {
+          CHECK((*batch.ids)[j * batch.max_len + k] == (k < ids.size() ? ids[k] : 0u));
+        }
+        switch (schedule.order) {
+          case Order::kInput:
+            CHECK(i == next_input++);
+            break;
+          case Order::kSorted:
+            CHECK(ids.size() >= last_len);
+            last_len = ids.size();
+            break;
+          case Order::kBucketed:
+            CHECK(ids.size() / schedule.bucket_width ==
+                  batch.encodings[0].ids->size() / schedule.bucket_width);
+            break;
+        }
+      }
+    }
+    CHECK(std::count(seen.begin(), seen.end(), true) == static_cast<long>(texts.size()));
+  }
+}
+
+// Pairs are cut to the lengths HF tokenizers' truncate_encodings gives; the
+// RWKV tokenizer has no pair template and one id per byte here, so the rows
+// show the lengths directly.
+static void TestEncodePairBatchTruncation() {
+  using tokenizers::TruncationStrategy;
+  struct Case {
+    size_t n1, n2, max_length;
+    TruncationStrategy truncation;
+    size_t len1, len2;
+  };
+  const Case kCases[] = {
+      {3, 4, 0, TruncationStrategy::kLongestFirst, 3, 4},
+      {3, 4, 7, TruncationStrategy::kLongestFirst, 3, 4},
+      {10, 3, 8, TruncationStrategy::kLongestFirst, 5, 3},
+      {3, 10, 8, TruncationStrategy::kLongestFirst, 3, 5},
+      {6, 6, 8, TruncationStrategy::kLongestFirst, 4, 4},
+      {10, 10, 7, TruncationStrategy::kLongestFirst, 3, 4},
+      {0, 10, 4, TruncationStrategy::kLongestFirst, 0, 4},
+      {3, 10, 8, TruncationStrategy::kOnlySecond, 3, 5},
+      // HF fails when the first alone fills max_length, the second is dropped instead
+      {8, 2, 8, TruncationStrategy::kOnlySecond, 8, 0},
+      {10, 3, 8, TruncationStrategy::kOnlySecond, 10, 0},
+  };
+
+  auto tokenizer = MakeRWKV({});
+  for (const Case& c : kCases) {
+    std::string first(c.n1, 'a'), second(c.n2, 'b');
+    auto pair = tokenizer->EncodePair(first, second, true, c.max_length, c.truncation);
+    std::vector<uint32_t> expected(c.len1, 'a');
+    expected.insert(expected.end(), c.len2, 'b');
+    CHECK(Ids(pair) == expected);
+    std::vector<uint32_t> type_ids(pair.type_ids->begin(), pair.type_ids->end());
+    CHECK(std::count(type_ids.begin(), type_ids.end(), 1u) == static_cast<long>(c.len2));
+  }
+
+  // one first against many seconds, padded to the longest row
+  std::vector<std::string> storage = {"aaaaaa", "b", "bbbbbbbbbb", ""};
+  std::vector<std::string_view> seconds(storage.begin() + 1, storage.end());
+  auto batch = tokenizer->EncodePairBatch({storage[0]}, seconds, true, 8);
+  CHECK(batch.encodings.size() == 3);
+  CHECK(batch.max_len == 8);
+  const size_t kLengths[] = {7, 8, 6};
+  for (size_t i = 0; i < 3; ++i) {
+    CHECK(batch.encodings[i].ids->size() == kLengths[i]);
+    for (size_t j = 0; j < 8; ++j) {
+      CHECK((*batch.attention_mask)[i * 8 + j] == (j < kLengths[i] ? 1u : 0u));
+      CHECK((*batch.ids)[i * 8 + j] == (j < kLengths[i] ? (*batch.encodings[i].ids)[j] : 0u));
+    }
+  }
+  CHECK(Throws([&] { tokenizer->EncodePairBatch({"a", "b"}, seconds); }));
+}
+
+static tokenizers::array_view<uint32_t> View(const std::vector<uint32_t>& ids) {
+  return {ids.data(), ids.size()};
+}
+
+static std::string TempPath(const char* name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+#ifdef ENABLE_DLPACK
+// The mask decides the span of each row by its bytes, so only integer and
+// bool masks are taken.
+static void TestDLPackDecodeMaskDtypes() {
+  auto tokenizer = MakeRWKV({});
+  std::vector<uint32_t> ids = {0, 'h', 'i', 0, 'o', 'k'};
+  std::vector<uint8_t> mask = {0, 1, 1, 0, 1, 1};
+  int64_t shape[2] = {2, 3};
+  DLTensor ids_tensor = {ids.data(), {kDLCPU, 0}, 2, {kDLUInt, 32, 1}, shape, nullptr, 0};
+  DLTensor mask_tensor = {mask.data(), {kDLCPU, 0}, 2, {kDLBool, 8, 1}, shape, nullptr, 0};
+
+  auto texts = tokenizer->DecodeBatch(ids_tensor, mask_tensor);
+  CHECK(texts.size() == 2 && texts[0].payload == "hi" && texts[1].payload == "ok");
+  mask_tensor.dtype.code = kDLUInt;
+  CHECK(!Throws([&] { tokenizer->DecodeBatch(ids_tensor, mask_tensor); }));
+  mask_tensor.dtype.code = kDLFloat;
+  CHECK(Throws([&] { tokenizer->DecodeBatch(ids_tensor, mask_tensor); }));
+}
+#endif // ENABLE_DLPACK
+
+static void TestDatasetRoundTrip() {
+  std::vector<std::vector<uint32_t>> docs = {{1, 2, 3}, {}, {65535, 0}, {7}};
+  for (size_t vocab_size : {size_t(65536), size_t(100000)}) {
+    std::string path = TempPath("test_tokenizers_cpp_dataset.bin");
+    tokenizers::TokenizedDatasetWriter writer(path, vocab_size, true);
+    for (size_t i = 0; i < docs.size(); ++i) {
+      writer.Add(View(docs[i]), "doc" + std::to_string(i));
+    }
+    CHECK(Throws([&] { writer.Add(View({static_cast<uint32_t>(vocab_size)})); }));
+    writer.Finish();
+
+    auto dataset = tokenizers::TokenizedDataset::Open(path);
+    CHECK(dataset->IdBytes() == (vocab_size == 65536 ? 2 : 4));
+    CHECK(dataset->NumDocuments() == docs.size());
+    CHECK(dataset->NumTokens() == 6);
+    CHECK(dataset->HasMetadata());
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < docs.size(); ++i) {
+      dataset->CopyDocument(i, ids);
+      CHECK(ids == docs[i]);
+      CHECK(dataset->Metadata(i) == "doc" + std::to_string(i));
+    }
+    dataset.reset();
+    std::filesystem::remove(path);
+  }
+}
+
+static void TestDatasetRejectsBadFiles() {
+  std::string path = TempPath("test_tokenizers_cpp_bad.bin");
+  auto open = [&] { tokenizers::TokenizedDataset::Open(path); };
+
+  // a writer that never finished leaves the header blank
+  {
+    tokenizers::TokenizedDatasetWriter writer(path, 1000);
+    writer.Add(View({1, 2, 3}));
+  }
+  CHECK(Throws(open));
+
+  tokenizers::TokenizedDatasetWriter writer(path, 1000);
+  writer.Add(View({1, 2, 3}));
+  writer.Add(View({4}));
+  writer.Finish();
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  auto rewrite = [&](const std::string& contents) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size());
+  };
+
+  // truncated inside the index
+  rewrite(bytes.substr(0, bytes.size() - 4));
+  CHECK(Throws(open));
+
+  // index going backwards
+  tokenizers::DatasetHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  std::string corrupt = bytes;
+  uint64_t backwards = 5;
+  std::memcpy(&corrupt[header.index_offset + sizeof(uint64_t)], &backwards, sizeof(backwards));
+  rewrite(corrupt);
+  CHECK(Throws(open));
+
+  // more tokens claimed than the file holds
+  corrupt = bytes;
+  header.num_tokens = uint64_t(1) << 40;
+  std::memcpy(&corrupt[0], &header, sizeof(header));
+  rewrite(corrupt);
+  CHECK(Throws(open));
+
+  rewrite("not a dataset");
+  CHECK(Throws(open));
+
+  rewrite(bytes);
+  CHECK(!Throws(open));
+  std::filesystem::remove(path);
+}
+
+int main() {
+  TestVocabTableShortTokens();
+  TestVocabTableUnusedAndDuplicateIds();
+  TestTokenBytesIndexFillMask();
+  TestRWKVDecodeRejectsUnknownIds();
+  TestRWKVEncodeCacheMatchesGreedy();
+  TestEncodeCacheBounds();
+  TestRWKVEncodeCacheBatch();
+  TestStopSequenceMatcher();
+  TestAddedTokenSplitterLeftmostLongest();
+  TestEncodeParallelMatchesEncode();
+  TestForEachPiece();
+  TestRWKVEncodeGuard();
+  TestScheduledEncodeBatch();
+  TestEncodePairBatchTruncation();
+#ifdef ENABLE_DLPACK
+  TestDLPackDecodeMaskDtypes();
+#endif // ENABLE_DLPACK
+  TestDatasetRoundTrip();
+  TestDatasetRejectsBadFiles();
+  std::printf("all tests passed\n");
+  return 0;
+}
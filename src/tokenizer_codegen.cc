@@ -0,0 +1,149 @@
+// Emits a C++ source holding a tokenizer as static const tables, so that
+// Tokenizer::FromCompiled(name) finds it without reading any file.
+//
+//   tokenizer_codegen <json|sentencepiece|rwkv> <input> <name> <output.cc>
+//
+// The vocabulary tables, with their perfect hash, are used in place. HF and
+// sentencepiece models are embedded as their source and parsed on load.
+#include <tokenizers_compiled.h>
+#include <tokenizers_cpp.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+using tokenizers::Tokenizer;
+using tokenizers::VocabTable;
+
+static std::string ReadFile(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    std::exit(1);
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// arrays get at least one element, zero-sized arrays are not C++
+static void EmitBytes(FILE* out, const char* ident, std::string_view bytes) {
+  std::fprintf(out, "\tconst char %s[] = {", ident);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    std::fprintf(out, i % 16 ? " '\\x%02x'," : "\n\t\t'\\x%02x',", static_cast<unsigned char>(bytes[i]));
+  }
+  std::fprintf(out, bytes.empty() ? " 0 };\n" : "\n\t};\n");
+}
+
+static void EmitWords(FILE* out, const char* ident, const uint32_t* words, size_t n) {
+  std::fprintf(out, "\tconst uint32_t %s[] = {", ident);
+  for (size_t i = 0; i < n; ++i) {
+    std::fprintf(out, i % 12 ? " %u," : "\n\t\t%u,", words[i]);
+  }
+  std::fprintf(out, n ? "\n\t};\n" : " 0 };\n");
+}
+
+static void EmitTable(FILE* out, const char* prefix, const VocabTable::Image& image) {
+  std::string ident(prefix);
+  EmitBytes(out, (ident + "Blob").c_str(), image.blob);
+  EmitWords(out, (ident + "Offsets").c_str(), image.offsets, image.num_offsets);
+  EmitWords(out, (ident + "Seeds").c_str(), image.seeds, image.num_seeds);
+  EmitWords(out, (ident + "Slots").c_str(), image.slots, image.num_slots);
+}
+
+static void EmitImage(FILE* out, const char* prefix, const VocabTable::Image& image) {
+  std::fprintf(out, "\t\t{ { %sBlob, %zu }, %sOffsets, %zu, %sSeeds, %zu, %sSlots, %zu },\n", prefix,
+               image.blob.size(), prefix, image.num_offsets, prefix, image.num_seeds, prefix,
+               image.num_slots);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    std::fprintf(stderr, "usage: %s <json|sentencepiece|rwkv> <input> <name> <output.cc>\n", argv[0]);
+    return 1;
+  }
+  std::string_view format = argv[1];
+  const char* input = argv[2];
+  std::string name = argv[3];
+  const char* output = argv[4];
+
+  // the name also makes up the accessor function, keep it an identifier
+  std::string ident = "tokenizer_";
+  for (char c : name) {
+    if (!std::isprint(static_cast<unsigned char>(c)) || c == '"' || c == '\\') {
+      std::fprintf(stderr, "name must be printable and not hold quotes or backslashes\n");
+      return 1;
+    }
+    ident.push_back(std::isalnum(static_cast<unsigned char>(c)) ? c : '_');
+  }
+
+  std::string source;
+  std::unique_ptr<Tokenizer> tok;
+  const char* format_enum;
+  if (format == "json") {
+    source = ReadFile(input);
+    tok = Tokenizer::FromBlobJSON(source);
+    format_enum = "kJSON";
+  } else if (format == "sentencepiece") {
+    source = ReadFile(input);
+    tok = Tokenizer::FromBlobSentencePiece(source);
+    format_enum = "kSentencePiece";
+  } else if (format == "rwkv") {
+    // the vocabulary table is all the RWKV world tokenizer is built from
+    tok = Tokenizer::FromBlobRWKVWorld(input);
+    format_enum = "kRWKVWorld";
+  } else {
+    std::fprintf(stderr, "unknown format %s\n", argv[1]);
+    return 1;
+  }
+
+  const VocabTable* vocab = tok->GetVocabTable();
+  if (!vocab) {
+    std::fprintf(stderr, "%s has no vocabulary table\n", input);
+    return 1;
+  }
+  auto decoded = tok->GetDecodedVocab();
+  bool has_decoded = decoded && decoded.get() != vocab;
+
+  FILE* out = std::fopen(output, "wb");
+  if (!out) {
+    std::fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+  std::fprintf(out, "// Generated by tokenizer_codegen from %s, do not edit.\n", input);
+  std::fprintf(out, "#include <tokenizers_compiled.h>\n\n#include <cstdint>\n\nnamespace\n{\n");
+  EmitBytes(out, "kSource", source);
+  EmitTable(out, "kVocab", vocab->GetImage());
+  if (has_decoded) EmitTable(out, "kDecoded", decoded->GetImage());
+
+  std::fprintf(out, "\n\tconst tokenizers::CompiledTokenizer kCompiled = {\n");
+  std::fprintf(out, "\t\t\"%s\",\n\t\ttokenizers::TokenizerSource::Format::%s,\n", name.c_str(), format_enum);
+  std::fprintf(out, "\t\t{ kSource, %zu },\n", source.size());
+  EmitImage(out, "kVocab", vocab->GetImage());
+  if (has_decoded) {
+    EmitImage(out, "kDecoded", decoded->GetImage());
+  } else {
+    std::fprintf(out, "\t\t{},\n");
+  }
+  std::fprintf(out, "\t};\n\n\tconst tokenizers::CompiledTokenizerRegistration kRegistration(kCompiled);\n");
+  std::fprintf(out, "} // namespace\n\n");
+
+  // referencing the accessor keeps the registration when linked from a static library
+  std::fprintf(out, "namespace tokenizers::compiled\n{\n");
+  std::fprintf(out, "\tconst CompiledTokenizer& %s()\n\t{\n\t\treturn kCompiled;\n\t}\n", ident.c_str());
+  std::fprintf(out, "} // namespace tokenizers::compiled\n");
+
+  bool ok = std::fflush(out) == 0;
+  ok = std::fclose(out) == 0 && ok;
+  if (!ok) {
+    std::fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+  std::printf("%s: %zu ids, %zu source bytes -> %s\n", name.c_str(), vocab->Size(), source.size(), output);
+  return 0;
+}
@@ -0,0 +1,327 @@
+// Load generator for tokenizer_server: each client connection keeps a number
+// of requests in flight and reports throughput and latency percentiles.
+//
+//   tokenizer_loadgen <socket> [--clients N] [--requests N] [--batch N]
+//                     [--depth N] [--corpus file] [--decode]
+//
+// Requests hold --batch lines of the corpus, a built-in sample by default.
+// With --decode the lines are encoded once up front and the ids decoded.
+#include <tokenizers_server.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace server = tokenizers::server;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+std::vector<std::string> Lines(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    std::exit(1);
+  }
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(file, line);) {
+    if (!line.empty()) lines.push_back(line);
+  }
+  return lines;
+}
+
+std::vector<std::string> SyntheticCorpus() {
+  const char* kLines[] = {
+      "The quick brown fox jumps over the lazy dog.",
+      "Tokenization throughput matters when every request of a serving fleet is tokenized.",
+      "It was the best of times, it was the worst of times, it was the age of wisdom.",
+      "fn main() { println!(\"hello, world\"); }",
+      "Die Würde des Menschen ist unantastbar. 人人生而自由，在尊严和权利上一律平等。",
+      "   leading spaces, trailing spaces   and\ttabs\tand\nnewlines   ",
+  };
+  return std::vector<std::string>(std::begin(kLines), std::end(kLines));
+}
+
+bool ReadAll(int fd, void* buf, size_t len) {
+  char* p = static_cast<char*>(buf);
+  while (len) {
+    ssize_t n = ::recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void* buf, size_t len) {
+  const char* p = static_cast<const char*>(buf);
+  while (len) {
+    ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// A connection to the server with its mapped ring.
+class Client {
+ public:
+  explicit Client(const char* socket_path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      Fail("cannot connect");
+    }
+
+    server::HelloMessage hello;
+    iovec iov = {&hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd_, &msg, MSG_WAITALL) != ssize_t(sizeof(hello)) || hello.magic != server::kMagic ||
+        hello.version != server::kVersion) {
+      Fail("bad hello");
+    }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) Fail("no ring descriptor");
+    int shm;
+    std::memcpy(&shm, CMSG_DATA(cmsg), sizeof(int));
+    mapping_bytes_ = hello.mapping_bytes;
+    mapping_ = ::mmap(nullptr, mapping_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+    ::close(shm);
+    if (mapping_ == MAP_FAILED) Fail("cannot map the ring");
+    ring_ = static_cast<server::RingHeader*>(mapping_);
+    data_ = static_cast<const char*>(mapping_) + server::kRingDataOffset;
+  }
+
+  ~Client() {
+    if (mapping_ != MAP_FAILED) ::munmap(mapping_, mapping_bytes_);
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  void Send(server::Op op, uint64_t request_id, uint32_t flags, const std::vector<std::string>& payload_parts,
+            uint32_t count) {
+    server::RequestHeader header;
+    header.op = uint32_t(op);
+    header.request_id = request_id;
+    header.flags = flags;
+    header.count = count;
+    for (const std::string& part : payload_parts) header.payload_bytes += part.size();
+    if (!WriteAll(fd_, &header, sizeof(header))) Fail("send failed");
+    for (const std::string& part : payload_parts) {
+      if (!WriteAll(fd_, part.data(), part.size())) Fail("send failed");
+    }
+  }
+
+  // The next response, its result viewing the ring until Release.
+  server::ResponseHeader Receive(std::string_view& result) {
+    server::ResponseHeader header;
+    if (!ReadAll(fd_, &header, sizeof(header))) Fail("connection closed");
+    result = {};
+    if (header.status == int32_t(server::Status::kOk)) {
+      result = std::string_view(data_ + header.ring_position % ring_->capacity, header.ring_bytes);
+    }
+    return header;
+  }
+
+  void Release(const server::ResponseHeader& header) {
+    if (header.status == int32_t(server::Status::kOk)) {
+      ring_->tail.store(header.ring_position + header.ring_bytes, std::memory_order_release);
+    }
+  }
+
+ private:
+  [[noreturn]] static void Fail(const char* what) {
+    std::fprintf(stderr, "%s: %s\n", what, std::strerror(errno));
+    std::exit(1);
+  }
+
+  int fd_ = -1;
+  void* mapping_ = MAP_FAILED;
+  size_t mapping_bytes_ = 0;
+  server::RingHeader* ring_ = nullptr;
+  const char* data_ = nullptr;
+};
+
+// Payload of count rows: the uint32 lengths, then the rows.
+template <class _Row>
+std::vector<std::string> Payload(const std::vector<_Row>& rows, size_t first, size_t count) {
+  std::string lengths, body;
+  for (size_t i = 0; i < count; ++i) {
+    const _Row& row = rows[(first + i) % rows.size()];
+    uint32_t len = uint32_t(row.size());
+    lengths.append(reinterpret_cast<const char*>(&len), sizeof(len));
+    body.append(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(row[0]));
+  }
+  return {std::move(lengths), std::move(body)};
+}
+
+// ids of each line, encoded by the server
+std::vector<std::vector<uint32_t>> EncodeLines(const char* socket_path, const std::vector<std::string>& lines) {
+  Client client(socket_path);
+  client.Send(server::Op::kEncode, 0, server::kAddSpecialTokens, Payload(lines, 0, lines.size()),
+              uint32_t(lines.size()));
+  std::string_view result;
+  server::ResponseHeader header = client.Receive(result);
+  if (header.status != int32_t(server::Status::kOk)) {
+    std::fprintf(stderr, "encoding the corpus failed with status %d\n", header.status);
+    std::exit(1);
+  }
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(result.data());
+  const uint32_t* ids = words + lines.size() + 1;
+  std::vector<std::vector<uint32_t>> encoded(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) encoded[i].assign(ids + words[i], ids + words[i + 1]);
+  client.Release(header);
+  return encoded;
+}
+
+struct Totals {
+  std::mutex mutex;
+  std::vector<double> latencies_us;
+  uint64_t rows = 0;
+  uint64_t items = 0;
+  uint64_t result_bytes = 0;
+  uint64_t errors = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr,
+                 "usage: %s <socket> [--clients N] [--requests N] [--batch N] [--depth N] [--corpus file] "
+                 "[--decode]\n",
+                 argv[0]);
+    return 1;
+  }
+  const char* socket_path = argv[1];
+  size_t clients = 4, requests = 1000, batch = 16, depth = 4;
+  const char* corpus = nullptr;
+  bool decode = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view flag = argv[i];
+    if (flag == "--decode") {
+      decode = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "%s needs a value\n", argv[i]);
+      return 1;
+    }
+    const char* value = argv[++i];
+    if (flag == "--clients") {
+      clients = size_t(std::atol(value));
+    } else if (flag == "--requests") {
+      requests = size_t(std::atol(value));
+    } else if (flag == "--batch") {
+      batch = size_t(std::atol(value));
+    } else if (flag == "--depth") {
+      depth = size_t(std::atol(value));
+    } else if (flag == "--corpus") {
+      corpus = value;
+    } else {
+      std::fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+      return 1;
+    }
+  }
+  if (!clients || !batch || !depth) {
+    std::fprintf(stderr, "--clients, --batch and --depth must be positive\n");
+    return 1;
+  }
+
+  std::vector<std::string> lines = corpus ? Lines(corpus) : SyntheticCorpus();
+  if (lines.empty()) {
+    std::fprintf(stderr, "empty corpus\n");
+    return 1;
+  }
+  std::vector<std::vector<uint32_t>> encoded;
+  if (decode) encoded = EncodeLines(socket_path, lines);
+
+  Totals totals;
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < clients; ++c) {
+    threads.emplace_back([&, c] {
+      Client client(socket_path);
+      std::deque<Clock::time_point> sent;
+      std::vector<double> latencies;
+      uint64_t items = 0, result_bytes = 0, errors = 0;
+      size_t next = 0, done = 0;
+      while (done < requests) {
+        // keep depth requests in flight
+        while (next < requests && sent.size() < depth) {
+          size_t first = (c * requests + next) * batch;
+          if (decode) {
+            client.Send(server::Op::kDecode, next, server::kSkipSpecialTokens, Payload(encoded, first, batch),
+                        uint32_t(batch));
+          } else {
+            client.Send(server::Op::kEncode, next, server::kAddSpecialTokens, Payload(lines, first, batch),
+                        uint32_t(batch));
+          }
+          sent.push_back(Clock::now());
+          ++next;
+        }
+        std::string_view result;
+        server::ResponseHeader header = client.Receive(result);
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent.front()).count());
+        sent.pop_front();
+        ++done;
+        if (header.status != int32_t(server::Status::kOk)) {
+          ++errors;
+          continue;
+        }
+        // ids or bytes past the offsets, the last offset is their count
+        uint32_t total;
+        std::memcpy(&total, result.data() + header.count * sizeof(uint32_t), sizeof(total));
+        items += total;
+        result_bytes += result.size();
+        client.Release(header);
+      }
+      std::unique_lock<std::mutex> lock(totals.mutex);
+      totals.latencies_us.insert(totals.latencies_us.end(), latencies.begin(), latencies.end());
+      totals.rows += requests * batch;
+      totals.items += items;
+      totals.result_bytes += result_bytes;
+      totals.errors += errors;
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  auto& lat = totals.latencies_us;
+  std::sort(lat.begin(), lat.end());
+  auto percentile = [&](double p) { return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, size_t(p * lat.size()))]; };
+  std::printf("%s: %zu clients x %zu requests of %zu rows, depth %zu, %.2f s\n", decode ? "decode" : "encode",
+              clients, requests, batch, depth, seconds);
+  std::printf("  %.0f requests/s, %.0f rows/s, %.0f %s/s, %.1f MB/s of results\n", lat.size() / seconds,
+              totals.rows / seconds, totals.items / seconds, decode ? "bytes" : "tokens",
+              totals.result_bytes / seconds / 1e6);
+  std::printf("  latency us: p50 %.0f  p90 %.0f  p99 %.0f  max %.0f\n", percentile(0.5), percentile(0.9),
+              percentile(0.99), lat.empty() ? 0.0 : lat.back());
+  if (totals.errors) std::printf("  %llu requests failed\n", (unsigned long long)totals.errors);
+  return totals.errors ? 1 : 0;
+}
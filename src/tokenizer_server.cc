@@ -0,0 +1,495 @@
+// A tokenizer daemon: serves encode and decode requests of local processes
+// over a Unix domain socket and returns the results in a shared memory ring
+// per connection, see tokenizers_server.h for the protocol.
+//
+//   tokenizer_server <json|sentencepiece|rwkv> <input> <socket>
+//                    [--ring-mb N] [--max-batch N] [--batch-wait-us N]
+//
+// Requests of all connections are queued and run together on the worker
+// pool once max-batch texts are waiting or the oldest request has waited
+// batch-wait-us. Each connection has a reader and a writer thread, so a
+// client that is slow to release its ring only stalls itself.
+#include <tokenizers_cpp.h>
+#include <tokenizers_server.h>
+#include <tokenizers_threads.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace server = tokenizers::server;
+using tokenizers::Tokenizer;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// requests larger than this are refused before their payload is read
+constexpr uint64_t kMaxPayloadBytes = uint64_t(1) << 30;
+
+std::atomic<bool> stopping{false};
+
+std::string ReadFile(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::fprintf(stderr, "cannot open %s\n", path);
+    std::exit(1);
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+bool ReadAll(int fd, void* buf, size_t len) {
+  char* p = static_cast<char*>(buf);
+  while (len) {
+    ssize_t n = ::recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const void* buf, size_t len) {
+  const char* p = static_cast<const char*>(buf);
+  while (len) {
+    ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+struct Result {
+  server::ResponseHeader header;
+  std::vector<char> bytes;
+};
+
+// One client: its socket, its ring and the results waiting to be written.
+struct Connection {
+  int fd = -1;
+  void* mapping = MAP_FAILED;
+  size_t mapping_bytes = 0;
+  server::RingHeader* ring = nullptr;
+  char* data = nullptr;
+  uint64_t next_position = 0;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Result> outbox;
+  // requests read but not yet answered
+  size_t pending = 0;
+  bool reader_done = false;
+  std::atomic<bool> peer_gone{false};
+
+  ~Connection() {
+    if (mapping != MAP_FAILED) ::munmap(mapping, mapping_bytes);
+    if (fd >= 0) ::close(fd);
+  }
+
+  void Post(Result result) {
+    std::unique_lock<std::mutex> lock(mutex);
+    outbox.push_back(std::move(result));
+    cv.notify_all();
+  }
+};
+
+struct Job {
+  std::shared_ptr<Connection> conn;
+  server::RequestHeader header;
+  std::string payload;
+  // views into payload, the texts of kEncode or the ids of kDecode
+  std::vector<std::string_view> texts;
+  std::vector<tokenizers::array_view<uint32_t>> ids;
+  // set for a request that is answered with this status without running
+  server::Status status = server::Status::kOk;
+  Clock::time_point arrived;
+
+  size_t Rows() const { return texts.size() + ids.size(); }
+};
+
+// Splits the payload into its rows, false if the lengths do not add up.
+bool ParsePayload(Job& job) {
+  uint64_t count = job.header.count;
+  if (job.payload.size() / sizeof(uint32_t) < count) return false;
+  std::vector<uint32_t> lengths(count);
+  std::memcpy(lengths.data(), job.payload.data(), count * sizeof(uint32_t));
+  size_t pos = count * sizeof(uint32_t);
+  // ids are read in place, pos stays 4-byte aligned in the payload
+  size_t unit = job.header.op == uint32_t(server::Op::kDecode) ? sizeof(uint32_t) : 1;
+  for (uint32_t len : lengths) {
+    uint64_t bytes = uint64_t(len) * unit;
+    if (bytes > job.payload.size() - pos) return false;
+    if (unit == 1) {
+      job.texts.emplace_back(job.payload.data() + pos, len);
+    } else {
+      job.ids.emplace_back(reinterpret_cast<const uint32_t*>(job.payload.data() + pos), len);
+    }
+    pos += bytes;
+  }
+  return pos == job.payload.size();
+}
+
+// Queue of the jobs of all connections, run in arrival order.
+class Batcher {
+ public:
+  Batcher(Tokenizer& tok, size_t max_batch, std::chrono::microseconds wait)
+      : tok_(tok), max_batch_(max_batch), wait_(wait) {}
+
+  void Push(Job job) {
+    job.arrived = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    rows_ += job.Rows();
+    jobs_.push_back(std::move(job));
+    cv_.notify_one();
+  }
+
+  void Run() {
+    std::vector<Job> batch;
+    while (!stopping.load()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::milliseconds(100), [&] { return !jobs_.empty(); });
+        if (jobs_.empty()) continue;
+        cv_.wait_until(lock, jobs_.front().arrived + wait_, [&] { return rows_ >= max_batch_; });
+        // whole requests only, at least one even when it alone is over max_batch
+        size_t rows = 0;
+        while (!jobs_.empty() && (batch.empty() || rows + jobs_.front().Rows() <= max_batch_)) {
+          rows += jobs_.front().Rows();
+          batch.push_back(std::move(jobs_.front()));
+          jobs_.pop_front();
+        }
+        rows_ -= rows;
+      }
+      RunBatch(batch);
+      batch.clear();
+    }
+  }
+
+ private:
+  void RunBatch(std::vector<Job>& batch) {
+    // the encode rows of all requests go to the pool at once
+    struct Row {
+      std::string_view text;
+      bool add_special_tokens;
+    };
+    std::vector<Row> rows;
+    for (Job& job : batch) {
+      if (job.status != server::Status::kOk || job.header.op != uint32_t(server::Op::kEncode)) continue;
+      for (std::string_view text : job.texts) {
+        rows.push_back({text, (job.header.flags & server::kAddSpecialTokens) != 0});
+      }
+    }
+    std::vector<tokenizers::Encoding> encodings(rows.size());
+    std::vector<char> failed(rows.size(), 0);
+    tokenizers::ThreadPool::ParallelFor(rows.size(), [&](size_t i) {
+      try {
+        encodings[i] = tok_.Encode(rows[i].text, rows[i].add_special_tokens);
+      } catch (const std::exception&) {
+        failed[i] = 1;
+      }
+    });
+
+    size_t row = 0;
+    for (Job& job : batch) {
+      Result result;
+      result.header.request_id = job.header.request_id;
+      result.header.count = job.header.count;
+      result.header.status = int32_t(job.status);
+      if (job.status == server::Status::kOk) {
+        if (job.header.op == uint32_t(server::Op::kEncode)) {
+          bool ok = CollectEncodings(encodings, failed, row, job.texts.size(), result.bytes);
+          row += job.texts.size();
+          if (!ok) result.header.status = int32_t(server::Status::kFailed);
+        } else if (!Decode(job, result.bytes)) {
+          result.header.status = int32_t(server::Status::kFailed);
+        }
+      }
+      if (result.header.status != int32_t(server::Status::kOk)) result.bytes.clear();
+      job.conn->Post(std::move(result));
+    }
+  }
+
+  // count + 1 offsets and the ids of rows [first, first + count)
+  static bool CollectEncodings(const std::vector<tokenizers::Encoding>& encodings,
+                               const std::vector<char>& failed, size_t first, size_t count,
+                               std::vector<char>& bytes) {
+    std::vector<uint32_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+      if (failed[first + i]) return false;
+      const auto& ids = encodings[first + i].ids;
+      offsets[i + 1] = offsets[i] + uint32_t(ids ? ids->size() : 0);
+    }
+    bytes.resize((offsets.size() + offsets[count]) * sizeof(uint32_t));
+    char* out = bytes.data();
+    std::memcpy(out, offsets.data(), offsets.size() * sizeof(uint32_t));
+    out += offsets.size() * sizeof(uint32_t);
+    for (size_t i = 0; i < count; ++i) {
+      const auto& ids = encodings[first + i].ids;
+      if (!ids || ids->empty()) continue;
+      std::memcpy(out, ids->data(), ids->size() * sizeof(uint32_t));
+      out += ids->size() * sizeof(uint32_t);
+    }
+    return true;
+  }
+
+  // count + 1 byte offsets and the texts
+  bool Decode(const Job& job, std::vector<char>& bytes) {
+    std::string text;
+    std::vector<size_t> offsets;
+    try {
+      tok_.DecodeBatchInto(job.ids, text, offsets, (job.header.flags & server::kSkipSpecialTokens) != 0);
+    } catch (const std::exception&) {
+      return false;
+    }
+    if (text.size() > UINT32_MAX) return false;
+    bytes.resize(offsets.size() * sizeof(uint32_t) + text.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+      uint32_t offset = uint32_t(offsets[i]);
+      std::memcpy(bytes.data() + i * sizeof(uint32_t), &offset, sizeof(offset));
+    }
+    std::memcpy(bytes.data() + offsets.size() * sizeof(uint32_t), text.data(), text.size());
+    return true;
+  }
+
+  Tokenizer& tok_;
+  size_t max_batch_;
+  std::chrono::microseconds wait_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job> jobs_;
+  size_t rows_ = 0;
+};
+
+// Copies a result into the ring once the client released enough of it,
+// false if the client went away meanwhile.
+bool WriteRing(Connection& conn, Result& result) {
+  uint64_t capacity = conn.ring->capacity;
+  uint64_t size = (result.bytes.size() + 7) & ~uint64_t(7);
+  if (size > capacity) {
+    result.header.status = int32_t(server::Status::kTooLarge);
+    return true;
+  }
+  uint64_t position = conn.next_position;
+  // results are contiguous, skip the tail end of the data if this one does not fit there
+  if (position % capacity + size > capacity) position += capacity - position % capacity;
+  while (position + size - conn.ring->tail.load(std::memory_order_acquire) > capacity) {
+    if (conn.peer_gone.load() || stopping.load()) return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  std::memcpy(conn.data + position % capacity, result.bytes.data(), result.bytes.size());
+  conn.next_position = position + size;
+  conn.ring->head.store(conn.next_position, std::memory_order_release);
+  result.header.ring_position = position;
+  result.header.ring_bytes = result.bytes.size();
+  return true;
+}
+
+void WriterLoop(std::shared_ptr<Connection> conn) {
+  while (true) {
+    Result result;
+    {
+      std::unique_lock<std::mutex> lock(conn->mutex);
+      conn->cv.wait(lock, [&] { return !conn->outbox.empty() || (conn->reader_done && !conn->pending); });
+      if (conn->outbox.empty()) break;
+      result = std::move(conn->outbox.front());
+      conn->outbox.pop_front();
+      --conn->pending;
+    }
+    if (result.header.status == int32_t(server::Status::kOk) && !WriteRing(*conn, result)) break;
+    if (!WriteAll(conn->fd, &result.header, sizeof(result.header))) break;
+  }
+  conn->peer_gone = true;
+  ::shutdown(conn->fd, SHUT_RDWR);
+}
+
+void ReaderLoop(std::shared_ptr<Connection> conn, Batcher& batcher) {
+  while (!conn->peer_gone.load()) {
+    Job job;
+    if (!ReadAll(conn->fd, &job.header, sizeof(job.header))) break;
+    bool valid = job.header.magic == server::kMagic &&
+                 (job.header.op == uint32_t(server::Op::kEncode) ||
+                  job.header.op == uint32_t(server::Op::kDecode)) &&
+                 job.header.payload_bytes <= kMaxPayloadBytes;
+    if (valid) {
+      job.payload.resize(job.header.payload_bytes);
+      if (!ReadAll(conn->fd, job.payload.data(), job.payload.size())) break;
+      valid = ParsePayload(job);
+    }
+    if (!valid) {
+      job.status = server::Status::kBadRequest;
+      job.texts.clear();
+      job.ids.clear();
+    }
+    job.conn = conn;
+    {
+      std::unique_lock<std::mutex> lock(conn->mutex);
+      ++conn->pending;
+    }
+    // queued even when malformed, so that the responses stay in order
+    batcher.Push(std::move(job));
+    if (!valid) break;
+  }
+  std::unique_lock<std::mutex> lock(conn->mutex);
+  conn->reader_done = true;
+  conn->cv.notify_all();
+}
+
+// Maps a ring of ring_bytes for a new client and sends it the descriptor.
+bool OpenRing(Connection& conn, size_t ring_bytes) {
+  static std::atomic<uint64_t> serial{0};
+  std::string name = "/tokenizer_server." + std::to_string(::getpid()) + "." + std::to_string(serial++);
+  int shm = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (shm < 0) return false;
+  // only the descriptor passed to the client keeps it reachable
+  ::shm_unlink(name.c_str());
+  conn.mapping_bytes = server::kRingDataOffset + ring_bytes;
+  bool ok = ::ftruncate(shm, off_t(conn.mapping_bytes)) == 0;
+  if (ok) {
+    conn.mapping = ::mmap(nullptr, conn.mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+    ok = conn.mapping != MAP_FAILED;
+  }
+  if (ok) {
+    conn.ring = new (conn.mapping) server::RingHeader{ring_bytes, {0}, {0}};
+    conn.data = static_cast<char*>(conn.mapping) + server::kRingDataOffset;
+
+    server::HelloMessage hello;
+    hello.mapping_bytes = conn.mapping_bytes;
+    iovec iov = {&hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &shm, sizeof(int));
+    ok = ::sendmsg(conn.fd, &msg, MSG_NOSIGNAL) == ssize_t(sizeof(hello));
+  }
+  ::close(shm);
+  return ok;
+}
+
+void OnSignal(int) { stopping = true; }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    std::fprintf(stderr,
+                 "usage: %s <json|sentencepiece|rwkv> <input> <socket> [--ring-mb N] [--max-batch N] "
+                 "[--batch-wait-us N]\n",
+                 argv[0]);
+    return 1;
+  }
+  std::string_view format = argv[1];
+  const char* input = argv[2];
+  const char* socket_path = argv[3];
+  size_t ring_bytes = size_t(64) << 20;
+  size_t max_batch = 256;
+  long batch_wait_us = 500;
+  for (int i = 4; i + 1 < argc; i += 2) {
+    std::string_view flag = argv[i];
+    if (flag == "--ring-mb") {
+      ring_bytes = size_t(std::atol(argv[i + 1])) << 20;
+    } else if (flag == "--max-batch") {
+      max_batch = size_t(std::atol(argv[i + 1]));
+    } else if (flag == "--batch-wait-us") {
+      batch_wait_us = std::atol(argv[i + 1]);
+    } else {
+      std::fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (!ring_bytes || !max_batch) {
+    std::fprintf(stderr, "--ring-mb and --max-batch must be positive\n");
+    return 1;
+  }
+
+  std::unique_ptr<Tokenizer> tok;
+  if (format == "json") {
+    tok = Tokenizer::FromBlobJSON(ReadFile(input));
+  } else if (format == "sentencepiece") {
+    tok = Tokenizer::FromBlobSentencePiece(ReadFile(input));
+  } else if (format == "rwkv") {
+    tok = Tokenizer::FromBlobRWKVWorld(input);
+  } else {
+    std::fprintf(stderr, "unknown format %s\n", argv[1]);
+    return 1;
+  }
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(socket_path) >= sizeof(addr.sun_path)) {
+    std::fprintf(stderr, "socket path too long\n");
+    return 1;
+  }
+  std::strcpy(addr.sun_path, socket_path);
+  int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ::unlink(socket_path);
+  if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      ::listen(listener, 64) != 0) {
+    std::fprintf(stderr, "cannot listen on %s: %s\n", socket_path, std::strerror(errno));
+    return 1;
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = OnSignal;
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+
+  Batcher batcher(*tok, max_batch, std::chrono::microseconds(batch_wait_us));
+  std::thread batch_thread([&] { batcher.Run(); });
+  std::printf("serving %s on %s, %zu MiB ring per client\n", input, socket_path, ring_bytes >> 20);
+  std::fflush(stdout);
+
+  while (!stopping.load()) {
+    pollfd pfd = {listener, POLLIN, 0};
+    if (::poll(&pfd, 1, 200) <= 0) continue;
+    int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    auto conn = std::make_shared<Connection>();
+    conn->fd = fd;
+    if (!OpenRing(*conn, ring_bytes)) {
+      std::fprintf(stderr, "cannot set up a ring: %s\n", std::strerror(errno));
+      continue;
+    }
+    std::thread(WriterLoop, conn).detach();
+    std::thread(ReaderLoop, conn, std::ref(batcher)).detach();
+  }
+
+  // connection threads still running end with the process
+  batch_thread.join();
+  ::close(listener);
+  ::unlink(socket_path);
+  return 0;
+}
@@ -0,0 +1,31 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_backends.h
+ * \brief Backend constructors taking a prebuilt vocabulary table
+ */
+#ifndef TOKENIZERS_BACKENDS_H_
+#define TOKENIZERS_BACKENDS_H_
+
+#include <tokenizers_cpp.h>
+
+#include <memory>
+#include <string_view>
+
+namespace tokenizers
+{
+	/*!
+	 * \brief HF tokenizer of a tokenizer.json, vocab as its vocabulary table.
+	 */
+	std::unique_ptr<Tokenizer> MakeHuggingFaceTokenizer(std::string_view json, std::shared_ptr<VocabTable> vocab);
+
+	/*!
+	 * \brief sentencepiece tokenizer of a model, vocab as its vocabulary table.
+	 */
+	std::unique_ptr<Tokenizer> MakeSentencePieceTokenizer(std::string_view model_blob, std::shared_ptr<VocabTable> vocab);
+
+	/*!
+	 * \brief RWKV world tokenizer over vocab, which is all it needs.
+	 */
+	std::unique_ptr<Tokenizer> MakeRWKVWorldTokenizer(std::shared_ptr<VocabTable> vocab);
+} // namespace tokenizers
+#endif // TOKENIZERS_BACKENDS_H_
@@ -0,0 +1,172 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_cache.cc
+ */
+#include "tokenizers_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace tokenizers
+{
+	namespace
+	{
+		constexpr size_t kMaxShards = 16;
+
+		struct Entry
+		{
+			std::string piece;
+			std::vector<uint32_t> ids;
+		};
+	} // namespace
+
+	struct EncodeCache::Shard
+	{
+		std::mutex mutex;
+		size_t capacity = 0;
+		// most recently used first, the index keys view the pieces of the list nodes
+		std::list<Entry> lru;
+		std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		size_t bytes = 0;
+	};
+
+	EncodeCache::EncodeCache(size_t capacity) : capacity_(capacity)
+	{
+		if (!capacity)
+			throw std::invalid_argument("EncodeCache: capacity must be positive");
+		size_t num_shards = std::min(capacity, kMaxShards);
+		shards_.reserve(num_shards);
+		for (size_t i = 0; i < num_shards; ++i)
+		{
+			shards_.push_back(std::make_unique<Shard>());
+			// the first capacity % num_shards shards take one more
+			shards_.back()->capacity = capacity / num_shards + (i < capacity % num_shards);
+		}
+	}
+
+	EncodeCache::~EncodeCache() = default;
+
+	EncodeCache::Shard& EncodeCache::ShardOf(std::string_view piece) const
+	{
+		size_t hash = std::hash<std::string_view>()(piece);
+		// the low bits pick the map bucket, shards use the high ones
+		return *shards_[(hash >> (sizeof(size_t) * 8 - 8)) % shards_.size()];
+	}
+
+	template <class _Ty>
+	bool EncodeCache::LookupAs(std::string_view piece, std::vector<_Ty>& ids)
+	{
+		Shard& shard = ShardOf(piece);
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		auto iter = shard.index.find(piece);
+		if (iter == shard.index.end())
+		{
+			++shard.misses;
+			return false;
+		}
+		++shard.hits;
+		shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+		const std::vector<uint32_t>& cached = iter->second->ids;
+		ids.insert(ids.end(), cached.begin(), cached.end());
+		return true;
+	}
+
+	template <class _Ty>
+	void EncodeCache::InsertAs(std::string_view piece, const _Ty* ids, size_t num_ids)
+	{
+		if (piece.size() > kMaxPieceBytes)
+			return;
+		Shard& shard = ShardOf(piece);
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		// another thread may have encoded the same piece meanwhile
+		if (shard.index.count(piece))
+			return;
+
+		if (shard.lru.size() >= shard.capacity)
+		{
+			// reuse the evicted node, its buffers usually fit the new piece
+			auto last = std::prev(shard.lru.end());
+			shard.index.erase(last->piece);
+			shard.bytes -= last->piece.capacity() + last->ids.capacity() * sizeof(uint32_t);
+			shard.lru.splice(shard.lru.begin(), shard.lru, last);
+		}
+		else
+		{
+			shard.lru.emplace_front();
+		}
+
+		Entry& entry = shard.lru.front();
+		entry.piece.assign(piece);
+		entry.ids.assign(ids, ids + num_ids);
+		shard.bytes += entry.piece.capacity() + entry.ids.capacity() * sizeof(uint32_t);
+		shard.index.emplace(entry.piece, shard.lru.begin());
+	}
+
+	bool EncodeCache::Lookup(std::string_view piece, std::vector<uint32_t>& ids)
+	{
+		return LookupAs(piece, ids);
+	}
+
+	bool EncodeCache::Lookup(std::string_view piece, std::vector<int32_t>& ids)
+	{
+		return LookupAs(piece, ids);
+	}
+
+	void EncodeCache::Insert(std::string_view piece, const uint32_t* ids, size_t num_ids)
+	{
+		InsertAs(piece, ids, num_ids);
+	}
+
+	void EncodeCache::Insert(std::string_view piece, const int32_t* ids, size_t num_ids)
+	{
+		InsertAs(piece, ids, num_ids);
+	}
+
+	void EncodeCache::Clear()
+	{
+		for (auto& shard : shards_)
+		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			shard->index.clear();
+			shard->lru.clear();
+			shard->hits = shard->misses = 0;
+			shard->bytes = 0;
+		}
+	}
+
+	EncodeCacheStats EncodeCache::GetStats() const
+	{
+		EncodeCacheStats stats;
+		stats.capacity = capacity_;
+		for (auto& shard : shards_)
+		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			stats.hits += shard->hits;
+			stats.misses += shard->misses;
+			stats.entries += shard->lru.size();
+		}
+		return stats;
+	}
+
+	size_t EncodeCache::MemoryUsage() const
+	{
+		// each entry also takes a list node and an index node with its bucket
+		constexpr size_t kEntryOverhead = sizeof(Entry) + 2 * sizeof(void*) +
+			sizeof(std::pair<std::string_view, void*>) + 3 * sizeof(void*);
+
+		size_t bytes = 0;
+		for (auto& shard : shards_)
+		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			bytes += shard->bytes + shard->lru.size() * kEntryOverhead;
+		}
+		return bytes;
+	}
+} // namespace tokenizers
@@ -0,0 +1,86 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_compiled.cc
+ */
+#include "tokenizers_compiled.h"
+
+#include "tokenizers_backends.h"
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace tokenizers
+{
+	namespace
+	{
+		struct CompiledTokenizers
+		{
+			std::mutex mutex;
+			std::map<std::string_view, const CompiledTokenizer*> by_name;
+		};
+
+		// constructed on first use, registrations run during static initialization
+		CompiledTokenizers& compiled_tokenizers()
+		{
+			static CompiledTokenizers compiled;
+			return compiled;
+		}
+	} // namespace
+
+	CompiledTokenizerRegistration::CompiledTokenizerRegistration(const CompiledTokenizer& tokenizer)
+	{
+		auto& compiled = compiled_tokenizers();
+		std::unique_lock<std::mutex> lock(compiled.mutex);
+		// the same generated source linked twice registers identical tables
+		compiled.by_name.emplace(tokenizer.name, &tokenizer);
+	}
+
+	const CompiledTokenizer* FindCompiledTokenizer(std::string_view name)
+	{
+		auto& compiled = compiled_tokenizers();
+		std::unique_lock<std::mutex> lock(compiled.mutex);
+		auto iter = compiled.by_name.find(name);
+		return iter == compiled.by_name.end() ? nullptr : iter->second;
+	}
+
+	std::vector<std::string_view> CompiledTokenizerNames()
+	{
+		auto& compiled = compiled_tokenizers();
+		std::unique_lock<std::mutex> lock(compiled.mutex);
+		std::vector<std::string_view> names;
+		names.reserve(compiled.by_name.size());
+		for (auto& [name, tokenizer] : compiled.by_name)
+			names.push_back(name);
+		return names;
+	}
+
+	std::unique_ptr<Tokenizer> Tokenizer::FromCompiled(std::string_view name)
+	{
+		const CompiledTokenizer* compiled = FindCompiledTokenizer(name);
+		if (!compiled)
+			throw std::invalid_argument("FromCompiled: no compiled tokenizer named " + std::string(name));
+
+		std::shared_ptr<VocabTable> vocab = VocabTable::FromImage(compiled->vocab);
+		std::unique_ptr<Tokenizer> tokenizer;
+		switch (compiled->format)
+		{
+		case TokenizerSource::Format::kJSON:
+			tokenizer = MakeHuggingFaceTokenizer(compiled->source, vocab);
+			break;
+		case TokenizerSource::Format::kSentencePiece:
+			tokenizer = MakeSentencePieceTokenizer(compiled->source, vocab);
+			break;
+		case TokenizerSource::Format::kRWKVWorld:
+			tokenizer = MakeRWKVWorldTokenizer(vocab);
+			break;
+		default:
+			throw std::invalid_argument("FromCompiled: unknown format");
+		}
+
+		if (compiled->decoded_vocab.num_offsets)
+			tokenizer->SetDecodedVocab(VocabTable::FromImage(compiled->decoded_vocab));
+		return tokenizer;
+	}
+} // namespace tokenizers
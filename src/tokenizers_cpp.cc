@@ -4,6 +4,16 @@
  */
 #include "tokenizers_cpp.h"
 
+#include "tokenizers_c.h"
+#include "tokenizers_guard.h"
+#include "tokenizers_payload.h"
+#include "tokenizers_simd.h"
+#include "tokenizers_threads.h"
+
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
 namespace tokenizers {
 #ifdef ENABLE_TORCH
 	torch::Device global::CUDA0(torch::DeviceType::CUDA);
@@ -17,11 +27,14 @@ void copy(_T& src, _T& dst)
 	dst = src;
 }
 
-tokenizers::EncodingBatch tokenizers::Tokenizer::EncodeBatch(const std::vector<std::string_view>& texts, bool add_special_tokens)
+tokenizers::EncodingBatch tokenizers::Tokenizer::EncodeRows(const std::vector<std::string_view>& texts, bool add_special_tokens)
 {
 	EncodingBatch res;
 
-	res.encodings.reserve(texts.size());
+	if (texts.empty())
+		return res;
+
+	res.encodings.resize(texts.size());
 
 	do
 	{
@@ -29,16 +42,435 @@ tokenizers::EncodingBatch tokenizers::Tokenizer::EncodeBatch(const std::vector<s
 #ifdef ENABLE_TORCH
 		copy<tokenizers::options>(first, res);
 #endif // ENABLE_TORCH
-		res.encodings.emplace_back(std::move(first));
+		res.encodings[0] = std::move(first);
 	} while (false);
 
+	ThreadPool::ParallelFor(texts.size() - 1, [&](size_t i) {
+		res.encodings[i + 1] = Encode(texts[i + 1], add_special_tokens);
+	});
+
+	return res;
+}
+
+tokenizers::Encoding tokenizers::Tokenizer::EncodeParallel(std::string_view text, bool add_special_tokens)
+{
+	return Encode(text, add_special_tokens);
+}
+
+tokenizers::EncodingBatch tokenizers::Tokenizer::EncodeBatch(const std::vector<std::string_view>& texts, bool add_special_tokens, IdType id_type)
+{
+	EncodingBatch res = EncodeRows(texts, add_special_tokens);
+	res.set_id_type(id_type);
+	res.update();
+	return res;
+}
+
+namespace
+{
+	// padded width of a row, the longest of its id arrays
+	size_t row_length(const tokenizers::EncodeAdvanced& e)
+	{
+		size_t len = 0;
+		if (e.ids.has_value())
+			len = std::max(len, e.ids->size());
+		if (e.attention_mask.has_value())
+			len = std::max(len, e.attention_mask->size());
+		if (e.type_ids.has_value())
+			len = std::max(len, e.type_ids->size());
+		return len;
+	}
+
+	template <class _Ty>
+	inline void padRow(const std::optional<tokenizers::array_view<uint32_t>>& src, size_t max_len, _Ty* row)
+	{
+		size_t len = src.has_value() ? src->size() : 0;
+		if (len)
+			std::copy(src->begin(), src->end(), row);
+		std::fill(row + len, row + max_len, _Ty(0));
+	}
+} // namespace
+
+// the ids, mask and type ids of each row are written together, one row per task
+void tokenizers::EncodingBatch::update()
+{
+	bool has[3] = {};
+	max_len = 0;
+	for (auto& e : encodings)
+	{
+		max_len = std::max(max_len, row_length(e));
+		has[0] |= e.ids.has_value();
+		has[1] |= e.attention_mask.has_value();
+		has[2] |= e.type_ids.has_value();
+	}
+
+	size_t total = encodings.size() * max_len;
+	std::optional<std::vector<uint32_t>>* plain[3] = { &ids, &attention_mask, &type_ids };
+	std::optional<IdBuffer>* typed[3] = { &typed_ids, &typed_attention_mask, &typed_type_ids };
+	void* buffers[3] = {};
+	for (size_t f = 0; f < 3; ++f)
+	{
+		if (!has[f])
+			continue;
+		if (id_type == IdType::kUInt32)
+		{
+			*plain[f] = std::vector<uint32_t>(total);
+			buffers[f] = (*plain[f])->data();
+		}
+		else
+		{
+			*typed[f] = IdBuffer(id_type, total);
+			buffers[f] = (*typed[f])->data();
+		}
+	}
+
+	ThreadPool::ParallelFor(encodings.size(), [&](size_t i) {
+		const EncodeAdvanced& e = encodings[i];
+		const std::optional<array_view<uint32_t>>* fields[3] = { &e.ids, &e.attention_mask, &e.type_ids };
+		for (size_t f = 0; f < 3; ++f)
+		{
+			if (!buffers[f])
+				continue;
+			switch (id_type)
+			{
+			case IdType::kInt32:
+				padRow(*fields[f], max_len, static_cast<int32_t*>(buffers[f]) + i * max_len);
+				break;
+			case IdType::kInt64:
+				padRow(*fields[f], max_len, static_cast<int64_t*>(buffers[f]) + i * max_len);
+				break;
+			default:
+				padRow(*fields[f], max_len, static_cast<uint32_t*>(buffers[f]) + i * max_len);
+				break;
+			}
+		}
+	});
+}
+
+std::vector<tokenizers::EncodingBatch> tokenizers::Tokenizer::EncodeBatch(const std::vector<std::string_view>& texts, const BatchSchedule& schedule, bool add_special_tokens, IdType id_type)
+{
+	EncodingBatch rows = EncodeRows(texts, add_special_tokens);
+	size_t n = rows.encodings.size();
+
+	std::vector<size_t> lengths(n), order(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		lengths[i] = row_length(rows.encodings[i]);
+		order[i] = i;
+	}
+
+	size_t bucket_width = std::max<size_t>(schedule.bucket_width, 1);
+	auto bucket = [&](size_t i) { return lengths[i] / bucket_width; };
+	switch (schedule.order)
+	{
+	case BatchSchedule::Order::kSorted:
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+		break;
+	case BatchSchedule::Order::kBucketed:
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bucket(a) < bucket(b); });
+		break;
+	default:
+		break;
+	}
+
+	std::vector<EncodingBatch> batches;
+	size_t begin = 0;
+	while (begin < n)
+	{
+		// grow the sub-batch while its padded size stays under the budgets
+		size_t end = begin + 1, max_len = lengths[order[begin]];
+		for (; end < n; ++end)
+		{
+			size_t i = order[end];
+			size_t rows_after = end - begin + 1, len_after = std::max(max_len, lengths[i]);
+			if (schedule.max_rows && rows_after > schedule.max_rows)
+				break;
+			if (schedule.max_tokens && rows_after * len_after > schedule.max_tokens)
+				break;
+			if (schedule.order == BatchSchedule::Order::kBucketed && bucket(i) != bucket(order[begin]))
+				break;
+			max_len = len_after;
+		}
+
+		EncodingBatch batch;
+#ifdef ENABLE_TORCH
+		copy<tokenizers::options>(rows, batch);
+#endif // ENABLE_TORCH
+		// rows keep pointing into the payload of the whole batch
+		batch.payload = rows.payload;
+		batch.set_id_type(id_type);
+		batch.encodings.reserve(end - begin);
+		batch.permutation.assign(order.begin() + begin, order.begin() + end);
+		for (size_t i : batch.permutation)
+			batch.encodings.push_back(rows.encodings[i]);
+		batch.update();
+
+		batches.emplace_back(std::move(batch));
+		begin = end;
+	}
+
+	return batches;
+}
+
+namespace
+{
+	// lengths the sequences of a pair are cut to, the same rules as the Rust side
+	std::pair<size_t, size_t> pairLengths(size_t n1, size_t n2, size_t max_length, tokenizers::TruncationStrategy truncation)
+	{
+		if (n1 + n2 <= max_length)
+			return { n1, n2 };
+		if (truncation == tokenizers::TruncationStrategy::kOnlySecond)
+			return { n1, n1 >= max_length ? 0 : max_length - n1 };
+
+		// the longer one is cut to what the shorter leaves, or both to half
+		size_t shorter = std::min(n1, n2);
+		size_t short_len = shorter, long_len = shorter > max_length ? shorter : std::max(shorter, max_length - shorter);
+		if (short_len + long_len > max_length)
+		{
+			short_len = max_length / 2;
+			long_len = short_len + max_length % 2;
+		}
+		return n1 <= n2 ? std::make_pair(short_len, long_len) : std::make_pair(long_len, short_len);
+	}
+
+} // namespace
+
+tokenizers::EncodingBatch tokenizers::Tokenizer::EncodePairRows(const std::vector<std::string_view>& firsts,
+	const std::vector<size_t>& first_index, const std::vector<std::string_view>& seconds,
+	[[maybe_unused]] bool add_special_tokens, size_t max_length, TruncationStrategy truncation)
+{
+	// without a pair template the sequences are joined as they are, add_special_tokens has no effect
+	std::vector<Encoding> first_encodings(firsts.size()), second_encodings(seconds.size());
+	ThreadPool::ParallelFor(firsts.size() + seconds.size(), [&](size_t i) {
+		if (i < firsts.size())
+			first_encodings[i] = Encode(firsts[i], false);
+		else
+			second_encodings[i - firsts.size()] = Encode(seconds[i - firsts.size()], false);
+	});
+
+	// each row holds its ids, type_ids, attention_mask and special_tokens_mask
+	auto rows = make_payload<std::vector<std::vector<uint32_t>>>(seconds.size());
+	EncodingBatch res;
+	res.payload = rows;
+	res.encodings.resize(seconds.size());
+	ThreadPool::ParallelFor(seconds.size(), [&](size_t i) {
+		array_view<uint32_t> a = first_encodings[first_index[i]].ids.value_or(array_view<uint32_t>());
+		array_view<uint32_t> b = second_encodings[i].ids.value_or(array_view<uint32_t>());
+		auto [n1, n2] = max_length ? pairLengths(a.size(), b.size(), max_length, truncation) : std::make_pair(a.size(), b.size());
+
+		size_t len = n1 + n2;
+		std::vector<uint32_t>& row = (*rows)[i];
+		row.assign(4 * len, 0);
+		std::copy(a.begin(), a.begin() + n1, row.begin());
+		std::copy(b.begin(), b.begin() + n2, row.begin() + n1);
+		std::fill(row.begin() + len + n1, row.begin() + 3 * len, 1u);
 
-	for (size_t i = 1; i < texts.size(); ++i)
+		const uint32_t* data = row.data();
+		res.encodings[i] = { BaseEncode{ .ids = array_view<uint32_t>(data, len),
+			.type_ids = array_view<uint32_t>(data + len, len),
+			.special_tokens_mask = array_view<uint32_t>(data + 3 * len, len),
+			.attention_mask = array_view<uint32_t>(data + 2 * len, len) }, {} };
+	});
+
+	return res;
+}
+
+tokenizers::Encoding tokenizers::Tokenizer::EncodePair(std::string_view first, std::string_view second,
+	bool add_special_tokens, size_t max_length, TruncationStrategy truncation)
+{
+	EncodingBatch rows = EncodePairRows({ first }, { 0 }, { second }, add_special_tokens, max_length, truncation);
+
+	Encoding res;
+	static_cast<EncodeAdvanced&>(res) = rows.encodings[0];
+	res.payload = rows.payload;
+	return res;
+}
+
+tokenizers::EncodingBatch tokenizers::Tokenizer::EncodePairBatch(const std::vector<std::string_view>& firsts,
+	const std::vector<std::string_view>& seconds, bool add_special_tokens, size_t max_length,
+	TruncationStrategy truncation, IdType id_type)
+{
+	if (firsts.size() != seconds.size() && firsts.size() != 1)
+		throw std::invalid_argument("EncodePairBatch: firsts must hold one text per second, or a single text");
+
+	// equal firsts, e.g. one query against many passages, are encoded once
+	std::vector<std::string_view> distinct;
+	std::vector<size_t> first_index(seconds.size());
+	std::unordered_map<std::string_view, size_t> seen;
+	for (size_t i = 0; i < seconds.size(); ++i)
 	{
-		res.encodings.emplace_back(Encode(texts[i], add_special_tokens));
+		auto [it, inserted] = seen.try_emplace(firsts[firsts.size() == 1 ? 0 : i], distinct.size());
+		if (inserted)
+			distinct.push_back(it->first);
+		first_index[i] = it->second;
 	}
 
+	EncodingBatch res = EncodePairRows(distinct, first_index, seconds, add_special_tokens, max_length, truncation);
+	res.set_id_type(id_type);
 	res.update();
+	return res;
+}
+
+tokenizers::Decoding tokenizers::Tokenizer::IdToToken(uint32_t token_id)
+{
+	Decoding result;
+	if (vocab_table_)
+	{
+		result.payload = vocab_table_->IdToToken(token_id);
+		result.handle = vocab_table_;
+	}
+	return result;
+}
+
+uint32_t tokenizers::Tokenizer::TokenToId(std::string_view token)
+{
+	return vocab_table_ ? vocab_table_->TokenToId(token) : VocabTable::kNotFound;
+}
+
+void tokenizers::Tokenizer::SetAddedTokens(const std::vector<std::string_view>& tokens)
+{
+	std::vector<uint32_t> ids(tokens.size());
+	for (size_t i = 0; i < tokens.size(); ++i)
+	{
+		// the table rather than TokenToId, which maps unknown pieces to the unknown
+		// id for sentencepiece
+		ids[i] = vocab_table_ ? vocab_table_->TokenToId(tokens[i]) : VocabTable::kNotFound;
+		if (ids[i] == VocabTable::kNotFound)
+			throw std::runtime_error("SetAddedTokens: " + std::string(tokens[i]) + " is not in the vocabulary");
+	}
+	added_tokens_ = tokens.empty() ? nullptr : std::make_shared<AddedTokenSplitter>(tokens, ids);
+	// special tokens decode to empty bytes
+	ResetLazyTables();
+}
+
+struct tokenizers::Tokenizer::LazyTables
+{
+	std::mutex mutex;
+	std::shared_ptr<const VocabTable> decoded_vocab;
+	std::shared_ptr<const TokenBytesIndex> token_bytes_index;
+};
+
+std::shared_ptr<tokenizers::Tokenizer::LazyTables> tokenizers::Tokenizer::MakeLazyTables()
+{
+	return std::make_shared<LazyTables>();
+}
+
+std::shared_ptr<tokenizers::VocabTable> tokenizers::Tokenizer::BuildDecodedVocab()
+{
+	return vocab_table_;
+}
+
+void tokenizers::Tokenizer::SetDecodedVocab(std::shared_ptr<const VocabTable> decoded)
+{
+	std::unique_lock<std::mutex> lock(lazy_tables_->mutex);
+	lazy_tables_->decoded_vocab = std::move(decoded);
+}
+
+void tokenizers::Tokenizer::ResetLazyTables()
+{
+	std::unique_lock<std::mutex> lock(lazy_tables_->mutex);
+	lazy_tables_->decoded_vocab = nullptr;
+	lazy_tables_->token_bytes_index = nullptr;
+}
+
+std::shared_ptr<const tokenizers::VocabTable> tokenizers::Tokenizer::GetDecodedVocab()
+{
+	std::unique_lock<std::mutex> lock(lazy_tables_->mutex);
+	if (!lazy_tables_->decoded_vocab)
+		lazy_tables_->decoded_vocab = BuildDecodedVocab();
+	return lazy_tables_->decoded_vocab;
+}
+
+std::shared_ptr<const tokenizers::TokenBytesIndex> tokenizers::Tokenizer::GetTokenBytesIndex()
+{
+	auto decoded = GetDecodedVocab();
+	std::unique_lock<std::mutex> lock(lazy_tables_->mutex);
+	if (!lazy_tables_->token_bytes_index)
+		lazy_tables_->token_bytes_index = std::make_shared<TokenBytesIndex>(decoded);
+	return lazy_tables_->token_bytes_index;
+}
+
+tokenizers::MemoryReport tokenizers::Tokenizer::MemoryUsage()
+{
+	MemoryReport report;
+	if (vocab_table_)
+		report.components.push_back({ "vocab_table", vocab_table_->MemoryUsage() });
+
+	std::unique_lock<std::mutex> lock(lazy_tables_->mutex);
+	if (lazy_tables_->decoded_vocab && lazy_tables_->decoded_vocab != vocab_table_)
+		report.components.push_back({ "decoded_vocab", lazy_tables_->decoded_vocab->MemoryUsage() });
+	if (lazy_tables_->token_bytes_index)
+		report.components.push_back({ "token_bytes_index", lazy_tables_->token_bytes_index->MemoryUsage() });
+	if (encode_cache_)
+		report.components.push_back({ "encode_cache", encode_cache_->MemoryUsage() });
+	return report;
+}
+
+std::atomic<size_t> tokenizers::outstanding_payloads = 0;
+
+size_t tokenizers::Tokenizer::OutstandingPayloads()
+{
+	return outstanding_payloads.load(std::memory_order_relaxed);
+}
+
+std::atomic<uint64_t> tokenizers::guard_pieces_split = 0;
+std::atomic<uint64_t> tokenizers::guard_budget_exceeded = 0;
+
+void tokenizers::Tokenizer::SetEncodeGuard(const EncodeGuard& guard)
+{
+	encode_guard_ = guard;
+}
+
+void tokenizers::Tokenizer::SetEncodeCache(size_t capacity)
+{
+	encode_cache_ = capacity ? std::make_shared<EncodeCache>(capacity) : nullptr;
+}
+
+tokenizers::EncodeGuardStats tokenizers::Tokenizer::GetEncodeGuardStats()
+{
+	// the Rust backend counts its own triggers
+	rust::EncodeGuardStats rust_stats = tokenizers_encode_guard_stats();
+	EncodeGuardStats stats;
+	stats.pieces_split = guard_pieces_split.load(std::memory_order_relaxed) + rust_stats.pieces_split;
+	stats.budget_exceeded = guard_budget_exceeded.load(std::memory_order_relaxed) + rust_stats.budget_exceeded;
+	return stats;
+}
+
+tokenizers::StreamDecoder::StreamDecoder(Tokenizer& tokenizer, std::shared_ptr<const StopSequenceMatcher> stop)
+	: decoded_(tokenizer.GetDecodedVocab()), stop_(std::move(stop))
+{
+}
+
+tokenizers::StreamDecoder::Step tokenizers::StreamDecoder::Put(uint32_t token_id)
+{
+	Step step = { decoded_->IdToToken(token_id), std::nullopt };
+	if (stop_ && !stopped_)
+	{
+		step.stop = stop_->Feed(state_, step.bytes);
+		stopped_ = step.stop.has_value();
+	}
+	return step;
+}
+
+void tokenizers::StreamDecoder::Reset()
+{
+	state_ = StopSequenceMatcher::State();
+	stopped_ = false;
+}
+
+// backends with a counting path override this, the default has nothing to stop early
+size_t tokenizers::Tokenizer::CountTokens(std::string_view text, bool add_special_tokens, [[maybe_unused]] size_t limit)
+{
+	auto encoding = Encode(text, add_special_tokens);
+	return encoding.ids.has_value() ? encoding.ids->size() : 0;
+}
+
+std::vector<size_t> tokenizers::Tokenizer::CountTokensBatch(const std::vector<std::string_view>& texts, bool add_special_tokens, size_t limit)
+{
+	std::vector<size_t> res(texts.size());
+
+	ThreadPool::ParallelFor(texts.size(), [&](size_t i) {
+		res[i] = CountTokens(texts[i], add_special_tokens, limit);
+	});
 
 	return res;
 }
@@ -81,7 +513,7 @@ inline std::vector<tokenizers::array_view<uint32_t>> vecToView(const std::vector
 	res.reserve(vec.size());
 	for (size_t i = 0; i < vec.size(); ++i)
 	{
-		auto& sub = vec[0];
+		auto& sub = vec[i];
 		res.emplace_back(sub.data(), sub.size());
 	}
 	return res;
@@ -134,18 +566,354 @@ tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatch(const torch::Tensor
 tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatch(
 	const std::vector<tokenizers::array_view<uint32_t>>& ids_batch, bool skip_special_token)
 {
-	tokenizers::DecodingBatch res;
-	res.reserve(ids_batch.size());
+	tokenizers::DecodingBatch res(ids_batch.size());
 
-	for (size_t i = 0; i < ids_batch.size(); ++i)
-	{
-		res.emplace_back(Decode(ids_batch[i], skip_special_token));
-	}
+	ThreadPool::ParallelFor(ids_batch.size(), [&](size_t i) {
+		res[i] = Decode(ids_batch[i], skip_special_token);
+		// payload views buff, whose inline short-string storage moved with it
+		if (res[i].buff.has_value())
+			res[i].payload = res[i].buff.value();
+	});
 
 	return res;
 }
 
+size_t tokenizers::Tokenizer::DecodeInto(array_view<uint32_t> ids, std::string& out, bool skip_special_token)
+{
+	Decoding decoding = Decode(ids, skip_special_token);
+	out.assign(decoding.payload);
+	return out.size();
+}
+
+size_t tokenizers::Tokenizer::DecodeBatchInto(const std::vector<array_view<uint32_t>>& ids_batch,
+	std::string& out, std::vector<size_t>& offsets, bool skip_special_token)
+{
+	DecodingBatch decodings = DecodeBatch(ids_batch, skip_special_token);
+	out.clear();
+	offsets.assign(1, 0);
+	for (auto& decoding : decodings)
+	{
+		out.append(decoding.payload);
+		offsets.push_back(out.size());
+	}
+	return out.size();
+}
+
 tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatch(
 	const std::vector<std::vector<uint32_t>>& ids_batch, bool skip_special_token) {
 	return DecodeBatch(vecToView(ids_batch), skip_special_token);
 }
+
+// [begin, end) of each row of a row-major matrix, without the runs of pad at both ends
+template <class _Ty>
+inline std::vector<std::pair<size_t, size_t>> validSpans(const _Ty* data, size_t rows, size_t cols, _Ty pad)
+{
+	std::vector<std::pair<size_t, size_t>> spans(rows, { 0, 0 });
+	for (size_t i = 0; i < rows; ++i)
+	{
+		const _Ty* row = data + i * cols;
+		size_t begin = tokenizers::simd::find_first_not_equal(row, cols, pad);
+		if (begin != cols)
+			spans[i] = { begin, tokenizers::simd::find_last_not_equal(row, cols, pad) + 1 };
+	}
+	return spans;
+}
+
+tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatchPadded(
+	array_view<uint32_t> ids_batch, size_t cols, uint32_t pad_id, bool skip_special_token)
+{
+	size_t rows = cols ? ids_batch.size() / cols : 0;
+	auto spans = validSpans(ids_batch.data(), rows, cols, pad_id);
+
+	std::vector<array_view<uint32_t>> views;
+	views.reserve(rows);
+	for (size_t i = 0; i < rows; ++i)
+	{
+		views.emplace_back(ids_batch.data() + i * cols + spans[i].first, spans[i].second - spans[i].first);
+	}
+	return DecodeBatch(views, skip_special_token);
+}
+
+#ifdef ENABLE_TORCH
+// rows x cols view of a tensor on the cpu, a 1-D tensor is a single row
+inline torch::Tensor cpuMatrix(const torch::Tensor& t)
+{
+	auto res = t.to(tokenizers::global::CPU).contiguous();
+	return res.dim() == 1 ? res.unsqueeze(0) : res;
+}
+
+// decode the given span of each row; int64 ids are narrowed span by span
+inline tokenizers::DecodingBatch decodeSpans(tokenizers::Tokenizer& tokenizer,
+	const torch::Tensor& ids,
+	const std::vector<std::pair<size_t, size_t>>& spans,
+	bool skip_special_token)
+{
+	size_t cols = ids.size(1);
+	std::vector<tokenizers::array_view<uint32_t>> views;
+	views.reserve(spans.size());
+
+	if (ids.dtype() == torch::kUInt32 || ids.dtype() == torch::kInt32)
+	{
+		auto data = reinterpret_cast<const uint32_t*>(ids.data_ptr());
+		for (size_t i = 0; i < spans.size(); ++i)
+			views.emplace_back(data + i * cols + spans[i].first, spans[i].second - spans[i].first);
+		return tokenizer.DecodeBatch(views, skip_special_token);
+	}
+
+	torch::Tensor ids64 = ids.dtype() == torch::kInt64 ? ids : ids.to(torch::kInt64);
+	auto data = reinterpret_cast<const int64_t*>(ids64.data_ptr());
+
+	size_t total = 0;
+	for (auto& span : spans)
+		total += span.second - span.first;
+
+	std::vector<uint32_t> narrowed(total);
+	uint32_t* out = narrowed.data();
+	for (size_t i = 0; i < spans.size(); ++i)
+	{
+		const int64_t* row = data + i * cols;
+		for (size_t j = spans[i].first; j < spans[i].second; ++j)
+			out[j - spans[i].first] = static_cast<uint32_t>(row[j]);
+		views.emplace_back(out, spans[i].second - spans[i].first);
+		out += spans[i].second - spans[i].first;
+	}
+	return tokenizer.DecodeBatch(views, skip_special_token);
+}
+
+template <class _Ty>
+inline std::vector<std::pair<size_t, size_t>> maskSpans(const torch::Tensor& mask)
+{
+	return validSpans(reinterpret_cast<const _Ty*>(mask.data_ptr()), mask.size(0), mask.size(1), _Ty(0));
+}
+
+tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatch(
+	const torch::Tensor& ids_batch, const torch::Tensor& attention_mask, bool skip_special_token)
+{
+	auto ids = cpuMatrix(ids_batch);
+	auto mask = cpuMatrix(attention_mask);
+
+	// zero is all-zero bytes in every dtype, so only the element width matters
+	std::vector<std::pair<size_t, size_t>> spans;
+	switch (mask.element_size())
+	{
+	case 1:
+		spans = maskSpans<uint8_t>(mask);
+		break;
+	case 2:
+		spans = maskSpans<uint16_t>(mask);
+		break;
+	case 4:
+		spans = maskSpans<uint32_t>(mask);
+		break;
+	default:
+		spans = maskSpans<uint64_t>(mask.to(torch::kInt64));
+		break;
+	}
+	return decodeSpans(*this, ids, spans, skip_special_token);
+}
+
+tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatchPadded(
+	const torch::Tensor& ids_batch, uint32_t pad_id, bool skip_special_token)
+{
+	auto ids = cpuMatrix(ids_batch);
+	if (ids.dtype() != torch::kUInt32 && ids.dtype() != torch::kInt32 && ids.dtype() != torch::kInt64)
+		ids = ids.to(torch::kInt64);
+
+	std::vector<std::pair<size_t, size_t>> spans;
+	if (ids.dtype() == torch::kInt64)
+		spans = validSpans(reinterpret_cast<const int64_t*>(ids.data_ptr()), ids.size(0), ids.size(1), int64_t(pad_id));
+	else
+		spans = validSpans(reinterpret_cast<const uint32_t*>(ids.data_ptr()), ids.size(0), ids.size(1), pad_id);
+	return decodeSpans(*this, ids, spans, skip_special_token);
+}
+#endif // ENABLE_TORCH
+
+#ifdef ENABLE_DLPACK
+namespace
+{
+	// the tensor and the batch sharing its buffer
+	struct DLPackContext
+	{
+		DLManagedTensor managed = {};
+		std::shared_ptr<tokenizers::EncodingBatch> batch;
+		int64_t shape[2] = {};
+	};
+
+	// rows x cols elements of a compact row-major CPU tensor, a 1-D tensor is a single row
+	struct DLMatrix
+	{
+		const char* data = nullptr;
+		size_t rows = 0;
+		size_t cols = 0;
+		size_t element_bytes = 0;
+	};
+
+	DLMatrix dlMatrix(const DLTensor& t, const char* what)
+	{
+		if (t.device.device_type != kDLCPU && t.device.device_type != kDLCUDAHost)
+			throw std::invalid_argument(std::string("DecodeBatch: ") + what + " is not in host memory");
+		if ((t.ndim != 1 && t.ndim != 2) || t.dtype.lanes != 1 || t.dtype.bits % 8)
+			throw std::invalid_argument(std::string("DecodeBatch: ") + what + " is not a matrix of scalars");
+
+		DLMatrix m;
+		m.rows = t.ndim == 1 ? 1 : static_cast<size_t>(t.shape[0]);
+		m.cols = static_cast<size_t>(t.shape[t.ndim - 1]);
+		m.element_bytes = t.dtype.bits / 8;
+		m.data = static_cast<const char*>(t.data) + t.byte_offset;
+		// NULL strides mean compact row-major, explicit ones must say the same
+		bool compact = !t.strides || (t.strides[t.ndim - 1] == 1 && (t.ndim == 1 || m.rows <= 1 ||
+			t.strides[0] == static_cast<int64_t>(m.cols)));
+		if (!compact)
+			throw std::invalid_argument(std::string("DecodeBatch: ") + what + " is not compact row-major");
+		return m;
+	}
+
+	DLMatrix dlIds(const DLTensor& t)
+	{
+		DLMatrix m = dlMatrix(t, "ids_batch");
+		if ((t.dtype.code != kDLInt && t.dtype.code != kDLUInt) || (t.dtype.bits != 32 && t.dtype.bits != 64))
+			throw std::invalid_argument("DecodeBatch: ids_batch must hold 32 or 64-bit integers");
+		return m;
+	}
+
+	DLMatrix dlMask(const DLTensor& t)
+	{
+		DLMatrix m = dlMatrix(t, "attention_mask");
+		// a float mask with -0.0 or NaN padding would not compare by its bytes
+		if (t.dtype.code != kDLInt && t.dtype.code != kDLUInt && t.dtype.code != kDLBool)
+			throw std::invalid_argument("DecodeBatch: attention_mask must hold integers or bools");
+		return m;
+	}
+
+	// decode the given span of each row; 64-bit ids are narrowed span by span
+	tokenizers::DecodingBatch decodeSpans(tokenizers::Tokenizer& tokenizer, const DLMatrix& ids,
+		const std::vector<std::pair<size_t, size_t>>& spans, bool skip_special_token)
+	{
+		std::vector<tokenizers::array_view<uint32_t>> views;
+		views.reserve(spans.size());
+		if (ids.element_bytes == 4)
+		{
+			auto data = reinterpret_cast<const uint32_t*>(ids.data);
+			for (size_t i = 0; i < spans.size(); ++i)
+				views.emplace_back(data + i * ids.cols + spans[i].first, spans[i].second - spans[i].first);
+			return tokenizer.DecodeBatch(views, skip_special_token);
+		}
+
+		size_t total = 0;
+		for (auto& span : spans)
+			total += span.second - span.first;
+
+		auto data = reinterpret_cast<const int64_t*>(ids.data);
+		std::vector<uint32_t> narrowed(total);
+		uint32_t* out = narrowed.data();
+		for (size_t i = 0; i < spans.size(); ++i)
+		{
+			const int64_t* row = data + i * ids.cols;
+			for (size_t j = spans[i].first; j < spans[i].second; ++j)
+				out[j - spans[i].first] = static_cast<uint32_t>(row[j]);
+			views.emplace_back(out, spans[i].second - spans[i].first);
+			out += spans[i].second - spans[i].first;
+		}
+		return tokenizer.DecodeBatch(views, skip_special_token);
+	}
+} // namespace
+
+DLManagedTensor* tokenizers::ToDLPack(std::shared_ptr<EncodingBatch> batch, BatchTensor tensor)
+{
+	batch->updateOnce();
+
+	std::optional<std::vector<uint32_t>>* plain = nullptr;
+	std::optional<IdBuffer>* typed = nullptr;
+	switch (tensor)
+	{
+	case BatchTensor::kIds:
+		plain = &batch->ids;
+		typed = &batch->typed_ids;
+		break;
+	case BatchTensor::kAttentionMask:
+		plain = &batch->attention_mask;
+		typed = &batch->typed_attention_mask;
+		break;
+	default:
+		plain = &batch->type_ids;
+		typed = &batch->typed_type_ids;
+		break;
+	}
+
+	void* data = nullptr;
+	DLDataType dtype = { static_cast<uint8_t>(kDLUInt), 32, 1 };
+	if (typed->has_value())
+	{
+		data = (*typed)->data();
+		dtype.code = kDLInt;
+		dtype.bits = static_cast<uint8_t>(IdBuffer::element_size((*typed)->type()) * 8);
+	}
+	else if (plain->has_value())
+	{
+		data = (*plain)->data();
+	}
+	else
+	{
+		return nullptr;
+	}
+
+	auto context = new DLPackContext();
+	context->shape[0] = static_cast<int64_t>(batch->encodings.size());
+	context->shape[1] = static_cast<int64_t>(batch->max_len);
+	context->batch = std::move(batch);
+
+	DLTensor& dl = context->managed.dl_tensor;
+	dl.data = data;
+	dl.device = { kDLCPU, 0 };
+	dl.ndim = 2;
+	dl.dtype = dtype;
+	dl.shape = context->shape;
+	dl.strides = nullptr;
+	dl.byte_offset = 0;
+	context->managed.manager_ctx = context;
+	context->managed.deleter = [](DLManagedTensor* self) { delete static_cast<DLPackContext*>(self->manager_ctx); };
+	return &context->managed;
+}
+
+tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatchPadded(
+	const DLTensor& ids_batch, uint32_t pad_id, bool skip_special_token)
+{
+	DLMatrix ids = dlIds(ids_batch);
+	std::vector<std::pair<size_t, size_t>> spans;
+	if (ids.element_bytes == 8)
+		spans = validSpans(reinterpret_cast<const int64_t*>(ids.data), ids.rows, ids.cols, int64_t(pad_id));
+	else
+		spans = validSpans(reinterpret_cast<const uint32_t*>(ids.data), ids.rows, ids.cols, pad_id);
+	return decodeSpans(*this, ids, spans, skip_special_token);
+}
+
+tokenizers::DecodingBatch tokenizers::Tokenizer::DecodeBatch(
+	const DLTensor& ids_batch, const DLTensor& attention_mask, bool skip_special_token)
+{
+	DLMatrix ids = dlIds(ids_batch);
+	DLMatrix mask = dlMask(attention_mask);
+	if (mask.rows != ids.rows || mask.cols != ids.cols)
+		throw std::invalid_argument("DecodeBatch: attention_mask and ids_batch differ in shape");
+
+	// zero is all-zero bytes in every dtype, so only the element width matters
+	std::vector<std::pair<size_t, size_t>> spans;
+	switch (mask.element_bytes)
+	{
+	case 1:
+		spans = validSpans(reinterpret_cast<const uint8_t*>(mask.data), mask.rows, mask.cols, uint8_t(0));
+		break;
+	case 2:
+		spans = validSpans(reinterpret_cast<const uint16_t*>(mask.data), mask.rows, mask.cols, uint16_t(0));
+		break;
+	case 4:
+		spans = validSpans(reinterpret_cast<const uint32_t*>(mask.data), mask.rows, mask.cols, uint32_t(0));
+		break;
+	case 8:
+		spans = validSpans(reinterpret_cast<const uint64_t*>(mask.data), mask.rows, mask.cols, uint64_t(0));
+		break;
+	default:
+		throw std::invalid_argument("DecodeBatch: attention_mask must hold 8 to 64-bit elements");
+	}
+	return decodeSpans(*this, ids, spans, skip_special_token);
+}
+#endif // ENABLE_DLPACK
@@ -0,0 +1,271 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_dataset.cc
+ */
+#include "tokenizers_dataset.h"
+
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tokenizers
+{
+	namespace
+	{
+		constexpr uint64_t kAlignment = 64;
+
+		inline uint64_t align_up(uint64_t n)
+		{
+			return (n + kAlignment - 1) & ~(kAlignment - 1);
+		}
+
+		// files are little-endian and read in place, which a big-endian host cannot do
+		inline void check_little_endian(const char* name)
+		{
+			if constexpr (std::endian::native != std::endian::little)
+				throw std::runtime_error(std::string(name) + ": dataset files need a little-endian host");
+		}
+	} // namespace
+
+	TokenizedDatasetWriter::TokenizedDatasetWriter(const std::string& path, size_t vocab_size, bool with_metadata)
+		: with_metadata_(with_metadata)
+	{
+		check_little_endian("TokenizedDatasetWriter");
+		header_.vocab_size = vocab_size;
+		header_.id_bytes = vocab_size <= std::numeric_limits<uint16_t>::max() + size_t(1) ? 2 : 4;
+
+		file_ = std::fopen(path.c_str(), "wb");
+		if (!file_)
+			throw std::runtime_error("TokenizedDatasetWriter: cannot create " + path);
+		// the header stays zero, and the file unreadable, until Finish
+		DatasetHeader blank;
+		Write(&blank, sizeof(blank));
+		header_.ids_offset = position_;
+	}
+
+	TokenizedDatasetWriter::~TokenizedDatasetWriter()
+	{
+		if (file_)
+			std::fclose(file_);
+	}
+
+	void TokenizedDatasetWriter::Write(const void* data, size_t bytes)
+	{
+		if (!file_)
+			throw std::runtime_error("TokenizedDatasetWriter: already finished");
+		if (bytes && std::fwrite(data, 1, bytes, file_) != bytes)
+			throw std::runtime_error("TokenizedDatasetWriter: write failed");
+		position_ += bytes;
+	}
+
+	void TokenizedDatasetWriter::Pad()
+	{
+		static const char kZeros[kAlignment] = {};
+		Write(kZeros, align_up(position_) - position_);
+	}
+
+	void TokenizedDatasetWriter::Add(array_view<uint32_t> ids, std::string_view metadata)
+	{
+		for (uint32_t id : ids)
+		{
+			if (id >= header_.vocab_size)
+				throw std::invalid_argument("TokenizedDatasetWriter: id " + std::to_string(id) + " is out of the vocabulary");
+		}
+
+		if (header_.id_bytes == 2)
+		{
+			narrow_.assign(ids.begin(), ids.end());
+			Write(narrow_.data(), narrow_.size() * sizeof(uint16_t));
+		}
+		else
+		{
+			Write(ids.data(), ids.size() * sizeof(uint32_t));
+		}
+		token_offsets_.push_back(token_offsets_.back() + ids.size());
+
+		if (with_metadata_)
+		{
+			metadata_.append(metadata);
+			metadata_offsets_.push_back(metadata_.size());
+		}
+	}
+
+	void TokenizedDatasetWriter::Add(const Encoding& encoding, std::string_view metadata)
+	{
+		Add(encoding.ids.value_or(array_view<uint32_t>()), metadata);
+	}
+
+	void TokenizedDatasetWriter::Finish()
+	{
+		header_.num_documents = NumDocuments();
+		header_.num_tokens = token_offsets_.back();
+
+		Pad();
+		header_.index_offset = position_;
+		Write(token_offsets_.data(), token_offsets_.size() * sizeof(uint64_t));
+
+		if (with_metadata_)
+		{
+			Pad();
+			header_.metadata_offset = position_;
+			Write(metadata_offsets_.data(), metadata_offsets_.size() * sizeof(uint64_t));
+			Write(metadata_.data(), metadata_.size());
+		}
+
+		std::memcpy(header_.magic, DatasetHeader::kMagic, sizeof(header_.magic));
+		bool ok = std::fflush(file_) == 0 && std::fseek(file_, 0, SEEK_SET) == 0 &&
+			std::fwrite(&header_, sizeof(header_), 1, file_) == 1;
+		ok = std::fclose(file_) == 0 && ok;
+		file_ = nullptr;
+		if (!ok)
+			throw std::runtime_error("TokenizedDatasetWriter: write failed");
+	}
+
+	std::shared_ptr<const TokenizedDataset> TokenizedDataset::Open(const std::string& path)
+	{
+		check_little_endian("TokenizedDataset");
+		std::shared_ptr<TokenizedDataset> dataset(new TokenizedDataset());
+
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("TokenizedDataset: cannot open " + path);
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping)
+		{
+			dataset->data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (dataset->data_)
+				dataset->mapping_handle_ = mapping;
+			else
+				CloseHandle(mapping);
+		}
+		if (!dataset->data_)
+			throw std::runtime_error("TokenizedDataset: cannot map " + path);
+		dataset->size_ = static_cast<size_t>(size.QuadPart);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw std::runtime_error("TokenizedDataset: cannot open " + path);
+		struct stat st;
+		void* data = MAP_FAILED;
+		if (::fstat(fd, &st) == 0 && st.st_size > 0)
+			data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		// the mapping keeps the file open
+		::close(fd);
+		if (data == MAP_FAILED)
+			throw std::runtime_error("TokenizedDataset: cannot map " + path);
+		dataset->data_ = static_cast<const char*>(data);
+		dataset->size_ = static_cast<size_t>(st.st_size);
+#endif
+
+		// every offset is checked once here, so accessors only index
+		DatasetHeader& header = dataset->header_;
+		const uint64_t size = dataset->size_;
+		auto fits = [&](uint64_t offset, uint64_t count, uint64_t unit) {
+			return offset <= size && count <= (size - offset) / unit;
+		};
+		if (size < sizeof(DatasetHeader))
+			throw std::runtime_error("TokenizedDataset: " + path + " is not a dataset file");
+		std::memcpy(&header, dataset->data_, sizeof(header));
+		if (std::memcmp(header.magic, DatasetHeader::kMagic, sizeof(header.magic)) != 0)
+			throw std::runtime_error("TokenizedDataset: " + path + " is not a finished dataset file");
+		if (header.version != DatasetHeader::kVersion || (header.id_bytes != 2 && header.id_bytes != 4))
+			throw std::runtime_error("TokenizedDataset: unsupported version or id width in " + path);
+		if (header.ids_offset % kAlignment || header.index_offset % kAlignment || header.metadata_offset % kAlignment ||
+			!fits(header.ids_offset, header.num_tokens, header.id_bytes) ||
+			header.num_documents == std::numeric_limits<uint64_t>::max() ||
+			!fits(header.index_offset, header.num_documents + 1, sizeof(uint64_t)))
+			throw std::runtime_error("TokenizedDataset: " + path + " is truncated or corrupt");
+
+		dataset->index_ = reinterpret_cast<const uint64_t*>(dataset->data_ + header.index_offset);
+		const uint64_t* index = dataset->index_;
+		for (uint64_t i = 0; i < header.num_documents; ++i)
+		{
+			if (index[i] > index[i + 1])
+				throw std::runtime_error("TokenizedDataset: " + path + " has a corrupt index");
+		}
+		if (index[0] != 0 || index[header.num_documents] != header.num_tokens)
+			throw std::runtime_error("TokenizedDataset: " + path + " has a corrupt index");
+
+		if (header.metadata_offset)
+		{
+			if (!fits(header.metadata_offset, header.num_documents + 1, sizeof(uint64_t)))
+				throw std::runtime_error("TokenizedDataset: " + path + " is truncated or corrupt");
+			const uint64_t* offsets = reinterpret_cast<const uint64_t*>(dataset->data_ + header.metadata_offset);
+			uint64_t start = header.metadata_offset + (header.num_documents + 1) * sizeof(uint64_t);
+			for (uint64_t i = 0; i < header.num_documents; ++i)
+			{
+				if (offsets[i] > offsets[i + 1])
+					throw std::runtime_error("TokenizedDataset: " + path + " has corrupt metadata");
+			}
+			if (offsets[0] != 0 || !fits(start, offsets[header.num_documents], 1))
+				throw std::runtime_error("TokenizedDataset: " + path + " has corrupt metadata");
+			dataset->metadata_offsets_ = offsets;
+			dataset->metadata_ = dataset->data_ + start;
+		}
+		return dataset;
+	}
+
+	TokenizedDataset::~TokenizedDataset()
+	{
+		if (!data_)
+			return;
+#if defined(_WIN32)
+		UnmapViewOfFile(data_);
+		CloseHandle(static_cast<HANDLE>(mapping_handle_));
+#else
+		::munmap(const_cast<char*>(data_), size_);
+#endif
+	}
+
+	array_view<uint32_t> TokenizedDataset::Document(size_t i) const
+	{
+		if (header_.id_bytes != 4)
+			throw std::logic_error("TokenizedDataset: the file holds uint16 ids, use Document16 or CopyDocument");
+		const uint32_t* ids = reinterpret_cast<const uint32_t*>(data_ + header_.ids_offset);
+		return { ids + index_[i], DocumentLength(i) };
+	}
+
+	array_view<uint16_t> TokenizedDataset::Document16(size_t i) const
+	{
+		if (header_.id_bytes != 2)
+			throw std::logic_error("TokenizedDataset: the file holds uint32 ids, use Document");
+		const uint16_t* ids = reinterpret_cast<const uint16_t*>(data_ + header_.ids_offset);
+		return { ids + index_[i], DocumentLength(i) };
+	}
+
+	void TokenizedDataset::CopyDocument(size_t i, std::vector<uint32_t>& out) const
+	{
+		if (header_.id_bytes == 4)
+		{
+			array_view<uint32_t> ids = Document(i);
+			out.assign(ids.begin(), ids.end());
+		}
+		else
+		{
+			array_view<uint16_t> ids = Document16(i);
+			out.assign(ids.begin(), ids.end());
+		}
+	}
+
+	std::string_view TokenizedDataset::Metadata(size_t i) const
+	{
+		if (!metadata_offsets_)
+			return {};
+		return { metadata_ + metadata_offsets_[i], metadata_offsets_[i + 1] - metadata_offsets_[i] };
+	}
+} // namespace tokenizers
@@ -0,0 +1,128 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_guard.h
+ * \brief Encode guard helpers shared by the C++ tokenizer backends
+ */
+#ifndef TOKENIZERS_GUARD_H_
+#define TOKENIZERS_GUARD_H_
+
+#include <tokenizers_cpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+namespace tokenizers
+{
+	/*! \brief Trigger counts of the C++ backends, see Tokenizer::GetEncodeGuardStats. */
+	extern std::atomic<uint64_t> guard_pieces_split;
+	extern std::atomic<uint64_t> guard_budget_exceeded;
+
+	/*!
+	 * \brief Work and time left to one guarded call. Once either runs out it
+	 *  stays out and the backend falls back to its linear path.
+	 */
+	class EncodeBudget
+	{
+	public:
+		explicit inline EncodeBudget(const EncodeGuard& guard)
+			: work_left_(guard.work_budget ? guard.work_budget : std::numeric_limits<size_t>::max()),
+			timed_(guard.time_budget.count() > 0)
+		{
+			if (timed_)
+				deadline_ = std::chrono::steady_clock::now() + guard.time_budget;
+		}
+
+		inline bool Exceeded() const { return exceeded_; }
+
+		/*! \brief Account for len bytes matched by the model. */
+		inline void Spend(size_t len)
+		{
+			if (exceeded_)
+				return;
+			bool late = false;
+			// the clock is read once per kClockInterval bytes, not per token
+			if (timed_ && (since_clock_ += len) >= kClockInterval)
+			{
+				since_clock_ = 0;
+				late = std::chrono::steady_clock::now() >= deadline_;
+			}
+			if (late || len > work_left_)
+			{
+				exceeded_ = true;
+				guard_budget_exceeded.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			work_left_ -= len;
+		}
+
+	private:
+		static constexpr size_t kClockInterval = 1024;
+
+		size_t work_left_;
+		bool timed_;
+		bool exceeded_ = false;
+		size_t since_clock_ = 0;
+		std::chrono::steady_clock::time_point deadline_;
+	};
+
+	/*! \brief Byte length of the UTF-8 sequence lead starts, 1 for invalid leads. */
+	inline size_t utf8_sequence_length(unsigned char lead)
+	{
+		if (lead >= 0xF0 && lead < 0xF8)
+			return 4;
+		if (lead >= 0xE0)
+			return lead < 0xF0 ? 3 : 1;
+		if (lead >= 0xC0)
+			return 2;
+		return 1;
+	}
+
+	/*!
+	 * \brief fn(piece) for consecutive pieces of text: runs without ASCII
+	 *  whitespace longer than max_piece_bytes are cut into pieces of at most
+	 *  that many bytes at character boundaries, everything else stays whole.
+	 *  max_piece_bytes of 0 passes text as one piece.
+	 */
+	template <class _Fn>
+	inline void for_each_piece(std::string_view text, size_t max_piece_bytes, _Fn&& fn)
+	{
+		if (!max_piece_bytes || text.size() <= max_piece_bytes)
+		{
+			fn(text);
+			return;
+		}
+
+		size_t begin = 0, run = 0;
+		bool cut = false;
+		for (size_t i = 0; i < text.size();)
+		{
+			unsigned char c = static_cast<unsigned char>(text[i]);
+			if (c == ' ' || (c >= '\t' && c <= '\r'))
+			{
+				run = 0;
+				cut = false;
+				++i;
+				continue;
+			}
+			size_t len = std::min(utf8_sequence_length(c), text.size() - i);
+			if (run && run + len > max_piece_bytes)
+			{
+				if (!cut)
+					guard_pieces_split.fetch_add(1, std::memory_order_relaxed);
+				fn(text.substr(begin, i - begin));
+				begin = i;
+				run = 0;
+				cut = true;
+			}
+			run += len;
+			i += len;
+		}
+		fn(text.substr(begin));
+	}
+} // namespace tokenizers
+#endif // TOKENIZERS_GUARD_H_
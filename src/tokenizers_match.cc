@@ -0,0 +1,209 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_match.cc
+ */
+#include "tokenizers_match.h"
+
+#include "tokenizers_simd.h"
+
+#include <stdexcept>
+
+namespace tokenizers
+{
+	AhoCorasick::AhoCorasick(const std::vector<std::string_view>& patterns)
+	{
+		// one class per distinct pattern byte, class 0 for all other bytes
+		for (auto& pattern : patterns)
+		{
+			for (unsigned char c : pattern)
+			{
+				if (!classes_[c])
+				{
+					if (num_classes_ == 256)
+						throw std::runtime_error("AhoCorasick: too many distinct bytes");
+					classes_[c] = static_cast<uint8_t>(num_classes_++);
+				}
+			}
+		}
+
+		constexpr State kNone = static_cast<State>(-1);
+		transitions_.assign(num_classes_, kNone);
+
+		// trie of the patterns
+		pattern_lengths_.reserve(patterns.size());
+		for (size_t index = 0; index < patterns.size(); ++index)
+		{
+			auto& pattern = patterns[index];
+			pattern_lengths_.push_back(pattern.size());
+			if (pattern.empty())
+				continue;
+			if (pattern.size() > max_pattern_length_)
+				max_pattern_length_ = pattern.size();
+
+			State state = kRoot;
+			for (unsigned char c : pattern)
+			{
+				State& next = transitions_[state * num_classes_ + classes_[c]];
+				if (next == kNone)
+				{
+					next = static_cast<State>(outputs_.size());
+					transitions_.resize(transitions_.size() + num_classes_, kNone);
+					outputs_.push_back(-1);
+					depths_.push_back(depths_[state] + 1);
+				}
+				state = transitions_[state * num_classes_ + classes_[c]];
+			}
+			if (outputs_[state] < 0)
+				outputs_[state] = static_cast<int32_t>(index);
+		}
+
+		// breadth first: failure links folded into the dense table
+		std::vector<State> fail(outputs_.size(), kRoot);
+		std::vector<State> queue;
+		queue.reserve(outputs_.size());
+		for (uint32_t c = 0; c < num_classes_; ++c)
+		{
+			State& next = transitions_[c];
+			if (next == kNone)
+				next = kRoot;
+			else
+				queue.push_back(next);
+		}
+		for (size_t head = 0; head < queue.size(); ++head)
+		{
+			State state = queue[head];
+			// the longest pattern ending here is its own, or the one of its suffix
+			if (outputs_[state] < 0)
+				outputs_[state] = outputs_[fail[state]];
+
+			for (uint32_t c = 0; c < num_classes_; ++c)
+			{
+				State& next = transitions_[state * num_classes_ + c];
+				State fallback = transitions_[fail[state] * num_classes_ + c];
+				if (next == kNone)
+				{
+					next = fallback;
+				}
+				else
+				{
+					fail[next] = fallback;
+					queue.push_back(next);
+				}
+			}
+		}
+	}
+
+	StopSequenceMatcher::StopSequenceMatcher(const std::vector<std::string_view>& stop_strings)
+		: automaton_(stop_strings)
+	{
+	}
+
+	std::optional<StopSequenceMatcher::Match> StopSequenceMatcher::Feed(State& state, std::string_view bytes) const
+	{
+		state.token_lengths.push_back(static_cast<uint32_t>(bytes.size()));
+		state.recent_bytes += bytes.size();
+
+		for (size_t i = 0; i < bytes.size(); ++i)
+		{
+			state.node = automaton_.Next(state.node, static_cast<uint8_t>(bytes[i]));
+			int32_t index = automaton_.Output(state.node);
+			if (index < 0)
+				continue;
+
+			Match match = { static_cast<size_t>(index), automaton_.PatternLength(index) + bytes.size() - i - 1, 0 };
+			size_t covered = 0;
+			for (auto it = state.token_lengths.rbegin(); it != state.token_lengths.rend() && covered < match.rollback_bytes; ++it)
+			{
+				covered += *it;
+				++match.rollback_tokens;
+			}
+			return match;
+		}
+
+		// only keep the tokens a future match could reach back into
+		while (state.token_lengths.size() > 1 &&
+			state.recent_bytes - state.token_lengths.front() >= automaton_.MaxPatternLength())
+		{
+			state.recent_bytes -= state.token_lengths.front();
+			state.token_lengths.pop_front();
+		}
+		return std::nullopt;
+	}
+
+	namespace
+	{
+		// beyond this many distinct first bytes a table lookup beats the SIMD compares
+		constexpr size_t kMaxSimdFirstBytes = 8;
+	} // namespace
+
+	AddedTokenSplitter::AddedTokenSplitter(const std::vector<std::string_view>& tokens, const std::vector<uint32_t>& ids)
+		: automaton_(tokens), ids_(ids)
+	{
+		if (tokens.size() != ids.size())
+			throw std::invalid_argument("AddedTokenSplitter: tokens and ids differ in size");
+
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			if (tokens[i].empty())
+				continue;
+			tokens_by_id_.emplace(ids[i], std::string(tokens[i]));
+			uint8_t first = static_cast<uint8_t>(tokens[i][0]);
+			if (!is_first_byte_[first])
+			{
+				is_first_byte_[first] = true;
+				first_bytes_.push_back(first);
+			}
+		}
+	}
+
+	std::vector<AddedTokenSplitter::Segment> AddedTokenSplitter::Split(std::string_view text) const
+	{
+		std::vector<Segment> segments;
+		Split(text, [&](const Segment& segment) { segments.push_back(segment); });
+		return segments;
+	}
+
+	int32_t AddedTokenSplitter::FindNext(std::string_view text, size_t from, size_t& begin, size_t& end) const
+	{
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(text.data());
+		const size_t n = text.size();
+
+		int32_t best = -1;
+		AhoCorasick::State state = AhoCorasick::kRoot;
+		size_t i = from;
+		while (i < n)
+		{
+			if (state == AhoCorasick::kRoot)
+			{
+				// no token is partially matched, skip to a byte that can start one
+				if (best >= 0 || first_bytes_.empty())
+					break;
+				if (first_bytes_.size() <= kMaxSimdFirstBytes)
+					i = simd::find_first_of(data, i, n, first_bytes_.data(), first_bytes_.size());
+				else
+					while (i < n && !is_first_byte_[data[i]])
+						++i;
+				if (i == n)
+					break;
+			}
+
+			state = automaton_.Next(state, data[i++]);
+			int32_t index = automaton_.Output(state);
+			if (index >= 0)
+			{
+				// the longest token ending here starts the earliest
+				size_t length = automaton_.PatternLength(index);
+				if (best < 0 || i - length < begin || (i - length == begin && i > end))
+				{
+					best = index;
+					begin = i - length;
+					end = i;
+				}
+			}
+			// every partial match in flight starts after the best match
+			if (best >= 0 && i - automaton_.Depth(state) > begin)
+				break;
+		}
+		return best;
+	}
+} // namespace tokenizers
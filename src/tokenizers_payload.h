@@ -0,0 +1,43 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_payload.h
+ * \brief Counted result payloads shared by the tokenizer backends
+ */
+#ifndef TOKENIZERS_PAYLOAD_H_
+#define TOKENIZERS_PAYLOAD_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace tokenizers
+{
+	/*! \brief Number of live payloads, see Tokenizer::OutstandingPayloads. */
+	extern std::atomic<size_t> outstanding_payloads;
+
+	template <class _Ty>
+	struct CountedPayload : public _Ty
+	{
+		template <class... _Args>
+		inline CountedPayload(_Args&&... args) : _Ty(std::forward<_Args>(args)...)
+		{
+			outstanding_payloads.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		CountedPayload(const CountedPayload&) = delete;
+
+		inline ~CountedPayload() { outstanding_payloads.fetch_sub(1, std::memory_order_relaxed); }
+	};
+
+	/*!
+	 * \brief Allocate the object an Encoding, EncodingBatch or Decoding keeps
+	 *  alive, counted until the last result sharing it is gone.
+	 */
+	template <class _Ty, class... _Args>
+	inline std::shared_ptr<_Ty> make_payload(_Args&&... args)
+	{
+		return std::make_shared<CountedPayload<_Ty>>(std::forward<_Args>(args)...);
+	}
+} // namespace tokenizers
+#endif // TOKENIZERS_PAYLOAD_H_
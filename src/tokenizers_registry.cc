@@ -0,0 +1,216 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_registry.cc
+ */
+#include "tokenizers_registry.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace tokenizers
+{
+	namespace
+	{
+		inline uint64_t mix64(uint64_t x)
+		{
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+
+		// two independent 64-bit lanes, so distinct blobs practically never share a key
+		inline std::pair<uint64_t, uint64_t> hash128(std::string_view s)
+		{
+			uint64_t a = 0x9E3779B97F4A7C15ULL ^ s.size();
+			uint64_t b = 0xC2B2AE3D27D4EB4FULL + s.size();
+			size_t i = 0;
+			for (; i + 8 <= s.size(); i += 8)
+			{
+				uint64_t w;
+				std::memcpy(&w, s.data() + i, 8);
+				a = mix64(a ^ w);
+				b = mix64(b + w) ^ (b >> 29);
+			}
+			uint64_t tail = 0;
+			if (i < s.size())
+				std::memcpy(&tail, s.data() + i, s.size() - i);
+			return { mix64(a ^ tail), mix64(b + tail) };
+		}
+
+		std::string read_file(std::string_view path)
+		{
+			std::ifstream file(std::string(path), std::ios::binary);
+			if (!file)
+				throw std::runtime_error("TokenizerRegistry: cannot open " + std::string(path));
+			std::ostringstream contents;
+			contents << file.rdbuf();
+			return contents.str();
+		}
+	} // namespace
+
+	TokenizerSource TokenizerSource::JSONFile(std::string_view path)
+	{
+		return { Format::kJSON, read_file(path) };
+	}
+
+	TokenizerSource TokenizerSource::SentencePieceFile(std::string_view path)
+	{
+		return { Format::kSentencePiece, read_file(path) };
+	}
+
+	TokenizerRegistry& TokenizerRegistry::Instance()
+	{
+		static TokenizerRegistry registry;
+		return registry;
+	}
+
+	TokenizerRegistry::TokenizerRegistry() : state_(std::make_shared<State>())
+	{
+	}
+
+	TokenizerRegistry::Key TokenizerRegistry::MakeKey(const TokenizerSource& source)
+	{
+		auto [a, b] = hash128(source.blob);
+		return { static_cast<int>(source.format), a, b, source.blob.size() };
+	}
+
+	std::unique_ptr<Tokenizer> TokenizerRegistry::Load(const TokenizerSource& source)
+	{
+		switch (source.format)
+		{
+		case TokenizerSource::Format::kJSON:
+			return Tokenizer::FromBlobJSON(source.blob);
+		case TokenizerSource::Format::kSentencePiece:
+			return Tokenizer::FromBlobSentencePiece(source.blob);
+		case TokenizerSource::Format::kRWKVWorld:
+			return Tokenizer::FromBlobRWKVWorld(source.blob);
+		}
+		throw std::invalid_argument("TokenizerRegistry: unknown format");
+	}
+
+	std::shared_ptr<Tokenizer> TokenizerRegistry::Get(const TokenizerSource& source)
+	{
+		Key key = MakeKey(source);
+		State& state = *state_;
+
+		std::unique_lock<std::mutex> lock(state.mutex);
+		bool waited = false;
+		while (true)
+		{
+			// looked up again after waiting, the entry may have been unloaded meanwhile
+			Entry& entry = state.entries[key];
+			if (auto tokenizer = entry.tokenizer.lock())
+				return tokenizer;
+			if (!entry.loading)
+			{
+				if (waited && entry.error)
+					std::rethrow_exception(entry.error);
+				entry.loading = true;
+				entry.error = nullptr;
+				break;
+			}
+			state.loaded.wait(lock);
+			waited = true;
+		}
+		lock.unlock();
+
+		std::unique_ptr<Tokenizer> loaded;
+		std::exception_ptr error;
+		try
+		{
+			loaded = Load(source);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		std::shared_ptr<Tokenizer> tokenizer;
+		if (loaded)
+		{
+			// drop the entry with the last reference, unless it was loaded again meanwhile
+			std::weak_ptr<State> weak_state = state_;
+			tokenizer = std::shared_ptr<Tokenizer>(loaded.release(), [weak_state, key](Tokenizer* ptr) {
+				delete ptr;
+				if (auto state = weak_state.lock())
+				{
+					std::unique_lock<std::mutex> lock(state->mutex);
+					auto iter = state->entries.find(key);
+					if (iter != state->entries.end() && !iter->second.loading && iter->second.tokenizer.expired())
+						state->entries.erase(iter);
+				}
+			});
+		}
+
+		lock.lock();
+		Entry& entry = state.entries[key];
+		entry.loading = false;
+		entry.tokenizer = tokenizer;
+		entry.error = error;
+		lock.unlock();
+		state.loaded.notify_all();
+
+		if (error)
+			std::rethrow_exception(error);
+		return tokenizer;
+	}
+
+	std::shared_future<std::shared_ptr<Tokenizer>> TokenizerRegistry::GetAsync(TokenizerSource source)
+	{
+		return std::async(std::launch::async, [this, source = std::move(source)]() { return Get(source); }).share();
+	}
+
+	size_t TokenizerRegistry::Size()
+	{
+		std::unique_lock<std::mutex> lock(state_->mutex);
+		size_t size = 0;
+		for (auto& [key, entry] : state_->entries)
+		{
+			if (entry.loading || !entry.tokenizer.expired())
+				++size;
+		}
+		return size;
+	}
+
+	LazyTokenizer::LazyTokenizer(TokenizerSource source, TokenizerRegistry& registry)
+		: source_(std::move(source)), registry_(registry)
+	{
+	}
+
+	void LazyTokenizer::Prefetch()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!future_.valid())
+			future_ = registry_.GetAsync(source_);
+	}
+
+	std::shared_ptr<Tokenizer> LazyTokenizer::Get()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!future_.valid())
+		{
+			// run by the first get() below, on the calling thread
+			future_ = std::async(std::launch::deferred, [this]() { return registry_.Get(source_); }).share();
+		}
+		auto future = future_;
+		lock.unlock();
+		return future.get();
+	}
+
+	bool LazyTokenizer::Ready()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return future_.valid() && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	void LazyTokenizer::Release()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		future_ = {};
+	}
+} // namespace tokenizers
@@ -12,6 +12,13 @@ void* tokenizers::alloc_string(size_t len, void* args)
 	return const_cast<char*>(str->data());
 }
 
+void* tokenizers::resize_string(size_t len, void* args)
+{
+	std::string* str = reinterpret_cast<std::string*>(args);
+	str->resize(len);
+	return str->data();
+}
+
 ::rust::ArrayHandle tokenizers::fetch_string(void* arr, size_t offset)
 {
 	std::vector<std::string>* strs = reinterpret_cast<std::vector<std::string>*>(arr);
@@ -0,0 +1,250 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_simd.h
+ * \brief Small SIMD kernels shared by the C++ tokenizer paths
+ */
+#ifndef TOKENIZERS_SIMD_H_
+#define TOKENIZERS_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOKENIZERS_SIMD_SSE2
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define TOKENIZERS_SIMD_NEON
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define TOKENIZERS_SIMD_WASM
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace tokenizers
+{
+	namespace simd
+	{
+		inline unsigned count_trailing_zeros(uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		inline unsigned count_leading_zeros(uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanReverse(&index, mask);
+			return 31 - index;
+#else
+			return __builtin_clz(mask);
+#endif
+		}
+
+		/*! \brief 16 bytes holding value repeated. */
+		template <class _Ty>
+		inline void broadcast_bytes(_Ty value, uint8_t* pattern)
+		{
+			for (size_t k = 0; k < 16; k += sizeof(_Ty))
+				std::memcpy(pattern + k, &value, sizeof(_Ty));
+		}
+
+		/*!
+		 * \brief Index of the first element of data[0, n) different from value, n if none.
+		 *  Elements are compared bytewise, 16 bytes at a time.
+		 */
+		template <class _Ty>
+		inline size_t find_first_not_equal(const _Ty* data, size_t n, _Ty value)
+		{
+			size_t i = 0;
+#if defined(TOKENIZERS_SIMD_SSE2) || defined(TOKENIZERS_SIMD_NEON) || defined(TOKENIZERS_SIMD_WASM)
+			constexpr size_t kLanes = 16 / sizeof(_Ty);
+			alignas(16) uint8_t pattern[16];
+			broadcast_bytes(value, pattern);
+#endif
+#if defined(TOKENIZERS_SIMD_SSE2)
+			const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern));
+			for (; i + kLanes <= n; i += kLanes)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				uint32_t diff = ~_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)) & 0xFFFF;
+				if (diff)
+					return i + count_trailing_zeros(diff) / sizeof(_Ty);
+			}
+#elif defined(TOKENIZERS_SIMD_NEON)
+			const uint8x16_t v = vld1q_u8(pattern);
+			for (; i + kLanes <= n; i += kLanes)
+			{
+				uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i)), v);
+				if (vminvq_u8(eq) != 0xFF)
+					break;
+			}
+#elif defined(TOKENIZERS_SIMD_WASM)
+			const v128_t v = wasm_v128_load(pattern);
+			for (; i + kLanes <= n; i += kLanes)
+			{
+				uint32_t diff = ~wasm_i8x16_bitmask(wasm_i8x16_eq(wasm_v128_load(data + i), v)) & 0xFFFF;
+				if (diff)
+					return i + count_trailing_zeros(diff) / sizeof(_Ty);
+			}
+#endif
+			for (; i < n; ++i)
+			{
+				if (data[i] != value)
+					return i;
+			}
+			return n;
+		}
+
+		/*!
+		 * \brief Index of the last element of data[0, n) different from value, n if none.
+		 */
+		template <class _Ty>
+		inline size_t find_last_not_equal(const _Ty* data, size_t n, _Ty value)
+		{
+			size_t i = n;
+#if defined(TOKENIZERS_SIMD_SSE2) || defined(TOKENIZERS_SIMD_NEON) || defined(TOKENIZERS_SIMD_WASM)
+			constexpr size_t kLanes = 16 / sizeof(_Ty);
+			alignas(16) uint8_t pattern[16];
+			broadcast_bytes(value, pattern);
+#endif
+#if defined(TOKENIZERS_SIMD_SSE2)
+			const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern));
+			for (; i >= kLanes; i -= kLanes)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i - kLanes));
+				uint32_t diff = ~_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)) & 0xFFFF;
+				if (diff)
+					return i - kLanes + (31 - count_leading_zeros(diff)) / sizeof(_Ty);
+			}
+#elif defined(TOKENIZERS_SIMD_NEON)
+			const uint8x16_t v = vld1q_u8(pattern);
+			for (; i >= kLanes; i -= kLanes)
+			{
+				uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i - kLanes)), v);
+				if (vminvq_u8(eq) != 0xFF)
+					break;
+			}
+#elif defined(TOKENIZERS_SIMD_WASM)
+			const v128_t v = wasm_v128_load(pattern);
+			for (; i >= kLanes; i -= kLanes)
+			{
+				uint32_t diff = ~wasm_i8x16_bitmask(wasm_i8x16_eq(wasm_v128_load(data + i - kLanes), v)) & 0xFFFF;
+				if (diff)
+					return i - kLanes + (31 - count_leading_zeros(diff)) / sizeof(_Ty);
+			}
+#endif
+			while (i > 0)
+			{
+				if (data[--i] != value)
+					return i;
+			}
+			return n;
+		}
+
+		/*!
+		 * \brief First index in [begin, end) with values[index] <= bound, end if none.
+		 */
+		inline size_t find_first_at_most_u16(const uint16_t* values, size_t begin, size_t end, uint16_t bound)
+		{
+			size_t i = begin;
+#if defined(TOKENIZERS_SIMD_SSE2)
+			const __m128i b = _mm_set1_epi16(static_cast<short>(bound));
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= end; i += 8)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+				// saturating v - bound is zero exactly when v <= bound
+				uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(v, b), zero));
+				if (mask)
+					return i + count_trailing_zeros(mask) / 2;
+			}
+#elif defined(TOKENIZERS_SIMD_NEON)
+			const uint16x8_t b = vdupq_n_u16(bound);
+			for (; i + 8 <= end; i += 8)
+			{
+				uint16x8_t le = vcleq_u16(vld1q_u16(values + i), b);
+				if (vmaxvq_u16(le))
+					break;
+			}
+#elif defined(TOKENIZERS_SIMD_WASM)
+			const v128_t b = wasm_i16x8_splat(static_cast<int16_t>(bound));
+			for (; i + 8 <= end; i += 8)
+			{
+				v128_t le = wasm_u16x8_le(wasm_v128_load(values + i), b);
+				uint32_t mask = wasm_i16x8_bitmask(le);
+				if (mask)
+					return i + count_trailing_zeros(mask);
+			}
+#endif
+			for (; i < end; ++i)
+			{
+				if (values[i] <= bound)
+					return i;
+			}
+			return end;
+		}
+
+		/*!
+		 * \brief First index in [begin, end) whose byte is one of set[0, set_size), end if none.
+		 *  Meant for small sets, each set byte costs one compare per 16 bytes.
+		 */
+		inline size_t find_first_of(const uint8_t* data, size_t begin, size_t end, const uint8_t* set, size_t set_size)
+		{
+			size_t i = begin;
+#if defined(TOKENIZERS_SIMD_SSE2)
+			for (; i + 16 <= end; i += 16)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				__m128i hit = _mm_setzero_si128();
+				for (size_t k = 0; k < set_size; ++k)
+					hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(set[k]))));
+				uint32_t mask = _mm_movemask_epi8(hit);
+				if (mask)
+					return i + count_trailing_zeros(mask);
+			}
+#elif defined(TOKENIZERS_SIMD_NEON)
+			for (; i + 16 <= end; i += 16)
+			{
+				uint8x16_t x = vld1q_u8(data + i);
+				uint8x16_t hit = vdupq_n_u8(0);
+				for (size_t k = 0; k < set_size; ++k)
+					hit = vorrq_u8(hit, vceqq_u8(x, vdupq_n_u8(set[k])));
+				if (vmaxvq_u8(hit))
+					break;
+			}
+#elif defined(TOKENIZERS_SIMD_WASM)
+			for (; i + 16 <= end; i += 16)
+			{
+				v128_t x = wasm_v128_load(data + i);
+				v128_t hit = wasm_i8x16_splat(0);
+				for (size_t k = 0; k < set_size; ++k)
+					hit = wasm_v128_or(hit, wasm_i8x16_eq(x, wasm_i8x16_splat(static_cast<int8_t>(set[k]))));
+				uint32_t mask = wasm_i8x16_bitmask(hit);
+				if (mask)
+					return i + count_trailing_zeros(mask);
+			}
+#endif
+			for (; i < end; ++i)
+			{
+				for (size_t k = 0; k < set_size; ++k)
+				{
+					if (data[i] == set[k])
+						return i;
+				}
+			}
+			return end;
+		}
+	} // namespace simd
+} // namespace tokenizers
+#endif // TOKENIZERS_SIMD_H_
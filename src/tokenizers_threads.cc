@@ -0,0 +1,132 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_threads.cc
+ */
+#include "tokenizers_threads.h"
+
+#include "tokenizers_c.h"
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace tokenizers
+{
+	namespace
+	{
+		struct PoolConfig
+		{
+			ThreadPoolOptions options;
+		};
+
+		// workers of a replaced pool may still be starting and reading their
+		// config, so configs live as long as the process
+		std::mutex configs_mutex;
+		std::vector<std::unique_ptr<PoolConfig>> configs;
+
+		void on_thread_start(size_t index, void* user_data)
+		{
+			auto& cpus = static_cast<PoolConfig*>(user_data)->options.cpus;
+			if (!cpus.empty())
+				ThreadPool::PinCurrentThread(cpus[index % cpus.size()]);
+		}
+
+		int32_t spawn_worker(void (*worker_main)(void*), void* worker, void* user_data)
+		{
+			try
+			{
+				static_cast<PoolConfig*>(user_data)->options.spawn([worker_main, worker]() { worker_main(worker); });
+				return 0;
+			}
+			catch (...)
+			{
+				return -1;
+			}
+		}
+
+		struct ParallelForContext
+		{
+			const std::function<void(size_t)>* fn;
+			std::mutex mutex;
+			std::exception_ptr error;
+		};
+
+		// exceptions must not cross the Rust frames
+		void parallel_for_body(void* ctx, size_t index)
+		{
+			auto* context = static_cast<ParallelForContext*>(ctx);
+			try
+			{
+				(*context->fn)(index);
+			}
+			catch (...)
+			{
+				std::unique_lock<std::mutex> lock(context->mutex);
+				if (!context->error)
+					context->error = std::current_exception();
+			}
+		}
+	} // namespace
+
+	void ThreadPool::Configure(const ThreadPoolOptions& options)
+	{
+		std::unique_lock<std::mutex> lock(configs_mutex);
+		auto config = std::make_unique<PoolConfig>(PoolConfig{ options });
+
+		::rust::ThreadPoolConfig raw{};
+		raw.num_threads = options.num_threads;
+		raw.on_thread_start = options.cpus.empty() ? nullptr : on_thread_start;
+		raw.spawn = options.spawn ? spawn_worker : nullptr;
+		raw.user_data = config.get();
+
+		if (tokenizers_configure_thread_pool(&raw) != 0)
+			throw std::runtime_error("ThreadPool: cannot start the tokenizer workers");
+		if (options.num_threads)
+			configs.push_back(std::move(config));
+	}
+
+	void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)>& fn)
+	{
+		if (n == 0)
+			return;
+		if (n == 1)
+		{
+			fn(0);
+			return;
+		}
+
+		ParallelForContext context;
+		context.fn = &fn;
+		tokenizers_parallel_for(n, parallel_for_body, &context);
+		if (context.error)
+			std::rethrow_exception(context.error);
+	}
+
+	bool ThreadPool::PinCurrentThread(int cpu)
+	{
+		if (cpu < 0)
+			return false;
+#if defined(_WIN32)
+		if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+			return false;
+		return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+		if (cpu >= CPU_SETSIZE)
+			return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+} // namespace tokenizers
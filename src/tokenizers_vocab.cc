@@ -0,0 +1,213 @@
+/*!
+ *  Copyright (c) 2025 by Contributors
+ * \file tokenizers_vocab.cc
+ */
+#include "tokenizers_vocab.h"
+
+#include "tokenizers_simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace tokenizers
+{
+	namespace
+	{
+		constexpr uint64_t kGolden = 0x9E3779B97F4A7C15ULL;
+		// the displacement search practically never goes beyond a few hundred
+		constexpr uint32_t kMaxSeed = 1u << 24;
+
+		inline uint64_t mix64(uint64_t x)
+		{
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+
+		inline uint64_t hash_bytes(std::string_view s)
+		{
+			uint64_t h = kGolden ^ s.size();
+			size_t i = 0;
+			for (; i + 8 <= s.size(); i += 8)
+			{
+				uint64_t w;
+				std::memcpy(&w, s.data() + i, 8);
+				h = mix64(h ^ w);
+			}
+			uint64_t tail = 0;
+			if (i < s.size())
+				std::memcpy(&tail, s.data() + i, s.size() - i);
+			// the tail never fills the top byte, keep the length there so that
+			// e.g. "\x03" and "\x00\x00" do not collide through the seed
+			tail |= static_cast<uint64_t>(s.size()) << 56;
+			return mix64(h ^ tail);
+		}
+
+		inline size_t bucket_index(uint64_t h, size_t num_buckets)
+		{
+			return static_cast<size_t>(h >> 32) % num_buckets;
+		}
+
+		inline size_t slot_index(uint64_t h, uint32_t seed, size_t num_slots)
+		{
+			return static_cast<size_t>(mix64(h ^ (seed * kGolden + 1)) % num_slots);
+		}
+	} // namespace
+
+	VocabTable::VocabTable(const std::vector<std::string_view>& tokens)
+	{
+		size_t total = 0;
+		for (auto& token : tokens)
+			total += token.size();
+
+		blob_.reserve(total);
+		offsets_.reserve(tokens.size() + 1);
+		offsets_.push_back(0);
+		for (auto& token : tokens)
+		{
+			blob_.append(token);
+			offsets_.push_back(static_cast<uint32_t>(blob_.size()));
+		}
+
+		// keys of the perfect hash: non-empty tokens, smallest id for duplicates
+		std::vector<uint32_t> keys;
+		keys.reserve(tokens.size());
+		for (uint32_t id = 0; id < tokens.size(); ++id)
+		{
+			if (!tokens[id].empty())
+				keys.push_back(id);
+		}
+		std::stable_sort(keys.begin(), keys.end(), [&](uint32_t a, uint32_t b) { return tokens[a] < tokens[b]; });
+		keys.erase(std::unique(keys.begin(), keys.end(), [&](uint32_t a, uint32_t b) { return tokens[a] == tokens[b]; }),
+			keys.end());
+
+		size_t n = keys.size();
+		if (!n)
+		{
+			image_ = { blob_, offsets_.data(), offsets_.size() };
+			return;
+		}
+
+		size_t num_buckets = (n + 3) / 4;
+		std::vector<uint64_t> hashes(n);
+		std::vector<uint32_t> bucket_start(num_buckets + 1, 0);
+		for (size_t i = 0; i < n; ++i)
+		{
+			hashes[i] = hash_bytes(tokens[keys[i]]);
+			++bucket_start[bucket_index(hashes[i], num_buckets) + 1];
+		}
+		for (size_t b = 0; b < num_buckets; ++b)
+			bucket_start[b + 1] += bucket_start[b];
+
+		// keys grouped by bucket
+		std::vector<uint32_t> members(n);
+		std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+		for (uint32_t i = 0; i < n; ++i)
+			members[fill[bucket_index(hashes[i], num_buckets)]++] = i;
+
+		// place the largest buckets first while the table is still empty
+		std::vector<uint32_t> order(num_buckets);
+		for (uint32_t b = 0; b < num_buckets; ++b)
+			order[b] = b;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return bucket_start[a + 1] - bucket_start[a] > bucket_start[b + 1] - bucket_start[b];
+		});
+
+		seeds_.assign(num_buckets, 0);
+		slots_.assign(n, kNotFound);
+		std::vector<size_t> candidate;
+		for (uint32_t b : order)
+		{
+			uint32_t begin = bucket_start[b], end = bucket_start[b + 1];
+			if (begin == end)
+				break;
+
+			uint32_t seed = 0;
+			for (; seed < kMaxSeed; ++seed)
+			{
+				candidate.clear();
+				bool ok = true;
+				for (uint32_t k = begin; k < end && ok; ++k)
+				{
+					size_t slot = slot_index(hashes[members[k]], seed, n);
+					ok = slots_[slot] == kNotFound &&
+						std::find(candidate.begin(), candidate.end(), slot) == candidate.end();
+					candidate.push_back(slot);
+				}
+				if (ok)
+					break;
+			}
+			if (seed == kMaxSeed)
+				throw std::runtime_error("VocabTable: failed to build the perfect hash");
+
+			seeds_[b] = seed;
+			for (uint32_t k = begin; k < end; ++k)
+				slots_[candidate[k - begin]] = keys[members[k]];
+		}
+		image_ = { blob_, offsets_.data(), offsets_.size(), seeds_.data(), seeds_.size(), slots_.data(), slots_.size() };
+	}
+
+	std::shared_ptr<VocabTable> VocabTable::FromImage(const Image& image)
+	{
+		if ((image.num_offsets && !image.offsets) || (image.num_slots && (!image.num_seeds || !image.seeds || !image.slots)))
+			throw std::invalid_argument("VocabTable: incomplete image");
+		if (image.num_offsets && image.offsets[image.num_offsets - 1] > image.blob.size())
+			throw std::invalid_argument("VocabTable: image offsets exceed its blob");
+
+		auto table = std::make_shared<VocabTable>();
+		table->image_ = image;
+		return table;
+	}
+
+	uint32_t VocabTable::TokenToId(std::string_view token) const
+	{
+		if (!image_.num_slots)
+			return kNotFound;
+
+		uint64_t h = hash_bytes(token);
+		uint32_t seed = image_.seeds[bucket_index(h, image_.num_seeds)];
+		uint32_t id = image_.slots[slot_index(h, seed, image_.num_slots)];
+		return IdToToken(id) == token ? id : kNotFound;
+	}
+
+	TokenBytesIndex::TokenBytesIndex(std::shared_ptr<const VocabTable> decoded) : decoded_(std::move(decoded))
+	{
+		const VocabTable& table = *decoded_;
+		order_.reserve(table.Size());
+		for (uint32_t id = 0; id < table.Size(); ++id)
+		{
+			if (table.TokenLength(id))
+				order_.push_back(id);
+		}
+		std::stable_sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+			return table.IdToToken(a) < table.IdToToken(b);
+		});
+
+		lcp_.resize(order_.size(), 0);
+		for (size_t i = 1; i < order_.size(); ++i)
+		{
+			auto prev = table.IdToToken(order_[i - 1]);
+			auto cur = table.IdToToken(order_[i]);
+			size_t len = std::min({ prev.size(), cur.size(), size_t(UINT16_MAX) });
+			size_t shared = 0;
+			while (shared < len && prev[shared] == cur[shared])
+				++shared;
+			lcp_[i] = static_cast<uint16_t>(shared);
+		}
+	}
+
+	void TokenBytesIndex::FillMask(ByteAcceptor& acceptor, uint32_t* bitmask) const
+	{
+		FillMask<ByteAcceptor>(acceptor, bitmask);
+	}
+
+	size_t TokenBytesIndex::SkipRejected(size_t begin, size_t depth) const
+	{
+		uint16_t bound = static_cast<uint16_t>(std::min(depth, size_t(UINT16_MAX)));
+		return simd::find_first_at_most_u16(lcp_.data(), begin, lcp_.size(), bound);
+	}
+} // namespace tokenizers
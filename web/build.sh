@@ -3,13 +3,33 @@ set -euxo pipefail
 
 rustup target add wasm32-unknown-emscripten
 
-mkdir -p build
-cd build
-emcmake cmake ../.. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_FLAGS="-O3 -DCOMPILE_WASM_RUNTIME"
-emmake make tokenizers_cpp tokenizers_c sentencepiece-static -j8
-cd ..
-
-emcc --bind -o src/tokenizers_binding.js src/tokenizers_binding.cc\
-  build/libtokenizers_cpp.a build/libtokenizers_c.a   build/sentencepiece/src/libsentencepiece.a\
- -O3 -s EXPORT_ES6=1 -s ERROR_ON_UNDEFINED_SYMBOLS=0 -s NO_DYNAMIC_EXECUTION=1 -s MODULARIZE=1 -s SINGLE_FILE=1 -s EXPORTED_RUNTIME_METHODS=FS -s ALLOW_MEMORY_GROWTH=1\
- -I../include
+# build_variant <build dir> <output js> <extra compile flags> <rust flags>
+build_variant() {
+  mkdir -p $1
+  cd $1
+  # cmake hands cargo its own RUSTFLAGS, an exported one would be overridden
+  emcmake cmake ../.. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_FLAGS="-O3 -DCOMPILE_WASM_RUNTIME $3"\
+    -DTOKENIZERS_CPP_RUST_FLAGS="$4"
+  emmake make tokenizers_cpp tokenizers_c sentencepiece-static -j8
+  cd ..
+
+  emcc --bind -o $2 src/tokenizers_binding.cc\
+    $1/libtokenizers_cpp.a $1/libtokenizers_c.a $1/sentencepiece/src/libsentencepiece.a\
+   -O3 $3 -s EXPORT_ES6=1 -s ERROR_ON_UNDEFINED_SYMBOLS=0 -s NO_DYNAMIC_EXECUTION=1 -s MODULARIZE=1 -s SINGLE_FILE=1 -s EXPORTED_RUNTIME_METHODS=FS -s ALLOW_MEMORY_GROWTH=1\
+   -s ENVIRONMENT=web,worker,node\
+   -I../include
+}
+
+build_variant build src/tokenizers_binding.js "" ""
+
+# wasm128 variant, picked at load time when the runtime validates SIMD code
+build_variant build-simd src/tokenizers_binding_simd.js "-msimd128" "-C target-feature=+simd128"
+
+# both halves of the SIMD variant must contain SIMD code
+OBJDUMP="$(dirname "$(which emcc)")/../bin/llvm-objdump"
+for lib in build-simd/libtokenizers_c.a build-simd/libtokenizers_cpp.a; do
+  if ! "$OBJDUMP" -d $lib | grep -E "(v128|i8x16|i16x8|i32x4|i64x2)\." > /dev/null; then
+    echo "$lib has no simd128 instructions" >&2
+    exit 1
+  fi
+done
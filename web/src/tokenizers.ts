@@ -1,10 +1,25 @@
 import Module from "./tokenizers_binding"
+import SIMDModule from "./tokenizers_binding_simd"
 
 let binding: any = null;
 
+// A module using one v128 instruction, valid only where wasm SIMD is supported.
+const simdProbe = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0,
+  65, 0, 253, 15, 253, 98, 11
+]);
+
+function hasWasmSIMD(): boolean {
+  try {
+    return WebAssembly.validate(simdProbe);
+  } catch (err) {
+    return false;
+  }
+}
+
 async function asyncInitTokenizers() {
   if (binding == null) {
-    binding = await Module();
+    binding = hasWasmSIMD() ? await SIMDModule() : await Module();
   }
 }
 
@@ -54,6 +69,87 @@ export class Tokenizer {
     return res;
   }
 
+  /**
+   * Encode a batch of texts with a single call into wasm.
+   *
+   * The texts are UTF-8 encoded straight into one wasm buffer and the ids
+   * come back as one buffer, the result rows are views into a single copy of it.
+   *
+   * @param texts Input texts.
+   * @param addSpecialTokens Whether to add the special tokens.
+   * @returns The output tokens of each text.
+   */
+  encodeBatch(texts: string[], addSpecialTokens = true): Int32Array[] {
+    const batch = new binding.PackedBatch();
+    try {
+      let capacity = 0;
+      for (const text of texts) {
+        capacity += text.length * 3;
+      }
+      batch.AllocText(capacity);
+      batch.AllocTextOffsets(texts.length);
+      // take the views after allocating, growth detaches earlier ones
+      const bytes: Uint8Array = batch.Text();
+      const offsets: Uint32Array = batch.TextOffsets();
+      const encoder = new TextEncoder();
+      let pos = 0;
+      for (let i = 0; i < texts.length; ++i) {
+        pos += encoder.encodeInto(texts[i], bytes.subarray(pos)).written ?? 0;
+        offsets[i + 1] = pos;
+      }
+
+      this.handle.EncodePacked(batch, addSpecialTokens);
+      const ids: Int32Array = batch.Ids().slice();
+      const idOffsets: Uint32Array = batch.IdOffsets();
+      const res: Int32Array[] = [];
+      for (let i = 0; i < texts.length; ++i) {
+        res.push(ids.subarray(idOffsets[i], idOffsets[i + 1]));
+      }
+      return res;
+    } finally {
+      batch.delete();
+    }
+  }
+
+  /**
+   * Decode a batch of token id arrays with a single call into wasm.
+   *
+   * @param idsBatch The input ids of each text.
+   * @param skipSpecialTokens Whether to drop special tokens from the output.
+   * @returns The decoded strings.
+   */
+  decodeBatch(idsBatch: Int32Array[], skipSpecialTokens = true): string[] {
+    const batch = new binding.PackedBatch();
+    try {
+      let total = 0;
+      for (const ids of idsBatch) {
+        total += ids.length;
+      }
+      batch.AllocIds(total);
+      batch.AllocIdOffsets(idsBatch.length);
+      const ids: Int32Array = batch.Ids();
+      const offsets: Uint32Array = batch.IdOffsets();
+      let pos = 0;
+      for (let i = 0; i < idsBatch.length; ++i) {
+        ids.set(idsBatch[i], pos);
+        pos += idsBatch[i].length;
+        offsets[i + 1] = pos;
+      }
+
+      this.handle.DecodePacked(batch, skipSpecialTokens);
+      const bytes: Uint8Array = batch.Text();
+      const textOffsets: Uint32Array = batch.TextOffsets();
+      const decoder = new TextDecoder();
+      const res: string[] = [];
+      for (let i = 0; i < idsBatch.length; ++i) {
+        res.push(decoder.decode(bytes.subarray(textOffsets[i], textOffsets[i + 1])));
+      }
+      return res;
+    } finally {
+      batch.delete();
+    }
+  }
+
   /**
    * Returns the vocabulary size. Special tokens are considered.
    *
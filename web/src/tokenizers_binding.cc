@@ -2,12 +2,178 @@
 #include <emscripten/bind.h>
 #include <tokenizers_cpp.h>
 
+#include <cstring>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using tokenizers::Tokenizer;
 
 emscripten::val vecIntToView(const std::vector<int>& vec) {
   return emscripten::val(emscripten::typed_memory_view(vec.size(), vec.data()));
 }
 
+/*!
+ * \brief A batch packed into flat buffers of wasm linear memory.
+ *
+ *  Item i of the text side is text[text_offsets[i], text_offsets[i + 1]), item i
+ *  of the id side is ids[id_offsets[i], id_offsets[i + 1]). JS fills one side
+ *  through the Alloc* views, one EncodePacked/DecodePacked call fills the other,
+ *  and JS reads it back through views, so a batch costs one call into wasm.
+ *
+ *  Views alias linear memory: they are detached when memory grows, so take
+ *  them after the last Alloc* call and drop them before the next one.
+ */
+class PackedBatch {
+ public:
+  emscripten::val AllocText(size_t num_bytes) {
+    text_.resize(num_bytes);
+    return Text();
+  }
+
+  emscripten::val AllocTextOffsets(size_t num_items) {
+    text_offsets_.assign(num_items + 1, 0);
+    return TextOffsets();
+  }
+
+  emscripten::val AllocIds(size_t num_ids) {
+    ids_.resize(num_ids);
+    return Ids();
+  }
+
+  emscripten::val AllocIdOffsets(size_t num_items) {
+    id_offsets_.assign(num_items + 1, 0);
+    return IdOffsets();
+  }
+
+  emscripten::val Text() const {
+    return emscripten::val(emscripten::typed_memory_view(text_.size(), text_.data()));
+  }
+
+  emscripten::val TextOffsets() const {
+    return emscripten::val(
+        emscripten::typed_memory_view(text_offsets_.size(), text_offsets_.data()));
+  }
+
+  emscripten::val Ids() const {
+    return emscripten::val(emscripten::typed_memory_view(
+        ids_.size(), reinterpret_cast<const int32_t*>(ids_.data())));
+  }
+
+  emscripten::val IdOffsets() const {
+    return emscripten::val(emscripten::typed_memory_view(id_offsets_.size(), id_offsets_.data()));
+  }
+
+  void Encode(Tokenizer& tok, bool add_special_tokens) {
+    CheckOffsets(text_offsets_, text_.size());
+    size_t n = text_offsets_.size() - 1;
+    std::vector<std::string_view> texts(n);
+    for (size_t i = 0; i < n; ++i) {
+      texts[i] = std::string_view(reinterpret_cast<const char*>(text_.data()) + text_offsets_[i],
+                                  text_offsets_[i + 1] - text_offsets_[i]);
+    }
+
+    id_offsets_.assign(n + 1, 0);
+    ids_.clear();
+    if (n == 0) return;
+
+    auto batch = tok.EncodeBatch(texts, add_special_tokens);
+    size_t total = 0;
+    for (auto& e : batch.encodings) total += e.ids ? e.ids->size() : 0;
+    ids_.resize(total);
+    for (size_t i = 0; i < n; ++i) {
+      auto& ids = batch.encodings[i].ids;
+      size_t len = ids ? ids->size() : 0;
+      if (len) std::memcpy(ids_.data() + id_offsets_[i], ids->data(), len * sizeof(uint32_t));
+      id_offsets_[i + 1] = id_offsets_[i] + static_cast<uint32_t>(len);
+    }
+  }
+
+  void Decode(Tokenizer& tok, bool skip_special_tokens) {
+    CheckOffsets(id_offsets_, ids_.size());
+    size_t n = id_offsets_.size() - 1;
+    std::vector<tokenizers::array_view<uint32_t>> ids_batch(n);
+    for (size_t i = 0; i < n; ++i) {
+      ids_batch[i] = tokenizers::array_view<uint32_t>(ids_.data() + id_offsets_[i],
+                                                      id_offsets_[i + 1] - id_offsets_[i]);
+    }
+
+    text_offsets_.assign(n + 1, 0);
+    text_.clear();
+    if (n == 0) return;
+
+    auto decodings = tok.DecodeBatch(ids_batch, skip_special_tokens);
+    size_t total = 0;
+    for (auto& d : decodings) total += d.payload.size();
+    text_.resize(total);
+    for (size_t i = 0; i < n; ++i) {
+      std::string_view text = decodings[i];
+      if (!text.empty()) std::memcpy(text_.data() + text_offsets_[i], text.data(), text.size());
+      text_offsets_[i + 1] = text_offsets_[i] + static_cast<uint32_t>(text.size());
+    }
+  }
+
+ private:
+  static void CheckOffsets(const std::vector<uint32_t>& offsets, size_t size) {
+    if (offsets.empty()) throw std::invalid_argument("PackedBatch: offsets are not allocated");
+    for (size_t i = 1; i < offsets.size(); ++i) {
+      if (offsets[i] < offsets[i - 1] || offsets[i] > size)
+        throw std::invalid_argument("PackedBatch: offsets out of order or out of range");
+    }
+  }
+
+  std::vector<uint8_t> text_;
+  std::vector<uint32_t> text_offsets_;
+  std::vector<uint32_t> ids_;
+  std::vector<uint32_t> id_offsets_;
+};
+
+std::shared_ptr<Tokenizer> FromBlobJSON(const std::string& json) {
+  return Tokenizer::FromBlobJSON(json);
+}
+
+std::shared_ptr<Tokenizer> FromBlobByteLevelBPE(const std::string& vocab,
+                                                const std::string& merges,
+                                                const std::string& added_tokens) {
+  return Tokenizer::FromBlobByteLevelBPE(vocab, merges, added_tokens);
+}
+
+std::shared_ptr<Tokenizer> FromBlobSentencePiece(const std::string& model) {
+  return Tokenizer::FromBlobSentencePiece(model);
+}
+
+std::vector<int> Encode(Tokenizer& tok, const std::string& text) {
+  auto encoding = tok.Encode(text);
+  std::vector<int> ids;
+  if (encoding.ids) ids.assign(encoding.ids->begin(), encoding.ids->end());
+  return ids;
+}
+
+std::string Decode(Tokenizer& tok, const std::vector<int>& ids) {
+  std::vector<uint32_t> uids(ids.begin(), ids.end());
+  return std::string(tok.Decode(uids).payload);
+}
+
+void EncodePacked(Tokenizer& tok, PackedBatch& batch, bool add_special_tokens) {
+  batch.Encode(tok, add_special_tokens);
+}
+
+void DecodePacked(Tokenizer& tok, PackedBatch& batch, bool skip_special_tokens) {
+  batch.Decode(tok, skip_special_tokens);
+}
+
+size_t GetVocabSize(Tokenizer& tok) { return tok.GetVocabSize(); }
+
+std::string IdToToken(Tokenizer& tok, uint32_t id) {
+  return std::string(tok.IdToToken(id).payload);
+}
+
+}  // namespace
+
 EMSCRIPTEN_BINDINGS(tokenizers) {
   emscripten::register_vector<int>("VectorInt");
   emscripten::function("vecIntToView", &vecIntToView);
@@ -15,13 +181,26 @@ EMSCRIPTEN_BINDINGS(tokenizers) {
                        emscripten::select_overload<std::vector<int>(const emscripten::val&)>(
                            &emscripten::vecFromJSArray));
 
-  emscripten::class_<tokenizers::Tokenizer>("Tokenizer")
-      .smart_ptr<std::shared_ptr<tokenizers::Tokenizer>>("Tokenizer")
-      .class_function("FromBlobJSON", &tokenizers::Tokenizer::FromBlobJSON)
-      .class_function("FromBlobByteLevelBPE", &tokenizers::Tokenizer::FromBlobByteLevelBPE)
-      .class_function("FromBlobSentencePiece", &tokenizers::Tokenizer::FromBlobSentencePiece)
-      .function("Encode", &tokenizers::Tokenizer::Encode)
-      .function("Decode", &tokenizers::Tokenizer::Decode)
-      .function("GetVocabSize", &tokenizers::Tokenizer::GetVocabSize)
-      .function("IdToToken", &tokenizers::Tokenizer::IdToToken);
+  emscripten::class_<PackedBatch>("PackedBatch")
+      .constructor<>()
+      .function("AllocText", &PackedBatch::AllocText)
+      .function("AllocTextOffsets", &PackedBatch::AllocTextOffsets)
+      .function("AllocIds", &PackedBatch::AllocIds)
+      .function("AllocIdOffsets", &PackedBatch::AllocIdOffsets)
+      .function("Text", &PackedBatch::Text)
+      .function("TextOffsets", &PackedBatch::TextOffsets)
+      .function("Ids", &PackedBatch::Ids)
+      .function("IdOffsets", &PackedBatch::IdOffsets);
+
+  emscripten::class_<Tokenizer>("Tokenizer")
+      .smart_ptr<std::shared_ptr<Tokenizer>>("Tokenizer")
+      .class_function("FromBlobJSON", &FromBlobJSON)
+      .class_function("FromBlobByteLevelBPE", &FromBlobByteLevelBPE)
+      .class_function("FromBlobSentencePiece", &FromBlobSentencePiece)
+      .function("Encode", &Encode)
+      .function("Decode", &Decode)
+      .function("EncodePacked", &EncodePacked)
+      .function("DecodePacked", &DecodePacked)
+      .function("GetVocabSize", &GetVocabSize)
+      .function("IdToToken", &IdToToken);
 }
@@ -0,0 +1,97 @@
+// Checks the packed batch bindings against single-text Encode/Decode under Node.
+//
+//   node tests/node/test_packed_batch.mjs [tokenizer.json]
+//
+// Both the plain and the SIMD build are tested when they have been built.
+import { existsSync, readFileSync } from "fs";
+import { fileURLToPath } from "url";
+
+const srcDir = fileURLToPath(new URL("../../src/", import.meta.url));
+
+async function loadJSON() {
+  if (process.argv.length > 2) {
+    return readFileSync(process.argv[2]);
+  }
+  const res = await fetch("https://huggingface.co/openai/clip-vit-large-patch14/raw/main/tokenizer.json");
+  return new Uint8Array(await res.arrayBuffer());
+}
+
+function assertEqual(a, b, what) {
+  if (JSON.stringify(a) !== JSON.stringify(b)) {
+    throw Error(what + ": expect " + JSON.stringify(b) + " but got " + JSON.stringify(a));
+  }
+}
+
+function encodeOne(binding, tok, text) {
+  const vec = tok.Encode(text);
+  const ids = Array.from(binding.vecIntToView(vec));
+  vec.delete();
+  return ids;
+}
+
+function decodeOne(binding, tok, ids) {
+  const vec = binding.vecIntFromJSArray(ids);
+  const text = tok.Decode(vec);
+  vec.delete();
+  return text;
+}
+
+async function testVariant(file, json, texts) {
+  const Module = (await import(srcDir + file)).default;
+  const binding = await Module();
+  const tok = binding.Tokenizer.FromBlobJSON(json);
+  const batch = new binding.PackedBatch();
+
+  const encoded = texts.map((text) => new TextEncoder().encode(text));
+  const total = encoded.reduce((n, bytes) => n + bytes.length, 0);
+  batch.AllocText(total);
+  batch.AllocTextOffsets(texts.length);
+  const bytes = batch.Text();
+  const offsets = batch.TextOffsets();
+  let pos = 0;
+  encoded.forEach((item, i) => {
+    bytes.set(item, pos);
+    pos += item.length;
+    offsets[i + 1] = pos;
+  });
+
+  tok.EncodePacked(batch, true);
+  const ids = batch.Ids();
+  const idOffsets = batch.IdOffsets();
+  const rows = texts.map((_, i) => Array.from(ids.subarray(idOffsets[i], idOffsets[i + 1])));
+  texts.forEach((text, i) => assertEqual(rows[i], encodeOne(binding, tok, text), file + " encode " + i));
+
+  // decode the ids left in the batch by the encode call
+  tok.DecodePacked(batch, true);
+  const out = batch.Text();
+  const outOffsets = batch.TextOffsets();
+  const decoder = new TextDecoder();
+  rows.forEach((row, i) => {
+    const text = decoder.decode(out.subarray(outOffsets[i], outOffsets[i + 1]));
+    assertEqual(text, decodeOne(binding, tok, row), file + " decode " + i);
+  });
+
+  batch.delete();
+  tok.delete();
+  console.log(file + ": ok");
+}
+
+async function main() {
+  const json = await loadJSON();
+  const texts = ["What is the capital of Canada?", "", "héllo wörld 你好", "a".repeat(1000)];
+  let tested = 0;
+  for (const file of ["tokenizers_binding.js", "tokenizers_binding_simd.js"]) {
+    if (existsSync(srcDir + file)) {
+      await testVariant(file, json, texts);
+      ++tested;
+    }
+  }
+  if (tested === 0) {
+    throw Error("No binding found in " + srcDir + ", run ./build.sh first");
+  }
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});